@@ -30,8 +30,98 @@ Example:
     std::vector<const intpair*> results = db.overlap(22, 25);
     // alternative: db.overlap(22, 25, results);
 
+The builder also offers add(Item&&), emplace(args...) and reserve(n), and build_presorted() skips
+the sort for items added in sorted order. The separate iitii_loader.h (which requires zlib) loads
+BED, VCF & GTF/GFF files, plain or BGZF-compressed, on several threads into sorted runs for it.
+
 Building iitii works the same way, except build() takes a size_t argument giving the number of
-model domains.
+model domains, plus optionally iitii_partition::equal_count to size the domains by item count
+(instead of equal widths), which suits data of very uneven density. Or, build(iitii_auto_domains())
+chooses both automatically, reporting the choice in model_summary(). For very large inputs, a third
+argument iitii_train_options can have the training estimate each level's cost on a sample of the
+items, so that it takes a small fraction of the build time. The builder's threads(n) setting lets
+build() sort, index and train the model using n threads, e.g.
+p_iit::builder(container.begin(), container.end()).threads(8).build().
+
+When the results needn't be materialized, overlap_visit(qbeg, qend, f) calls f(const Item&) on
+each result instead (f may return false to stop early), and overlap_count() & overlap_any() answer
+"how many" and "is there any" without a result vector. overlap_range(qbeg, qend) returns a lazy
+forward iterator (and range) over the same results, advancing the search only as it's advanced:
+
+    for (const intpair& p : db.overlap_range(22, 25)) { ... }
+
+Every overlap query (including overlap_range(), overlap_batch(), sessions and the composite indexes
+below) gives its results in ascending order of begin, then end position, so that results from
+several tracks can be merged without sorting them again. overlap_ranks(qbeg, qend, ranks) gives
+the results' ranks in that sorted order (item_at(rank) being the item) instead of pointers, and
+overlap_rank_runs() coalesces consecutive ranks into [first, last] runs, for merges & set
+operations on compact integers.
+
+For annotation by proximity, nearest(pos) returns the item nearest a position (overlapping it, or
+else the closest upstream or downstream), nearest_upstream(pos) & nearest_downstream(pos) the
+nearest on one side, and k_nearest(pos, k) the k nearest in order of distance. iitii starts these
+from the model's prediction of pos's rank, so they cost about as much as a short overlap query.
+
+For per-window statistics across a whole range, coverage(beg, end, window, out) fills out with the
+item count & depth of each window, and aggregate(windows, out, reduce) folds the items overlapping
+each of a sorted list of windows into its accumulator, both by one sweep over the sorted nodes
+(optionally split across threads) rather than a query per window.
+
+Both classes take an optional Layout template parameter: the default iit_aos stores each Item
+inline with its node, while iit_soa keeps the node keys in a dense array separate from the Items,
+which makes queries much more cache-efficient when Item is large. iit_compact<Offset> is as iit_soa,
+but stores the keys as narrow offsets, to save memory with 64-bit positions. Any of these may be
+wrapped, e.g. as iit_eytzinger<iit_soa>, to also keep a compact breadth-first copy of the
+top levels' keys, which the top-down search and long climbs read instead of the scattered nodes.
+
+If Pos and Item are trivially copyable, an index can be saved to a file with save() and reloaded
+with load(). With NodeArray = iit_mapped_array, load_mmap() instead maps the file and queries it
+in place, so that processes loading the same index share one copy in the page cache:
+
+    db.save("intpairs.iitii");
+    auto db2 = iitii<int, intpair, p_get_beg, p_get_end, iit_mapped_array>::load_mmap("intpairs.iitii");
+
+Other NodeArray implementations control where the node arrays live: iit_hugepage_array maps large
+arrays with huge pages, saving TLB misses on the random probes of big indexes; iit_arena_array
+takes them from an iit_arena (which also serves the build's scratch arrays, when building within
+an iit_arena::scope). iit_numa_replicated<tree> keeps a copy of an index in each NUMA node's local
+memory, answering queries from the copy local to the calling thread.
+
+Queries only read the index, so one index may be shared by any number of concurrent query threads.
+iitii takes an optional sixth template parameter Stats to collect query statistics (see
+iitii_stats_none, iitii_stats_sharded, iitii_stats_atomic and iitii_stats_histograms below); the
+default collects nothing. model_report() describes the model of each domain, exportable as TSV or
+JSON, as are the query histograms of iitii_stats_histograms.
+
+For a dataset receiving a trickle of new items, iitii_updatable (bottom of this file) accepts
+insert() into a small delta index, merging it into a new iitii in the background.
+
+For data on many contigs, iitii_genome (bottom of this file) holds one iitii per contig in shared
+contiguous storage, answering overlap(rid, qbeg, qend) for a dense contig id rid.
+
+For data mixing short & very long intervals (e.g. reads or exons with genes or structural variants),
+iitii_hybrid (bottom of this file) keeps the long ones in a separate small iit, so that they don't
+spoil the iitii model for the rest.
+
+For data too large for one machine, iitii_sharded (bottom of this file) splits the position range
+into shards of equal item counts, each an iitii saved & loaded separately, with a small router
+mapping each query to the shards it needs.
+
+For a stream of queries with locality (e.g. coordinate-sorted), querying through an
+iitii::session sess(db) (one per thread) starts each query from where the last one fell, instead
+of from the model's prediction.
+
+To intersect two whole indexes, a.join(b, f) calls f(const Item&, const OtherItem&) on every
+overlapping pair, by one sweep over both sorted node arrays instead of a query per item (and
+likewise iitii_genome::join, contig by contig).
+
+Many queries can be answered together with overlap_batch(), which interleaves several in-flight
+queries to hide memory latency and returns the results in CSR form (offsets + item pointers):
+
+    std::vector<size_t> offsets;
+    std::vector<const intpair*> items;
+    db.overlap_batch(qbegs, qends, n, offsets, items);
+    // results of query i: items[offsets[i]] ... items[offsets[i+1]-1]
 
 This header file has other helper template classes that allow most code to be shared between iit
 and iitii (without burdening the former with baggage from the latter -- important for fair
@@ -39,12 +129,66 @@ comparative benchmarking). The template structure has gotten a little out of han
 seems to happen.
 */
 
+#pragma once
 #include <vector>
 #include <limits>
 #include <algorithm>
 #include <cmath>
 #include <assert.h>
 #include <functional>
+#include <iterator>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <sched.h>
+#include <pthread.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Subtrees up to the leaf level are scanned linearly, with a branchless kernel testing each whole
+// block of (up to 2^(L+1)-1) nodes against the query at once, vectorized with AVX2 for the iit_soa
+// layout of 32-bit integer positions. The leaf level is 3 for the layouts & positions so
+// vectorized, where the deeper cutoff pays off, and otherwise 2; defining IITII_LEAF_LEVEL sets it
+// for all of them (it may also be set per Layout, with iit_leaf_blocks below). There's no
+// AVX-512 kernel: its 16-lane gathers would take a level-3 block in one step instead of two, but
+// gathers cost about the same per lane, so AVX-512 builds use the AVX2 kernel.
+#ifdef IITII_LEAF_LEVEL
+static_assert(IITII_LEAF_LEVEL >= 1 && IITII_LEAF_LEVEL <= 4, "IITII_LEAF_LEVEL must be 1-4");
+#endif
+
+// is the leaf kernel vectorized for key-only nodes (iit_soa) of Pos positions?
+template<typename Pos>
+constexpr bool iit_simd_leaf_mask() {
+#ifdef __AVX2__
+    return std::is_integral<Pos>::value && sizeof(Pos) == 4;
+#else
+    return false;
+#endif
+}
+
+// the default leaf level (above) for nodes of Pos positions, key-only or not
+template<typename Pos>
+constexpr unsigned iit_default_leaf_level(bool key_only) {
+#ifdef IITII_LEAF_LEVEL
+    return IITII_LEAF_LEVEL;
+#else
+    return key_only && iit_simd_leaf_mask<Pos>() ? 3 : 2;
+#endif
+}
 
 // Base template for the internal representation of a node within an implicit interval tree
 // User should not care about this; subclass instantiations may add more members for more-
@@ -52,13 +196,21 @@ seems to happen.
 template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
 struct iit_node_base {
     static const Pos npos = std::numeric_limits<Pos>::max();  // reserved constant for invalid Pos
+    static const bool has_item = true;      // the Item is stored inline (array-of-structs layout)
+    static const bool has_outside_max_end = false;
+    static const bool compact = false;      // see iit_compact_node
+    typedef iit_node_base<Pos, Item, get_beg, get_end> build_node;  // node type sorted by builder
 
     Item item;
-    Pos inside_max_end;   // max end of this & subtree (as in textbook augmented interval tree)
+    Pos inside_max_end_;  // max end of this & subtree (as in textbook augmented interval tree)
 
     iit_node_base(const Item& item_)
         : item(item_)
-        , inside_max_end(get_end(item))
+        , inside_max_end_(get_end(item))
+        {}
+    iit_node_base(Item&& item_)
+        : item(std::move(item_))
+        , inside_max_end_(get_end(item))
         {}
     inline Pos beg() const {
         return get_beg(item);
@@ -66,6 +218,12 @@ struct iit_node_base {
     inline Pos end() const {
         return get_end(item);
     }
+    inline Pos inside_max_end() const {
+        return inside_max_end_;
+    }
+    inline void set_inside_max_end(Pos ime) {
+        inside_max_end_ = ime;
+    }
     bool operator<(const iit_node_base<Pos, Item, get_beg, get_end>& rhs) const {
         auto lbeg = beg(), rbeg = rhs.beg();
         if (lbeg == rbeg) {
@@ -75,576 +233,5169 @@ struct iit_node_base {
     }
 };
 
-// Base template for an implicit interval tree, with internal repr
-//     Node<Pos, Item, ...> : iit_node_base<Pos, Item, ...>
-// User should not deal with this directly, but instantiate sub-templates iit or iiitii (below)
-template<typename Pos, typename Item, class Node, template<class> class NodeArray>
-class iit_base {
-protected:
-    // aliases to help keep the Pos, Rank, and Level concepts straight
-    typedef std::size_t Rank;   // rank of a node, its index in the sorted array (or beyond, if
-                                //                                                imaginary)
-    typedef std::size_t Level;  // level in tree
+// Alternative node representation holding only the keys, for the structure-of-arrays layout in
+// which the Items are stored in a separate array (addressed by rank). The builder sorts
+// iit_node_base, which is then split into the two arrays.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+struct iit_key_node {
+    static const Pos npos = std::numeric_limits<Pos>::max();
+    static const bool has_item = false;
+    static const bool has_outside_max_end = false;
+    static const bool compact = false;
+    typedef iit_node_base<Pos, Item, get_beg, get_end> build_node;
 
-    static const Rank nrank = std::numeric_limits<Rank>::max();  // invalid Rank
+    Pos beg_, end_;
+    Pos inside_max_end_;
 
-    NodeArray<Node> nodes;   // array of Nodes sorted by beginning position
-    size_t full_size;         // size of the full binary tree containing the nodes; liable to be
-                              // as large as 2*nodes.size()-1, including imaginary nodes.
+    iit_key_node(const Item& item_)
+        : beg_(get_beg(item_))
+        , end_(get_end(item_))
+        , inside_max_end_(end_)
+        {}
+    inline Pos beg() const {
+        return beg_;
+    }
+    inline Pos end() const {
+        return end_;
+    }
+    inline Pos inside_max_end() const {
+        return inside_max_end_;
+    }
+    inline void set_inside_max_end(Pos ime) {
+        inside_max_end_ = ime;
+    }
+};
 
-    Rank root;
-    Level root_level;         //  = K in cgranges
+// Compact key node for the iit_compact layout: as iit_key_node, but storing the end position as a
+// length, and inside_max_end as an offset from beg, each of the narrower unsigned type Offset. The
+// item lengths must fit in Offset (the builder throws otherwise), while an inside_max_end too far
+// from beg is stored as "infinity". Rounding it up like this lets the search visit more nodes,
+// but never miss results, so the query results are unchanged.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), typename Offset>
+struct iit_compact_node {
+    static_assert(std::is_integral<Pos>::value && std::is_unsigned<Offset>::value && sizeof(Offset) < sizeof(Pos),
+                  "iit_compact requires an integral Pos and a narrower unsigned Offset");
+    static const Pos npos = std::numeric_limits<Pos>::max();
+    static const bool has_item = false;
+    static const bool has_outside_max_end = false;
+    static const bool compact = true;
+    typedef iit_node_base<Pos, Item, get_beg, get_end> build_node;
+    typedef typename std::make_unsigned<Pos>::type UPos;   // for (modular) offset arithmetic
+    static const Offset saturated = std::numeric_limits<Offset>::max();
 
-    // compute a node's level, the # of 1 bits below the lowest 0 bit
-    inline Level level(Rank node) const {
-        assert(node < full_size);
-        Level ans = __builtin_ctzll(~(unsigned long long)node);  // bitwise-negate & count trailing zeroes
-        #ifndef NDEBUG
-        Level chk;
-        for (chk=0; node&1; chk++, node>>=1);
-        assert(ans == chk);
-        #endif
-        return ans;
-    }
+    Pos beg_;
+    Offset len_, inside_max_end_;
 
-    // get node's parent, or nrank if called on the root
-    inline Rank parent(Rank node, Level k) const {
-        assert(k == level(node));
-        assert(node < full_size);
-        if (node == root) {
-            return nrank;
-        }
-        Rank ofs = Rank(1) << k;
-        assert(node >= ofs-1);
-        if (((node>>(k+1)) & 1)) {  // node is right child
-            assert(node >= ofs);
-            return node-ofs;
+    iit_compact_node(const Item& item_)
+        : beg_(get_beg(item_))
+    {
+        const Pos end = get_end(item_);
+        if (end < beg_ || UPos(end) - UPos(beg_) > UPos(std::numeric_limits<Offset>::max())) {
+            throw std::runtime_error("item length exceeds the iit_compact Offset type");
         }
-        // node is left child
-        return node+ofs;
+        len_ = Offset(UPos(end) - UPos(beg_));
+        inside_max_end_ = len_;
     }
-    inline Rank parent2(Rank node) const {
-        // helper to compute level if it isn't already known (which it often is)
-        return parent(node, level(node));
+    inline Pos beg() const {
+        return beg_;
     }
-
-    // get node's left child, or nrank if called on a leaf
-    inline Rank left(Rank node, Level k) const {
-        assert(k == level(node));
-        return k > 0 ? node - (Rank(1) << (k-1)) : nrank;
+    inline Pos end() const {
+        return Pos(UPos(beg_) + len_);
     }
-    inline Rank left2(Rank node) const {
-        return left(node, level(node));
+    inline Pos inside_max_end() const {
+        return inside_max_end_ == saturated ? npos : Pos(UPos(beg_) + inside_max_end_);
     }
-
-    // get node's right child, or nrank if called on a leaf
-    inline Rank right(Rank node, Level k) const {
-        assert(k == level(node));
-        return k > 0 ? node + (Rank(1) << (k-1)) : nrank;
+    inline void set_inside_max_end(Pos ime) {
+        assert(ime >= end());
+        const UPos ofs = UPos(ime) - UPos(beg_);
+        inside_max_end_ = ofs < saturated ? Offset(ofs) : saturated;
     }
-    inline Rank right2(Rank node) const {
-        return right(node, level(node));
+};
+
+// Node layout selectors for the Layout template parameter of iit and iitii:
+//   iit_aos : array of structs; each node stores its Item inline, next to the augmentation values
+//   iit_soa : structure of arrays; dense node array of keys (beg, end and augmentation values), with
+//             the Items in a separate array. Queries read only the keys until they find a hit, so
+//             for large Items, each cache line fetched holds many more useful bytes.
+//   iit_compact<Offset> : as iit_soa, with the keys other than beg stored as narrow offsets from
+//             it (see iit_compact_node): for 64-bit Pos with 32-bit offsets, 16 bytes per iit node
+//             (instead of 24) and 24 per iitii node (instead of 32)
+//   iit_eytzinger<Layout> : any of the above, plus a breadth-first copy of the top levels' keys
+//   iit_leaf_blocks<Layout, L> : any of the above, with a different leaf block size
+struct iit_aos {
+    template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+    using node = iit_node_base<Pos, Item, get_beg, get_end>;
+    static const unsigned top_levels = 0;
+    template<typename Pos>
+    static constexpr unsigned leaf_level = iit_default_leaf_level<Pos>(false);
+};
+struct iit_soa {
+    template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+    using node = iit_key_node<Pos, Item, get_beg, get_end>;
+    static const unsigned top_levels = 0;
+    template<typename Pos>
+    static constexpr unsigned leaf_level = iit_default_leaf_level<Pos>(true);
+};
+template<typename Offset = uint32_t>
+struct iit_compact {
+    template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+    using node = iit_compact_node<Pos, Item, get_beg, get_end, Offset>;
+    static const unsigned top_levels = 0;
+    template<typename Pos>
+    static constexpr unsigned leaf_level = iit_default_leaf_level<Pos>(false);
+};
+
+// Hybrid layout modifier: as Layout, but the keys (beg, end and augmentation values) of the nodes
+// on the top TopLevels levels of the tree are also copied into a small side array in breadth-first
+// (Eytzinger) order. In the in-order node array, each of those nodes is far from the others -- on
+// its own cache line and often its own page -- whereas the side array packs them densely (64 KiB
+// for the default 12 levels of 32-bit positions), so that the top-down search from the root and
+// long climbs mostly hit cache. The side array is recomputed on load (not saved).
+template<class Layout = iit_aos, unsigned TopLevels = 12>
+struct iit_eytzinger {
+    template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+    using node = typename Layout::template node<Pos, Item, get_beg, get_end>;
+    static const unsigned top_levels = TopLevels;
+    template<typename Pos>
+    static constexpr unsigned leaf_level = Layout::template leaf_level<Pos>;
+};
+
+// Layout modifier: as Layout, but scanning subtrees up to level LeafLevel (1-4) as one block, in
+// place of the default (see IITII_LEAF_LEVEL); or with LeafLevel = 0, the deepest level whose
+// block of 2^(L+1)-1 nodes fits in iit_leaf_block_bytes (four cache lines), given the node size.
+template<class Layout = iit_aos, unsigned LeafLevel = 0>
+struct iit_leaf_blocks {
+    template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
+    using node = typename Layout::template node<Pos, Item, get_beg, get_end>;
+    static const unsigned top_levels = Layout::top_levels;
+    template<typename Pos>
+    static constexpr unsigned leaf_level = LeafLevel;
+};
+
+static const size_t iit_leaf_block_bytes = 256;
+
+constexpr unsigned iit_cache_leaf_level(size_t node_bytes) {
+    unsigned ans = 1;
+    while (ans < 4 && ((size_t(2) << (ans+1)) - 1)*node_bytes <= iit_leaf_block_bytes) {
+        ++ans;
     }
+    return ans;
+}
 
-    // leftmost leaf under subtree root
-    inline Rank leftmost_leaf(Rank subtree, Level k) const {
-        assert(k == level(subtree));
-        auto ofs = (Rank(1)<<k) - 1;
-        assert(subtree >= ofs);
-        return subtree - ofs;
+// Read-only memory mapping of a whole file, unmapped on destruction
+class iit_file_mapping {
+    void* addr_ = MAP_FAILED;
+    size_t size_ = 0;
+
+    iit_file_mapping() = default;
+
+public:
+    iit_file_mapping(const iit_file_mapping&) = delete;
+    iit_file_mapping& operator=(const iit_file_mapping&) = delete;
+    ~iit_file_mapping() {
+        if (addr_ != MAP_FAILED) {
+            munmap(addr_, size_);
+        }
     }
-    inline Rank leftmost_leaf2(Rank subtree) const {
-        return leftmost_leaf(subtree, level(subtree));
+
+    static std::shared_ptr<const iit_file_mapping> open(const std::string& filename) {
+        std::shared_ptr<iit_file_mapping> ans(new iit_file_mapping());
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            ans->size_ = size_t(st.st_size);
+            ans->addr_ = mmap(nullptr, ans->size_, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (ans->addr_ == MAP_FAILED) {
+            throw std::runtime_error("Failed to map " + filename);
+        }
+        return ans;
     }
 
-    // rightmost leaf under subtree root
-    inline Rank rightmost_leaf(Rank subtree, Level k) const {
-        assert(k == level(subtree));
-        auto ofs = (Rank(1)<<k) - 1;
-        assert(subtree + ofs < full_size);
-        return subtree + ofs;
+    const char* data() const {
+        return reinterpret_cast<const char*>(addr_);
     }
-    inline Rank rightmost_leaf2(Rank subtree) const {
-        return rightmost_leaf(subtree, level(subtree));
+    size_t size() const {
+        return size_;
     }
+};
 
-    // top-down overlap scan for [qbeg,qend). return # of nodes visited.
-    // recursion depth limited to tree height
-    size_t scan(Rank subtree, Level k, Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
-        assert(subtree < full_size);
-        assert(k == level(subtree));
+// NodeArray implementation which either owns its storage, behaving like a (minimal) std::vector,
+// or views an external read-only memory region such as an iit_file_mapping, which it keeps alive.
+// Trees using it can be loaded with load_mmap(), which queries the mapped file in place.
+template<class T>
+class iit_mapped_array {
+    std::vector<T> storage_;
+    T* data_ = nullptr;
+    size_t size_ = 0;
+    std::shared_ptr<const void> region_;  // set iff viewing an external region
 
-        if (subtree >= nodes.size()) {
-            // When we arrive at an imaginary node, its right subtree must be all imaginary, so we
-            // only need to descend left.
-            return 1 + (k>0 ? scan(left(subtree, k), k-1, qbeg, qend, ans) : 0);
-        } else if (k <= 2) {
-            // unroll low-level traversal to reduce overhead
-            const Rank lml = leftmost_leaf(subtree, k),
-                       rml = std::min(rightmost_leaf(subtree, k), nodes.size()-1);
-            Rank r = lml;
-            for (; r <= rml; ++r) {
-                const Node& n = nodes[r];
-                if (n.beg() >= qend) {
-                    break;
-                }
-                if (n.end() > qbeg) {
-                    ans.push_back(&(n.item));
-                }
-            }
-            return r-lml;
-        }
+    void sync() {
+        data_ = storage_.data();
+        size_ = storage_.size();
+    }
 
-        // textbook recursive search
-        size_t cost = 1;
-        const Node& n = nodes[subtree];
-        if (n.inside_max_end > qbeg) {  // something in current subtree extends into/over query
-            const Level ck = k-1;
-            cost += scan(left(subtree, k), ck, qbeg, qend, ans);
-            Pos nbeg = n.beg();
-            if (nbeg < qend) {          // this node isn't already past query
-                if (n.end() > qbeg) {   // this node overlaps query
-                    ans.push_back(&(n.item));
-                }
-                cost += scan(right(subtree, k), ck, qbeg, qend, ans);
-            }
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    iit_mapped_array() = default;
+    iit_mapped_array(const iit_mapped_array& rhs)
+        : storage_(rhs.storage_)
+        , data_(rhs.data_)
+        , size_(rhs.size_)
+        , region_(rhs.region_) {
+        if (!region_) {
+            sync();
         }
-        return cost;
+    }
+    iit_mapped_array(iit_mapped_array&& rhs) noexcept {
+        *this = std::move(rhs);
+    }
+    iit_mapped_array& operator=(const iit_mapped_array& rhs) {
+        return *this = iit_mapped_array(rhs);
+    }
+    iit_mapped_array& operator=(iit_mapped_array&& rhs) noexcept {
+        storage_ = std::move(rhs.storage_);
+        region_ = std::move(rhs.region_);
+        data_ = rhs.data_;
+        size_ = rhs.size_;
+        rhs.storage_.clear();
+        rhs.region_.reset();
+        rhs.sync();
+        return *this;
     }
 
-    iit_base(NodeArray<Node>& nodes_)
-        : nodes(std::move(nodes_))
-        , root_level(0)
-        , root(std::numeric_limits<Rank>::max())
-    {
-        // compute the implied tree geometry
-        for (root_level = 0, full_size = 0; full_size < nodes.size();
-             ++root_level, full_size = (size_t(1)<<(root_level+1)) - 1);
-        root = (Rank(1) << root_level) - 1;
+    // view n T's at data, which must remain valid as long as region does
+    static iit_mapped_array view(const T* data, size_t n, std::shared_ptr<const void> region) {
+        iit_mapped_array ans;
+        ans.data_ = const_cast<T*>(data);
+        ans.size_ = n;
+        ans.region_ = std::move(region);
+        return ans;
+    }
+    bool is_view() const {
+        return bool(region_);
+    }
 
-        if (nodes.size()) {
-            #ifndef NDEBUG
-            for (Rank r = 0; r < nodes.size()-1; ++r) {
-                assert(nodes[r].beg() <= nodes[r+1].beg());
-            }
-            #endif
+    size_t size() const { return size_; }
+    bool empty() const { return !size_; }
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    T& back() { return data_[size_-1]; }
+    const T& back() const { return data_[size_-1]; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
 
-            // Memoize the path from the rightmost leaf up to the root. This will trace the border
-            // between the real and imaginary nodes (if any), which we'll refer to in indexing
-            // below. Some of these border nodes may be imaginary.
-            std::vector<Rank> right_border_nodes({
-                nodes.size() - (2 - nodes.size() % 2)  // rightmost real leaf
-            });
-            while (right_border_nodes.back() != root) {
-                right_border_nodes.push_back(parent2(right_border_nodes.back()));
-            }
+    // modifiers (only for owned storage)
+    void push_back(const T& x) {
+        assert(!is_view());
+        storage_.push_back(x);
+        sync();
+    }
+    void push_back(T&& x) {
+        assert(!is_view());
+        storage_.push_back(std::move(x));
+        sync();
+    }
+    void reserve(size_t n) {
+        assert(!is_view());
+        storage_.reserve(n);
+        sync();
+    }
+    void resize(size_t n, const T& x) {
+        assert(!is_view());
+        storage_.resize(n, x);
+        sync();
+    }
+    void clear() {
+        storage_.clear();
+        region_.reset();
+        sync();
+    }
+};
 
-            // bottom-up indexing
-            Pos right_border_ime = nodes[right_border_nodes[0]].inside_max_end;
-            for (Level k=1; k <= root_level; ++k) {
-                // for each in nodes on this level
-                size_t x = size_t(1)<<(k-1), step = x<<2;
-                for (Rank n = (x<<1)-1; n < nodes.size(); n += step) {
-                    // figure inside_max_end
-                    Pos ime = nodes[n].end();
-                    ime = std::max(ime, nodes[left(n,k)].inside_max_end);
-                    if (right(n,k) < nodes.size()) {
-                        ime = std::max(ime, nodes[right(n,k)].inside_max_end);
-                    } else {
-                        // right child is imaginary; take the last border observation
-                        ime = std::max(ime, right_border_ime);
-                    }
-                    assert(ime != Node::npos);
-                    nodes[n].inside_max_end = ime;
+template<class A>
+struct iit_is_mapped_array : std::false_type {};
+template<class T>
+struct iit_is_mapped_array<iit_mapped_array<T>> : std::true_type {};
 
-                    if (n == right_border_nodes[k]) {
-                        // track inside_max_end of the real nodes on the border
-                        right_border_ime = ime;
-                    }
-                }
-            }
+// Allocator for large arrays (2 MiB or more) backed by huge pages, making random probes into a
+// multi-GB node array cheap in TLB entries. Arrays of 1 GiB or more first try a hugetlbfs mapping
+// of 1 GiB pages, others one of the default (usually 2 MiB) huge pages; if none are reserved
+// (vm.nr_hugepages), the array falls back to an ordinary anonymous mapping aligned to 2 MiB and
+// advised for transparent huge pages (MADV_HUGEPAGE). Smaller arrays use operator new.
+template<class T>
+struct iit_hugepage_allocator {
+    typedef T value_type;
+    static const size_t huge_page = size_t(1) << 21, giant_page = size_t(1) << 30;
+
+    iit_hugepage_allocator() = default;
+    template<class U>
+    iit_hugepage_allocator(const iit_hugepage_allocator<U>&) {}
+
+    // the mapped length for n T's (0 for operator new). The 1 GiB size class is never mapped with
+    // 2 MiB hugetlb pages, which would be reserved up to the 1 GiB rounding.
+    static size_t mapped_bytes(size_t n) {
+        const size_t bytes = n*sizeof(T);
+        if (bytes < huge_page) {
+            return 0;
         }
+        const size_t page = bytes >= giant_page ? giant_page : huge_page;
+        return (bytes + page - 1)/page*page;
     }
 
-public:
-    // overlap query; fill ans and return query cost (number of tree nodes visited)
-    virtual size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
-        ans.clear();
-        return scan(root, root_level, qbeg, qend, ans);
+    T* allocate(size_t n) {
+        const size_t len = mapped_bytes(n);
+        if (!len) {
+            return static_cast<T*>(::operator new(n*sizeof(T)));
+        }
+        void* p = MAP_FAILED;
+        #ifdef MAP_HUGETLB
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+        #ifdef MAP_HUGE_1GB
+        if (len % giant_page == 0) {
+            p = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags | MAP_HUGE_1GB, -1, 0);
+        }
+        #endif
+        if (p == MAP_FAILED && len < giant_page) {
+            p = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        }
+        #endif
+        if (p == MAP_FAILED) {
+            // map one huge page extra & trim to align
+            void* q = mmap(nullptr, len + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (q == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            const uintptr_t a = reinterpret_cast<uintptr_t>(q),
+                            aligned = (a + huge_page - 1)/huge_page*huge_page;
+            if (aligned > a) {
+                munmap(q, aligned - a);
+            }
+            munmap(reinterpret_cast<char*>(aligned) + len, huge_page - (aligned - a));
+            p = reinterpret_cast<void*>(aligned);
+            #ifdef MADV_HUGEPAGE
+            madvise(p, len, MADV_HUGEPAGE);
+            #endif
+        }
+        return static_cast<T*>(p);
     }
 
-    // overlap query, return vector of results
-    std::vector<const Item*> overlap(Pos qbeg, Pos qend) const {
-        std::vector<const Item*> ans;
-        overlap(qbeg, qend, ans);
-        return ans;
+    void deallocate(T* p, size_t n) {
+        const size_t len = mapped_bytes(n);
+        if (!len) {
+            ::operator delete(p);
+        } else {
+            munmap(p, len);
+        }
     }
+
+    template<class U>
+    bool operator==(const iit_hugepage_allocator<U>&) const { return true; }
+    template<class U>
+    bool operator!=(const iit_hugepage_allocator<U>&) const { return false; }
 };
 
-// Wrapper for std::sort; the sorting algorithm can be customized by providing a different function
-// to the builder constructor.
-template<class NodeArray>
-void iit_sort(NodeArray& vec) {
-    std::sort(vec.begin(), vec.end());
-}
+// NodeArray backed by huge pages, e.g. iitii<Pos, Item, get_beg, get_end, iit_hugepage_array>
+template<class T>
+using iit_hugepage_array = std::vector<T, iit_hugepage_allocator<T>>;
 
-// template for the builder class exposed by each user-facing class, which takes in items either
-// all at once from InputIterator, or streaming one-by-one
-template<class iitT, typename Item, class Node, template<class> class NodeArray>
-class iit_builder_base {
-    NodeArray<Node> nodes_;
-    std::function<void(NodeArray<Node>&)> sort_;
+// Bump allocator carving arrays out of large chunks, which it keeps until destroyed: freeing only
+// rolls back the most recent allocation in its chunk, while reset() recycles all the chunks
+// (invalidating everything allocated from the arena). Building inside an iit_arena::scope takes the
+// build's scratch arrays from the arena, so that repeated builds (e.g. in a loop over inputs) reuse
+// the same already-faulted pages instead of mapping & faulting fresh memory for each. So do the
+// index's own arrays with NodeArray = iit_arena_array, which then mustn't outlive the arena.
+class iit_arena {
+    struct chunk {
+        char* data;
+        size_t size, used;
+    };
+    std::vector<chunk> chunks_;
+    size_t chunk_bytes_;
+    mutable std::mutex mu_;
+
+    static iit_arena*& current_arena() {
+        thread_local iit_arena* ans = nullptr;
+        return ans;
+    }
 
 public:
-    iit_builder_base(void sort(NodeArray<Node>&) = iit_sort<NodeArray<Node>>)
-        : sort_(sort)
+    explicit iit_arena(size_t chunk_bytes = size_t(64) << 20)
+        : chunk_bytes_(chunk_bytes)
         {}
+    iit_arena(const iit_arena&) = delete;
+    iit_arena& operator=(const iit_arena&) = delete;
+    ~iit_arena() {
+        for (const chunk& c : chunks_) {
+            iit_hugepage_allocator<char>().deallocate(c.data, c.size);
+        }
+    }
 
-    template<typename InputIterator>
-    iit_builder_base(InputIterator begin, InputIterator end, void sort(NodeArray<Node>&) = iit_sort<NodeArray<Node>>) 
-        : sort_(sort) {
-        add(begin, end);
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        std::lock_guard<std::mutex> lock(mu_);
+        // first fit (there are few chunks)
+        for (chunk& c : chunks_) {
+            const size_t ofs = (c.used + align - 1)/align*align;
+            if (ofs + bytes <= c.size) {
+                c.used = ofs + bytes;
+                return c.data + ofs;
+            }
+        }
+        const size_t size = std::max(chunk_bytes_, bytes);
+        chunks_.push_back({ iit_hugepage_allocator<char>().allocate(size), size, bytes });
+        return chunks_.back().data;
     }
 
-    void add(const Item& it) {
-        nodes_.push_back(Node(it));
+    void deallocate(void* p, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (chunk& c : chunks_) {
+            if (static_cast<char*>(p) + bytes == c.data + c.used) {
+                c.used -= bytes;
+                return;
+            }
+        }
     }
 
-    template<typename InputIterator>
-    void add(InputIterator begin, InputIterator end) {
-        std::for_each(begin, end, [&](const Item& it) { add(it); });
+    void reset() {
+        std::lock_guard<std::mutex> lock(mu_);
+        for (chunk& c : chunks_) {
+            c.used = 0;
+        }
     }
 
-    template<typename... Args>
-    iitT build(Args&&... args) {
-        sort_(nodes_);
-        return iitT(nodes_, std::forward<Args>(args)...);
+    // bytes of chunks held
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t ans = 0;
+        for (const chunk& c : chunks_) {
+            ans += c.size;
+        }
+        return ans;
     }
-};
 
-// Basic implicit interval tree (a reimplementation of cgranges)
-// The optional fifth and sixth template parameters can substitute a different NodeArray
-// implementation.
-template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector>
-class iit : public iit_base<Pos, Item, iit_node_base<Pos, Item, get_beg, get_end>, NodeArray> {
-    using Node = iit_node_base<Pos, Item, get_beg, get_end>;
-
-    iit(NodeArray<Node>& nodes_)
-        : iit_base<Pos, Item, Node, NodeArray>(nodes_)
-        {}
+    // the arena of the innermost scope on this thread, if any
+    static iit_arena* current() {
+        return current_arena();
+    }
 
-public:
-    using builder = iit_builder_base<iit<Pos, Item, get_beg, get_end>, Item, Node, NodeArray>;
-    friend builder;    
+    // route this thread's arena allocations to arena until destroyed
+    class scope {
+        iit_arena* prev_;
+    public:
+        explicit scope(iit_arena& arena)
+            : prev_(current_arena()) {
+            current_arena() = &arena;
+        }
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+        ~scope() {
+            current_arena() = prev_;
+        }
+    };
 };
 
+// Allocator taking memory from the current iit_arena when constructed within an iit_arena::scope,
+// otherwise using operator new. Copies of a container are allocated afresh the same way on the
+// copying thread. The memory isn't returned until the arena is reset() or destroyed, which
+// invalidates any container still using it: in particular, an index with NodeArray =
+// iit_arena_array built within the scope must be destroyed first.
+template<class T>
+struct iit_arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    iit_arena* arena = iit_arena::current();
 
-// iitii-specialized node type
+    iit_arena_allocator() = default;
+    template<class U>
+    iit_arena_allocator(const iit_arena_allocator<U>& rhs)
+        : arena(rhs.arena)
+        {}
+    iit_arena_allocator select_on_container_copy_construction() const {
+        return iit_arena_allocator();
+    }
+
+    T* allocate(size_t n) {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n*sizeof(T), std::max(alignof(T), size_t(64))));
+        }
+        return static_cast<T*>(::operator new(n*sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if (arena) {
+            arena->deallocate(p, n*sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template<class U>
+    bool operator==(const iit_arena_allocator<U>& rhs) const { return arena == rhs.arena; }
+    template<class U>
+    bool operator!=(const iit_arena_allocator<U>& rhs) const { return arena != rhs.arena; }
+};
+
+// NodeArray allocated from the current iit_arena (when built within its scope)
+template<class T>
+using iit_arena_array = std::vector<T, iit_arena_allocator<T>>;
+
+// array for temporary use during the build, taken from the current iit_arena if any
+template<class T>
+using iit_scratch_vector = std::vector<T, iit_arena_allocator<T>>;
+
+// The NUMA nodes and their CPUs, as listed in /sys/devices/system/node (a single node holding all
+// CPUs, if that's unavailable)
+struct iit_numa_topology {
+    std::vector<std::vector<unsigned>> node_cpus;
+
+    // parse a sysfs list such as "0-3,8-11"
+    static std::vector<unsigned> parse_list(const std::string& s) {
+        std::vector<unsigned> ans;
+        size_t i = 0;
+        while (i < s.size()) {
+            char* e;
+            const unsigned long lo = strtoul(s.c_str() + i, &e, 10);
+            if (e == s.c_str() + i) {
+                break;
+            }
+            unsigned long hi = lo;
+            i = e - s.c_str();
+            if (i < s.size() && s[i] == '-') {
+                hi = strtoul(s.c_str() + i + 1, &e, 10);
+                i = e - s.c_str();
+            }
+            for (unsigned long c = lo; c <= hi; ++c) {
+                ans.push_back(unsigned(c));
+            }
+            if (i < s.size() && s[i] == ',') {
+                ++i;
+            }
+        }
+        return ans;
+    }
+
+    static iit_numa_topology detect() {
+        iit_numa_topology ans;
+        const std::string dir = "/sys/devices/system/node/";
+        std::string online;
+        std::ifstream in(dir + "online");
+        if (in && std::getline(in, online)) {
+            for (unsigned node : parse_list(online)) {
+                std::string cpulist;
+                std::ifstream cin(dir + "node" + std::to_string(node) + "/cpulist");
+                if (cin && std::getline(cin, cpulist)) {
+                    auto cpus = parse_list(cpulist);
+                    if (!cpus.empty()) {
+                        ans.node_cpus.push_back(std::move(cpus));
+                    }
+                }
+            }
+        }
+        if (ans.node_cpus.empty()) {
+            ans.node_cpus.emplace_back();
+        }
+        return ans;
+    }
+};
+
+// Replicas of a read-only index, one per NUMA node, each copied by a thread bound to that node's
+// CPUs so that the kernel's first-touch policy places its pages in the node's local memory. The
+// given tree itself is moved in as the replica of the calling thread's node, where its pages
+// were presumably touched by the build, so that no more than one tree per node exists at once.
+// The queries are answered by the replica local to the calling thread's current CPU. (Threads
+// running queries should be bound to CPUs, else they may migrate away from the replica they're
+// using.) A tree whose copies share its arrays (Tree::shared_storage) can't be replicated this way.
+template<class Tree>
+class iit_numa_replicated {
+    static_assert(!Tree::shared_storage, "NUMA replicas require a NodeArray owning its storage");
+
+    std::vector<std::unique_ptr<const Tree>> replicas_;
+    std::vector<unsigned> node_of_cpu_;
+
+public:
+    explicit iit_numa_replicated(Tree&& tree, const iit_numa_topology& topology = iit_numa_topology::detect()) {
+        const auto& nodes = topology.node_cpus;
+        if (nodes.size() <= 1) {
+            replicas_.emplace_back(new Tree(std::move(tree)));
+            return;
+        }
+        replicas_.resize(nodes.size());
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            for (unsigned cpu : nodes[node]) {
+                if (node_of_cpu_.size() <= cpu) {
+                    node_of_cpu_.resize(cpu+1, 0);
+                }
+                node_of_cpu_[cpu] = unsigned(node);
+            }
+        }
+        const int cpu = sched_getcpu();
+        const size_t home = cpu >= 0 && size_t(cpu) < node_of_cpu_.size() ? node_of_cpu_[cpu] : nodes.size()-1;
+        std::vector<std::thread> workers;
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            if (node == home) {
+                continue;
+            }
+            workers.emplace_back([&, node]() {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (unsigned cpu : nodes[node]) {
+                    if (cpu < CPU_SETSIZE) {
+                        CPU_SET(cpu, &set);
+                    }
+                }
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                replicas_[node].reset(new Tree(tree));
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+        replicas_[home].reset(new Tree(std::move(tree)));
+    }
+
+    size_t replicas() const {
+        return replicas_.size();
+    }
+    const Tree& replica(size_t node) const {
+        return *replicas_.at(node);
+    }
+
+    // the replica for the calling thread's NUMA node
+    const Tree& local() const {
+        if (replicas_.size() > 1) {
+            const int cpu = sched_getcpu();
+            if (cpu >= 0 && size_t(cpu) < node_of_cpu_.size()) {
+                return *replicas_[node_of_cpu_[cpu]];
+            }
+        }
+        return *replicas_[0];
+    }
+
+    template<typename... Args>
+    auto overlap(Args&&... args) const {
+        return local().overlap(std::forward<Args>(args)...);
+    }
+    template<typename Pos, class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        return local().overlap_visit(qbeg, qend, std::forward<F>(f));
+    }
+    template<typename Pos>
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        return local().overlap_count(qbeg, qend);
+    }
+    template<typename Pos>
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        return local().overlap_any(qbeg, qend);
+    }
+    // (the replicas rank the items identically)
+    template<typename Pos>
+    size_t overlap_ranks(Pos qbeg, Pos qend, std::vector<size_t>& ans) const {
+        return local().overlap_ranks(qbeg, qend, ans);
+    }
+    template<typename Pos>
+    size_t overlap_rank_runs(Pos qbeg, Pos qend, std::vector<std::pair<size_t, size_t>>& ans) const {
+        return local().overlap_rank_runs(qbeg, qend, ans);
+    }
+};
+
+// Header of the on-disk index format written by save(). The header is followed by the raw node
+// arrays and model parameters, each aligned to 64 bytes and located by the sections table, so
+// that the file can be mapped and queried in place. Only possible if the Node type (including
+// Item) is trivially copyable; files are specific to the types and the byte order of the host.
+struct iit_file_header {
+    static const uint32_t VERSION = 1;
+    enum { NODES = 0, ITEMS, PARAMETERS, BOUNDARIES, DOMAIN_COSTS, MAX_SECTIONS = 8 };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t has_model;           // iitii model is present
+    uint32_t pos_size, item_size, node_size, has_item;
+    uint64_t nodes, full_size, root, root_level;
+    uint64_t domains, min_beg, domain_size;  // iitii model geometry (Pos values stored bitwise)
+    struct {
+        uint64_t offset, bytes;
+    } sections[MAX_SECTIONS];
+
+    iit_file_header() {
+        memset(this, 0, sizeof(*this));
+        memcpy(magic, "iitii\0\0\0", 8);
+        version = VERSION;
+    }
+
+    // validate a header read from filename (of size bytes)
+    void check(const std::string& filename, size_t size) const {
+        if (memcmp(magic, "iitii\0\0\0", 8)) {
+            throw std::runtime_error(filename + " isn't an iitii index file");
+        }
+        if (version != VERSION) {
+            throw std::runtime_error(filename + " has unsupported iitii index format version "
+                                     + std::to_string(version));
+        }
+        for (const auto& sec : sections) {
+            if (sec.offset + sec.bytes > size) {
+                throw std::runtime_error(filename + " is truncated");
+            }
+        }
+    }
+
+    template<typename Pos>
+    static uint64_t pack(Pos x) {
+        static_assert(sizeof(Pos) <= sizeof(uint64_t), "Pos type too large");
+        uint64_t ans = 0;
+        memcpy(&ans, &x, sizeof(Pos));
+        return ans;
+    }
+    template<typename Pos>
+    static Pos unpack(uint64_t x) {
+        Pos ans;
+        memcpy(&ans, &x, sizeof(Pos));
+        return ans;
+    }
+};
+
+// Run f(lo, hi) over [0, n) split into up to `threads` contiguous chunks of at least `grain`
+// elements each, the first chunk on the calling thread. With one thread (or too few elements to
+// be worth spreading), this is just f(0, n).
+template<typename F>
+void iit_parallel_for(size_t n, unsigned threads, size_t grain, F&& f) {
+    size_t chunks = std::min(size_t(std::max(threads, 1U)), std::max(n/std::max(grain, size_t(1)), size_t(1)));
+    if (chunks <= 1) {
+        if (n) {
+            f(size_t(0), n);
+        }
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t c = 1; c < chunks; ++c) {
+        workers.emplace_back([&f, n, chunks, c]() { f(n*c/chunks, n*(c+1)/chunks); });
+    }
+    f(size_t(0), n/chunks);
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+// floor(log2(x)) for positive x (quickly)
+inline unsigned log2ull(unsigned long long x) {
+    assert(x);
+    unsigned ans = unsigned(8*sizeof(unsigned long long) - __builtin_clzll(x) - 1);
+    assert(ans == unsigned(floor(log2(double(x)))));
+    return ans;
+}
+
+// Equal-count partitioning, as of iitii_partition::equal_count model domains and iitii_sharded's
+// shards: given n sorted positions pos(0), ..., pos(n-1), part p of parts begins with the one
+// ranked p*n/parts. Appends the parts-1 boundaries of parts 1.. to out; the part holding a position
+// x is then the number of boundaries <= x (iit_boundary_count). Positions equal to a boundary all
+// fall on its right, so some parts may be empty if many positions are equal.
+template<class Out, class Get>
+void iit_equal_count_boundaries(size_t n, size_t parts, Get pos, Out& out) {
+    for (size_t p = 1; p < parts; ++p) {
+        out.push_back(pos(p*n/parts));
+    }
+}
+
+// number of the n sorted boundaries b[] <= x (branchless binary search)
+template<typename Pos>
+inline size_t iit_boundary_count(const Pos* b, size_t n, Pos x) {
+    if (!n) {
+        return 0;
+    }
+    size_t lo = 0;
+    while (n > 1) {
+        const size_t half = n/2;
+        lo = b[lo+half] <= x ? lo+half : lo;
+        n -= half;
+    }
+    return lo + (b[lo] <= x);
+}
+
+// call f(a, b) on a pair of items, treating a void return value as "continue"
+template<class F, typename A, typename B>
+inline bool iit_visit_pair(F& f, const A& a, const B& b) {
+    if constexpr (std::is_void<decltype(f(a, b))>::value) {
+        f(a, b);
+        return true;
+    } else {
+        return f(a, b);
+    }
+}
+
+// Which items a nearest-interval query considers (see iit_base::k_nearest): all of them, only those
+// ending at or before the query position, or only those beginning after it
+enum class iit_direction { both, upstream, downstream };
+
+// Summary of one window from iit_base::coverage()
+template<typename Pos>
+struct iit_coverage_window {
+    // sums of depth (integral if Pos is)
+    typedef typename std::conditional<std::is_integral<Pos>::value, uint64_t, double>::type Sum;
+
+    size_t items = 0;       // number of items overlapping the window (as overlap_count() counts)
+    size_t max_depth = 0;   // greatest depth (number of items covering a position) in the window
+    Pos covered = 0;        // length of the window's positions covered by at least one item
+    Sum depth_sum = 0;      // depth summed over the window's positions, i.e. the total length of
+                            // the items' overlaps with it; over the window's length, the mean depth
+};
+
+// Base template for an implicit interval tree, with internal repr
+//     Node<Pos, Item, ...> : iit_node_base<Pos, Item, ...>
+// User should not deal with this directly, but instantiate sub-templates iit or iiitii (below)
+// TopLevels is the number of top levels whose keys are copied into a side array (see iit_eytzinger)
+// and LeafLevel the level up to which subtrees are scanned as blocks (see iit_leaf_blocks)
+template<typename Pos, typename Item, class Node, template<class> class NodeArray, unsigned TopLevels = 0,
+         unsigned LeafLevel = iit_default_leaf_level<Pos>(!Node::has_item && !Node::compact)>
+class iit_base {
+protected:
+    // aliases to help keep the Pos, Rank, and Level concepts straight
+    typedef std::size_t Rank;   // rank of a node, its index in the sorted array (or beyond, if
+                                //                                                imaginary)
+    typedef std::size_t Level;  // level in tree
+
+    static const Rank nrank = std::numeric_limits<Rank>::max();  // invalid Rank
+
+    typedef typename Node::build_node BuildNode;
+
+    static const Level leaf_level = LeafLevel ? LeafLevel : iit_cache_leaf_level(sizeof(Node));  // see above
+    static_assert(leaf_level >= 1 && leaf_level <= 4, "leaf level must be 1-4");
+
+    template<typename P, typename I, P gb(const I&), P ge(const I&), class S, class L, class U>
+    friend class iitii_updatable;
+    template<typename P, typename I, class N, template<class> class A, unsigned T, unsigned L>
+    friend class iit_base;  // for join()
+
+    NodeArray<Node> nodes;   // array of Nodes sorted by beginning position
+    NodeArray<Item> items;   // Items by rank, if the Nodes don't hold them (otherwise empty)
+    size_t full_size;         // size of the full binary tree containing the nodes; liable to be
+                              // as large as 2*nodes.size()-1, including imaginary nodes.
+
+    Rank root;
+    Level root_level;         //  = K in cgranges
+
+    // keys of the nodes on levels >= top_min_level, in breadth-first order from the root (only if
+    // TopLevels > 0). The entries for imaginary nodes are unused.
+    struct top_key {
+        Pos beg, end, inside_max_end, outside_max_end;
+    };
+    NodeArray<top_key> top_keys;
+    Level top_min_level = std::numeric_limits<Level>::max();
+
+    // compute a node's level, the # of 1 bits below the lowest 0 bit
+    inline Level level(Rank node) const {
+        assert(node < full_size);
+        Level ans = __builtin_ctzll(~(unsigned long long)node);  // bitwise-negate & count trailing zeroes
+        #ifndef NDEBUG
+        Level chk;
+        for (chk=0; node&1; chk++, node>>=1);
+        assert(ans == chk);
+        #endif
+        return ans;
+    }
+
+    // get node's parent, or nrank if called on the root
+    inline Rank parent(Rank node, Level k) const {
+        assert(k == level(node));
+        assert(node < full_size);
+        if (node == root) {
+            return nrank;
+        }
+        Rank ofs = Rank(1) << k;
+        assert(node >= ofs-1);
+        if (((node>>(k+1)) & 1)) {  // node is right child
+            assert(node >= ofs);
+            return node-ofs;
+        }
+        // node is left child
+        return node+ofs;
+    }
+    inline Rank parent2(Rank node) const {
+        // helper to compute level if it isn't already known (which it often is)
+        return parent(node, level(node));
+    }
+
+    // get node's left child, or nrank if called on a leaf
+    inline Rank left(Rank node, Level k) const {
+        assert(k == level(node));
+        return k > 0 ? node - (Rank(1) << (k-1)) : nrank;
+    }
+    inline Rank left2(Rank node) const {
+        return left(node, level(node));
+    }
+
+    // get node's right child, or nrank if called on a leaf
+    inline Rank right(Rank node, Level k) const {
+        assert(k == level(node));
+        return k > 0 ? node + (Rank(1) << (k-1)) : nrank;
+    }
+    inline Rank right2(Rank node) const {
+        return right(node, level(node));
+    }
+
+    // leftmost leaf under subtree root
+    inline Rank leftmost_leaf(Rank subtree, Level k) const {
+        assert(k == level(subtree));
+        auto ofs = (Rank(1)<<k) - 1;
+        assert(subtree >= ofs);
+        return subtree - ofs;
+    }
+    inline Rank leftmost_leaf2(Rank subtree) const {
+        return leftmost_leaf(subtree, level(subtree));
+    }
+
+    // rightmost leaf under subtree root
+    inline Rank rightmost_leaf(Rank subtree, Level k) const {
+        assert(k == level(subtree));
+        auto ofs = (Rank(1)<<k) - 1;
+        assert(subtree + ofs < full_size);
+        return subtree + ofs;
+    }
+    inline Rank rightmost_leaf2(Rank subtree) const {
+        return rightmost_leaf(subtree, level(subtree));
+    }
+
+    // prefetch node (if real) into cache
+    inline void prefetch(Rank node) const {
+        if (node < nodes.size()) {
+            __builtin_prefetch(&(nodes[node]));
+        }
+    }
+
+    // Key accessors for the real node ranked r on level k, which read the top_keys side array for
+    // the top levels, or the node array otherwise
+    inline bool in_top(Level k) const {
+        return TopLevels && k >= top_min_level;
+    }
+    inline size_t top_index(Rank r, Level k) const {
+        assert(in_top(k) && k == level(r));
+        return (size_t(1) << (root_level-k)) - 1 + (r >> (k+1));
+    }
+    inline Pos key_beg(Rank r, Level k) const {
+        return in_top(k) ? top_keys[top_index(r, k)].beg : nodes[r].beg();
+    }
+    inline Pos key_end(Rank r, Level k) const {
+        return in_top(k) ? top_keys[top_index(r, k)].end : nodes[r].end();
+    }
+    inline Pos key_inside_max_end(Rank r, Level k) const {
+        return in_top(k) ? top_keys[top_index(r, k)].inside_max_end : nodes[r].inside_max_end();
+    }
+    inline Pos key_outside_max_end(Rank r, Level k) const {
+        if constexpr (Node::has_outside_max_end) {
+            return in_top(k) ? top_keys[top_index(r, k)].outside_max_end : nodes[r].outside_max_end();
+        } else {
+            assert(false);
+            return Pos();
+        }
+    }
+    inline void prefetch_key(Rank r, Level k) const {
+        if (in_top(k)) {
+            __builtin_prefetch(&(top_keys[top_index(r, k)]));
+        } else {
+            prefetch(r);
+        }
+    }
+
+    // (re)build top_keys from the node array
+    void build_top_keys() {
+        top_keys.clear();
+        top_min_level = std::numeric_limits<Level>::max();
+        if (!TopLevels || nodes.empty()) {
+            return;
+        }
+        // levels <= leaf_level are always scanned linearly in the node array
+        const Level depth = std::min(Level(TopLevels), root_level > leaf_level ? root_level-leaf_level : Level(0));
+        if (!depth) {
+            return;
+        }
+        top_min_level = root_level - depth + 1;
+        top_keys.resize((size_t(1) << depth) - 1, top_key());
+        for (Level k = top_min_level; k <= root_level; ++k) {
+            for (Rank r = (Rank(1) << k) - 1; r < nodes.size(); r += Rank(1) << (k+1)) {
+                top_key& tk = top_keys[top_index(r, k)];
+                tk.beg = nodes[r].beg();
+                tk.end = nodes[r].end();
+                tk.inside_max_end = nodes[r].inside_max_end();
+                if constexpr (Node::has_outside_max_end) {
+                    tk.outside_max_end = nodes[r].outside_max_end();
+                }
+            }
+        }
+    }
+
+    // Item of the node ranked r
+    inline const Item& item(Rank r) const {
+        if constexpr (Node::has_item) {
+            return nodes[r].item;
+        } else {
+            return items[r];
+        }
+    }
+
+    // call f on item, treating a void return value as "continue"
+    template<class F>
+    static inline bool visit(F& f, const Item& item) {
+        if constexpr (std::is_void<decltype(f(item))>::value) {
+            f(item);
+            return true;
+        } else {
+            return f(item);
+        }
+    }
+
+    // rank of an Item held by this index (inverse of item())
+    inline Rank rank_of(const Item& it) const {
+        if constexpr (Node::has_item) {
+            return Rank(reinterpret_cast<const char*>(&it) - reinterpret_cast<const char*>(&(nodes[0].item))) / sizeof(Node);
+        } else {
+            return Rank(&it - &(items[0]));
+        }
+    }
+
+    // overlap_visit functions appending the ranks of the items visited to ans, for overlap_ranks()
+    // and (coalescing consecutive ranks into runs) overlap_rank_runs()
+    auto rank_collector(std::vector<size_t>& ans) const {
+        return [this, &ans](const Item& it) { ans.push_back(rank_of(it)); };
+    }
+    auto rank_run_collector(std::vector<std::pair<size_t, size_t>>& ans) const {
+        return [this, &ans](const Item& it) {
+            const Rank r = rank_of(it);
+            if (!ans.empty() && ans.back().second+1 == r) {
+                ans.back().second = r;
+            } else {
+                ans.emplace_back(r, r);
+            }
+        };
+    }
+
+    // first rank whose node begins at or after pos (nodes.size() if none)
+    Rank lower_rank(Pos pos) const {
+        Rank lo = 0, hi = nodes.size();
+        while (lo < hi) {
+            const Rank mid = lo + (hi-lo)/2;
+            if (nodes[mid].beg() < pos) {
+                lo = mid+1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // first rank whose node begins at or after pos, by galloping (exponential) search from rank f
+    // followed by binary search; nrank if that's more than max_gallop ranks away. add the # of
+    // nodes visited to cost.
+    Rank gallop(Rank f, Pos pos, size_t max_gallop, size_t& cost) const {
+        const Rank n = nodes.size();
+        Rank a, b;  // the answer is in [a, b]
+        if (f < n && (++cost, nodes[f].beg() < pos)) {
+            a = f+1;
+            for (Rank step = 1; ; step *= 2) {
+                if (step > max_gallop) {
+                    return nrank;
+                }
+                if (f+step >= n) {
+                    b = n;
+                    break;
+                }
+                ++cost;
+                if (nodes[f+step].beg() >= pos) {
+                    b = f+step;
+                    break;
+                }
+                a = f+step+1;
+            }
+        } else {
+            b = f = std::min(f, n);
+            for (Rank step = 1; ; step *= 2) {
+                if (step > max_gallop) {
+                    return nrank;
+                }
+                if (step > f) {
+                    a = 0;
+                    break;
+                }
+                ++cost;
+                if (nodes[f-step].beg() < pos) {
+                    a = f-step+1;
+                    break;
+                }
+                b = f-step;
+            }
+        }
+        while (a < b) {
+            const Rank mid = a + (b-a)/2;
+            ++cost;
+            if (nodes[mid].beg() < pos) {
+                a = mid+1;
+            } else {
+                b = mid;
+            }
+        }
+        return a;
+    }
+
+    // lower_rank(pos) for a nearest-interval query, adding its cost; iitii starts from the model's
+    // prediction instead of a binary search
+    virtual Rank seek(Pos pos, size_t& cost) const {
+        cost += nodes.empty() ? 0 : log2ull(nodes.size())+1;
+        return lower_rank(pos);
+    }
+
+    // distance of a node from the position qpos: 0 if it overlaps qpos, otherwise the distance
+    // from qpos to the nearest position it contains, i.e. beg-qpos or qpos-(end-1)
+    static inline Pos nearest_distance(const Node& nd, Pos qpos) {
+        if (nd.beg() > qpos) {
+            return nd.beg() - qpos;
+        }
+        return nd.end() > qpos ? Pos(0) : Pos(qpos - nd.end() + 1);
+    }
+
+    // k-nearest candidates, ordered by distance then descending rank; the heap's front is the
+    // worst kept
+    struct nearest_candidate {
+        Pos dist;
+        Rank r;
+        bool operator<(const nearest_candidate& rhs) const {
+            return dist < rhs.dist || (dist == rhs.dist && r > rhs.r);
+        }
+    };
+
+    // Collect the k items nearest qpos (in direction dir) into heap, expanding outward from rank
+    // R = lower_rank(qpos). Rightward the nodes begin at increasing positions, so the walk on that
+    // side stops at the first node whose beg already puts it behind the worst kept candidate.
+    // Leftward, the ranks < R are visited in descending order, skipping at once any subtree whose
+    // inside_max_end puts all of it behind the worst candidate (which it can't beat on a tie of
+    // distance, being of lower rank; so once k overlapping nodes are found, the rest of the walk
+    // is skipped even though long intervals may remain to the left). Each step takes the largest
+    // subtree whose rightmost leaf is the next rank (found from the trailing bits of that rank),
+    // descending its right spine until a subtree can be skipped or a single node remains. So the
+    // leftward walk costs like a top-down scan pruned by inside_max_end, and once k candidates are
+    // in hand, the rest of the prefix is dismissed in O(log n) subtrees. With outside_max_end
+    // (iitii), the walk instead stops as soon as a skipped subtree or visited leaf shows that
+    // nothing to its left ends late enough. add the # of nodes visited to cost.
+    void nearest_walk(Rank R, Pos qpos, size_t k, iit_direction dir,
+                      std::vector<nearest_candidate>& heap, size_t& cost) const {
+        auto consider = [&](Rank r) {
+            const Node& nd = nodes[r];
+            if ((dir == iit_direction::upstream && nd.end() > qpos) ||
+                (dir == iit_direction::downstream && nd.beg() <= qpos)) {
+                return;
+            }
+            const nearest_candidate c = { nearest_distance(nd, qpos), r };
+            if (heap.size() < k) {
+                heap.push_back(c);
+                std::push_heap(heap.begin(), heap.end());
+            } else if (c < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = c;
+                std::push_heap(heap.begin(), heap.end());
+            }
+        };
+        // true if, with k candidates in hand, no node ranked below them & ending at e or before
+        // can beat the worst
+        auto behind = [&](Pos e) {
+            return heap.size() == k && heap.front().dist <= (e > qpos ? Pos(0) : Pos(qpos - e + 1));
+        };
+        // true if no node ranked below lo, the leftmost leaf of subtree x (on level kl), can beat
+        // the worst candidate: they're outside x & its subtree, and if they begin before x, then
+        // x's outside_max_end bounds their ends
+        auto left_behind = [&](Rank x, Level kl, Rank lo) {
+            if constexpr (Node::has_outside_max_end) {
+                if (!lo) {
+                    return true;
+                }
+                ++cost;
+                return nodes[lo-1].beg() < key_beg(x, kl) && behind(key_outside_max_end(x, kl));
+            } else {
+                return !lo;
+            }
+        };
+        if (!k) {
+            return;
+        }
+
+        // rightward: nodes ranked >= R begin at or after qpos, and each is at least beg-qpos away
+        for (Rank r = R; r < nodes.size(); ++r) {
+            const Pos beg = nodes[r].beg();
+            ++cost;
+            if ((dir == iit_direction::upstream && beg > qpos) ||
+                (heap.size() == k && heap.front().dist < Pos(beg - qpos))) {
+                break;
+            }
+            consider(r);
+        }
+        if (dir == iit_direction::downstream) {
+            return;  // (the nodes ranked < R begin before qpos)
+        }
+
+        // leftward: ranks < e remain to be visited
+        for (Rank e = R; e > 0; ) {
+            const Rank j = e-1;
+            if (j & 1) {
+                // j is an internal node, whose right subtree has been visited
+                ++cost;
+                consider(j);
+                e = j;
+                continue;
+            }
+            // leaf j is the rightmost of the subtrees on levels up to kmax
+            Level kl = Level(__builtin_ctzll((unsigned long long)(j+2))) - 1;
+            for (; kl > 0; --kl) {
+                const Rank x = j + 1 - (Rank(1) << kl);
+                assert(level(x) == kl);
+                ++cost;
+                // every node in the subtree is at least qpos-(ime-1) away (or ends after qpos)
+                if (behind(key_inside_max_end(x, kl))) {
+                    break;
+                }
+            }
+            const Rank x = j + 1 - (Rank(1) << kl);
+            if (kl == 0) {
+                ++cost;
+                consider(j);
+            }
+            e = j + 2 - (Rank(2) << kl);
+            if (left_behind(x, kl, e)) {
+                return;
+            }
+        }
+    }
+
+    // k-nearest query starting from rank R: fill ans by distance then rank & return the cost
+    size_t nearest_from(Rank R, Pos qpos, size_t k, iit_direction dir, std::vector<const Item*>& ans,
+                        size_t cost) const {
+        std::vector<nearest_candidate> heap;
+        heap.reserve(std::min(k, nodes.size()));
+        nearest_walk(R, qpos, k, dir, heap, cost);
+        std::sort_heap(heap.begin(), heap.end());
+        ans.clear();
+        for (const nearest_candidate& c : heap) {
+            ans.push_back(&item(c.r));
+        }
+        return cost;
+    }
+
+    // Test the n <= 31 nodes ranked [r, r+n) against [qbeg,qend): return the bitmask of those
+    // overlapping it, and set below to the bitmask of those with beg < qend.
+    inline unsigned leaf_mask(Rank r, size_t n, Pos qbeg, Pos qend, unsigned& below) const {
+        assert(n && n < 32 && r+n <= nodes.size());
+        #ifdef __AVX2__
+        if constexpr (!Node::has_item && !Node::compact && iit_simd_leaf_mask<Pos>()) {
+            // gather the begs & ends of 8 nodes at a time from the key array; for unsigned
+            // positions, flip the sign bits to use the signed comparison
+            const __m256i flip = _mm256_set1_epi32(std::is_signed<Pos>::value ? 0 : INT32_MIN),
+                          vqbeg = _mm256_xor_si256(_mm256_set1_epi32(int32_t(qbeg)), flip),
+                          vqend = _mm256_xor_si256(_mm256_set1_epi32(int32_t(qend)), flip),
+                          lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                          ofs = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(int32_t(sizeof(Node))));
+            unsigned hits = 0;
+            below = 0;
+            for (size_t i = 0; i < n; i += 8) {
+                const __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(int32_t(n-i)), lanes);
+                const int* pbeg = reinterpret_cast<const int*>(&(nodes[r+i].beg_));
+                const int* pend = reinterpret_cast<const int*>(&(nodes[r+i].end_));
+                const __m256i zero = _mm256_setzero_si256(),
+                    vbeg = _mm256_xor_si256(_mm256_mask_i32gather_epi32(zero, pbeg, ofs, valid, 1), flip),
+                    vend = _mm256_xor_si256(_mm256_mask_i32gather_epi32(zero, pend, ofs, valid, 1), flip),
+                    b = _mm256_and_si256(valid, _mm256_cmpgt_epi32(vqend, vbeg)),
+                    h = _mm256_and_si256(b, _mm256_cmpgt_epi32(vend, vqbeg));
+                below |= unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(b))) << i;
+                hits |= unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(h))) << i;
+            }
+            return hits;
+        }
+        #endif
+        unsigned hits = 0;
+        below = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const Node& nd = nodes[r+i];
+            const unsigned b = nd.beg() < qend, h = b & unsigned(nd.end() > qbeg);
+            below |= b << i;
+            hits |= h << i;
+        }
+        return hits;
+    }
+
+    // Resumable top-down overlap scan, with an explicit stack in place of recursion. The stack
+    // holds, for each ancestor whose left subtree we're currently exploring, a frame to "emit" it
+    // afterwards (then explore its right subtree), plus one frame on top for the subtree to
+    // explore next. So its depth is bounded by the tree height, and one fixed-size array
+    // suffices. When a low-level subtree (k <= leaf_level) is reached, its hits are found at
+    // once by leaf_mask(), and then emitted from leaf_hits one by one.
+    struct scan_state {
+        struct frame {
+            Rank node;
+            Level k;
+            bool emit;
+        };
+        frame stack[8*sizeof(Rank)+1];
+        size_t depth = 0;
+        Rank leaf_rank = 0;     // hits of the leaf block being emitted, ranked leaf_rank+i
+        unsigned leaf_hits = 0;
+    };
+
+    // prefetch the first node(s) the scan of subtree (at level k) will touch
+    inline void prefetch_subtree(Rank subtree, Level k) const {
+        if (k <= leaf_level) {
+            prefetch(leftmost_leaf(subtree, k));
+            prefetch(std::min(rightmost_leaf(subtree, k), nodes.size()-1));
+        } else {
+            prefetch_key(subtree, k);
+        }
+    }
+
+    // push a subtree to explore onto the scan stack & prefetch the first node it'll touch. When
+    // the subtree root is imaginary, only its left spine can hold real nodes: these are ranked
+    // lml-1+2^j for j = k, k-1, ..., 0 (lml its leftmost leaf), so we jump straight to the
+    // highest real one, counting a cost of one per imaginary node skipped.
+    void scan_push(scan_state& st, Rank subtree, Level k, size_t& cost) const {
+        if (nodes.empty()) {
+            return;
+        }
+        assert(k == level(subtree));
+        if (subtree >= nodes.size()) {
+            const Rank lml = subtree + 1 - (Rank(1) << k);
+            if (lml >= nodes.size()) {
+                cost += k+1;
+                return;
+            }
+            const Level kr = Level(log2ull(nodes.size() - lml));
+            assert(kr < k);
+            cost += k - kr;
+            k = kr;
+            subtree = lml - 1 + (Rank(1) << k);
+            assert(subtree < nodes.size() && level(subtree) == k);
+        }
+        assert(st.depth < sizeof(st.stack)/sizeof(st.stack[0]));
+        st.stack[st.depth++] = {subtree, k, false};
+        prefetch_subtree(subtree, k);
+    }
+
+    // Advance the resumable scan for [qbeg,qend), calling f on each result in order & adding the
+    // number of nodes visited to cost. Return false once the scan is done, or true if it paused
+    // because f returned false (to stop, or to take one result at a time), or, with Yield, after
+    // each push of a new subtree (whose first node has been prefetched). Paused scans resume from
+    // where they left off.
+    template<bool Yield, class F>
+    bool scan_run(scan_state& st, Pos qbeg, Pos qend, F& f, size_t& cost) const {
+        while (true) {
+            while (st.leaf_hits) {
+                const unsigned i = __builtin_ctz(st.leaf_hits);
+                st.leaf_hits &= st.leaf_hits-1;
+                if (!visit(f, item(st.leaf_rank+i))) {
+                    return true;
+                }
+            }
+            if (!st.depth) {
+                return false;
+            }
+            auto& fr = st.stack[st.depth-1];
+            const Rank subtree = fr.node;
+            const Level k = fr.k;
+            if (fr.emit) {
+                // returning to a node after its left subtree; this node is already in cache
+                --st.depth;
+                if (key_beg(subtree, k) < qend) {   // this node isn't already past query
+                    scan_push(st, right(subtree, k), k-1, cost);
+                    if (key_end(subtree, k) > qbeg && !visit(f, item(subtree))) {
+                        return true;
+                    }
+                    if (Yield) {
+                        return true;
+                    }
+                }
+            } else if (k <= leaf_level) {
+                // low-level subtree: test all its nodes at once. they're sorted by beg, so the
+                // (scalar) scan would've stopped at the first with beg >= qend
+                --st.depth;
+                st.leaf_rank = leftmost_leaf(subtree, k);
+                const Rank rml = std::min(rightmost_leaf(subtree, k), nodes.size()-1);
+                unsigned below;
+                st.leaf_hits = leaf_mask(st.leaf_rank, rml-st.leaf_rank+1, qbeg, qend, below);
+                cost += __builtin_popcount(below);
+            } else {
+                ++cost;
+                if (key_inside_max_end(subtree, k) > qbeg) {   // something in subtree extends into/over query
+                    fr.emit = true;
+                    // descend left, prefetching the right child too if it too will be scanned
+                    const Rank rc = right(subtree, k);
+                    if (rc < nodes.size() && key_beg(subtree, k) < qend) {
+                        prefetch_subtree(rc, k-1);
+                    }
+                    scan_push(st, left(subtree, k), k-1, cost);
+                    if (Yield) {
+                        return true;
+                    }
+                } else {
+                    --st.depth;
+                }
+            }
+        }
+    }
+
+    // top-down overlap scan for [qbeg,qend), calling f on each result in order. add # of nodes
+    // visited to cost & return false if f asked to stop.
+    template<class F>
+    bool scan_visit(Rank subtree, Level k, Pos qbeg, Pos qend, F& f, size_t& cost) const {
+        assert(subtree < full_size || nodes.empty());
+        assert(nodes.empty() || k == level(subtree));
+        scan_state st;
+        scan_push(st, subtree, k, cost);
+        return !scan_run<false>(st, qbeg, qend, f, cost);
+    }
+
+    // top-down overlap scan for [qbeg,qend), appending results to ans. return # of nodes visited.
+    size_t scan(Rank subtree, Level k, Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        size_t cost = 0;
+        auto f = [&ans](const Item& item) { ans.push_back(&item); };
+        scan_visit(subtree, k, qbeg, qend, f, cost);
+        return cost;
+    }
+
+    // advance a resumable scan until it needs to touch a new node (which has been prefetched by
+    // scan_push), accumulating results and cost like scan(). return false once the scan is done.
+    bool scan_step(scan_state& st, Pos qbeg, Pos qend, std::vector<const Item*>& ans,
+                   size_t& cost) const {
+        auto f = [&ans](const Item& item) { ans.push_back(&item); };
+        return scan_run<true>(st, qbeg, qend, f, cost);
+    }
+
+    // state of one in-flight query within overlap_batch
+    struct batch_slot {
+        size_t query;
+        Pos qbeg, qend;
+        size_t cost;
+        bool climbing;
+        Rank subtree;        // climbing state, used by subclasses starting somewhere below the root
+        Level k, k0;
+        scan_state scan;
+        std::vector<const Item*> results;
+    };
+
+    // Interleaved execution of a batch of queries: each in-flight query occupies a slot, and we
+    // advance them round-robin, one step each. Every step ends by prefetching the node that slot
+    // will touch next, so its cache miss overlaps with the other slots' steps. The start function
+    // initializes a slot for its new query by either calling scan_push or setting it climbing;
+    // climb_step advances a climbing slot by one step.
+    template<class Start, class ClimbStep>
+    size_t run_batch(const Pos* qbegs, const Pos* qends, size_t n, size_t inflight,
+                     std::vector<size_t>& offsets, std::vector<const Item*>& items,
+                     Start start, ClimbStep climb_step) const {
+        offsets.assign(n+1, 0);
+        items.clear();
+        if (!n) {
+            return 0;
+        }
+
+        // results are staged in completion order & then laid out in query order. spans[i] is the
+        // (offset, count) of query i's results in the staging buffer.
+        std::vector<const Item*> staged;
+        std::vector<std::pair<size_t,size_t>> spans(n);
+        std::vector<batch_slot> slots(std::max(size_t(1), std::min(inflight, n)));
+        size_t next = 0, active = 0, cost = 0;
+        auto launch = [&](batch_slot& s) {
+            s.query = next;
+            s.qbeg = qbegs[next];
+            s.qend = qends[next];
+            s.cost = 0;
+            s.climbing = false;
+            s.scan.depth = 0;
+            s.scan.leaf_hits = 0;
+            s.results.clear();
+            ++next;
+            start(s);
+        };
+        for (auto& s : slots) {
+            launch(s);
+            ++active;
+        }
+
+        while (active) {
+            for (auto& s : slots) {
+                if (s.query == nrank) {
+                    continue;
+                }
+                if (s.climbing) {
+                    climb_step(s);
+                } else if (!scan_step(s.scan, s.qbeg, s.qend, s.results, s.cost)) {
+                    // query complete; stage its results and refill the slot
+                    spans[s.query] = std::make_pair(staged.size(), s.results.size());
+                    staged.insert(staged.end(), s.results.begin(), s.results.end());
+                    cost += s.cost;
+                    if (next < n) {
+                        launch(s);
+                    } else {
+                        s.query = nrank;
+                        --active;
+                    }
+                }
+            }
+        }
+
+        items.reserve(staged.size());
+        for (size_t i = 0; i < n; ++i) {
+            offsets[i] = items.size();
+            auto it = staged.begin() + spans[i].first;
+            items.insert(items.end(), it, it + spans[i].second);
+        }
+        offsets[n] = items.size();
+        return cost;
+    }
+
+    // an item in one of join_sweep's active lists
+    struct join_entry {
+        Rank r;
+        Pos beg, end;
+    };
+
+    // Probe an active list with the item [beg,end) just reached by the sweep, calling emit(r) for
+    // each overlapping entry, and dropping those ending at or before beg, which can't overlap any
+    // later item either. The cost is thus linear in the number of results plus drops.
+    template<class Emit>
+    static bool join_probe(std::vector<join_entry>& active, Pos beg, Pos end, Emit emit) {
+        size_t kept = 0;
+        for (size_t e = 0; e < active.size(); ++e) {
+            const join_entry& je = active[e];
+            if (je.end > beg) {
+                active[kept++] = je;
+                if (je.beg < end && !emit(je.r)) {
+                    return false;
+                }
+            }
+        }
+        active.resize(kept);
+        return true;
+    }
+
+    // Sweep of join() over the nodes ranked [ra, ra_end) in this index and [rb, rb_end) in other,
+    // which are those beginning in one slice [lo, ...) of the position range, merged in begin
+    // order. Each item, when reached, is probed against the other index's active items, so each
+    // overlapping pair with its later begin in the slice is reported once. With seed, the active
+    // lists start with the items beginning before lo & extending past it, found by top-down scans
+    // for the empty query [lo,lo). return false if f asked to stop.
+    template<typename OItem, class ONode, template<class> class ONodeArray, unsigned OTopLevels, unsigned OLeafLevel, class F>
+    bool join_sweep(const iit_base<Pos, OItem, ONode, ONodeArray, OTopLevels, OLeafLevel>& other,
+                    Rank ra, Rank ra_end, Rank rb, Rank rb_end, bool seed, Pos lo,
+                    F& f, size_t& pairs, std::atomic<bool>& stop) const {
+        std::vector<join_entry> active_a, active_b;
+        if (seed) {
+            size_t cost = 0;
+            auto seed_a = [&](const Item& it) {
+                const Rank r = rank_of(it);
+                active_a.push_back({r, nodes[r].beg(), nodes[r].end()});
+            };
+            scan_visit(root, root_level, lo, lo, seed_a, cost);
+            auto seed_b = [&](const OItem& it) {
+                const Rank r = other.rank_of(it);
+                active_b.push_back({r, other.nodes[r].beg(), other.nodes[r].end()});
+            };
+            other.scan_visit(other.root, other.root_level, lo, lo, seed_b, cost);
+        }
+
+        auto emit = [&](const Item& a, const OItem& b) {
+            if (stop.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            ++pairs;
+            if (!iit_visit_pair(f, a, b)) {
+                stop = true;
+                return false;
+            }
+            return true;
+        };
+        while (ra < ra_end || rb < rb_end) {
+            if (rb == rb_end || (ra < ra_end && nodes[ra].beg() <= other.nodes[rb].beg())) {
+                const Pos beg = nodes[ra].beg(), end = nodes[ra].end();
+                if (!join_probe(active_b, beg, end, [&](Rank r) { return emit(item(ra), other.item(r)); })) {
+                    return false;
+                }
+                if (end > beg) {
+                    active_a.push_back({ra, beg, end});
+                }
+                ++ra;
+            } else {
+                const Pos beg = other.nodes[rb].beg(), end = other.nodes[rb].end();
+                if (!join_probe(active_a, beg, end, [&](Rank r) { return emit(item(r), other.item(rb)); })) {
+                    return false;
+                }
+                if (end > beg) {
+                    active_b.push_back({rb, beg, end});
+                }
+                ++rb;
+            }
+        }
+        return true;
+    }
+
+    // Sweep of coverage() over the windows [w0, w1) of [beg, end), recording out[w0..w1). Items'
+    // begins are taken in rank order & their ends from a min-heap of the active ones, so the depth
+    // is piecewise constant between consecutive events, which are accounted to the window holding
+    // them. The active items at the first window's start are seeded by a top-down scan for the
+    // empty query at that position, and windows with no events are skipped at once. return the #
+    // of nodes visited.
+    size_t coverage_sweep(Pos beg, Pos end, Pos window, size_t w0, size_t w1,
+                          iit_coverage_window<Pos>* out) const {
+        typedef typename iit_coverage_window<Pos>::Sum Sum;
+        auto wbeg = [&](size_t w) { return Pos(beg + Pos(w)*window); };
+        auto wend = [&](size_t w) { return std::min(end, Pos(beg + Pos(w+1)*window)); };
+        size_t cost = 0;
+        if (w0 >= w1) {
+            return cost;
+        }
+        const Pos lo = wbeg(w0), hi = wend(w1-1);
+
+        std::vector<Pos> ends;  // min-heap of the active items' ends
+        auto later = std::greater<Pos>();
+        auto seed = [&](const Item& it) { ends.push_back(nodes[rank_of(it)].end()); };
+        scan_visit(root, root_level, lo, lo, seed, cost);
+        std::make_heap(ends.begin(), ends.end(), later);
+
+        Rank r = lower_rank(lo);
+        size_t w = w0;
+        Pos p = lo, we = wend(w);
+        out[w].items = ends.size();
+        while (true) {
+            // next event: the first active end, the window end, or the next begin
+            const bool more = r < nodes.size() && nodes[r].beg() < hi;
+            Pos x = we;
+            if (!ends.empty() && ends.front() < x) {
+                x = ends.front();
+            }
+            if (more && nodes[r].beg() < x) {
+                x = nodes[r].beg();
+            }
+            if (x > p) {
+                if (const size_t depth = ends.size()) {
+                    iit_coverage_window<Pos>& o = out[w];
+                    o.covered += x - p;
+                    o.depth_sum += Sum(depth)*Sum(x - p);
+                    o.max_depth = std::max(o.max_depth, depth);
+                }
+                p = x;
+            }
+            if (!ends.empty() && ends.front() == x) {
+                std::pop_heap(ends.begin(), ends.end(), later);
+                ends.pop_back();
+            } else if (x == we) {
+                if (++w == w1) {
+                    break;
+                }
+                if (ends.empty() && more && nodes[r].beg() >= wend(w)) {
+                    // no item covers the windows before the next begin
+                    if constexpr (std::is_integral<Pos>::value) {
+                        w = size_t((nodes[r].beg() - beg)/window);
+                    } else {
+                        while (wend(w) <= nodes[r].beg()) {
+                            ++w;
+                        }
+                    }
+                    assert(w < w1);
+                }
+                p = wbeg(w);
+                we = wend(w);
+                out[w].items = ends.size();
+            } else {
+                // the next item begins at x (and counts as overlapping the window if it's empty
+                // but strictly inside it)
+                ++cost;
+                const Pos e = nodes[r++].end();
+                if (e > x) {
+                    ends.push_back(e);
+                    std::push_heap(ends.begin(), ends.end(), later);
+                }
+                if (e > x || x > wbeg(w)) {
+                    ++out[w].items;
+                }
+            }
+        }
+        return cost;
+    }
+
+    // Sweep of aggregate() over windows [w0, w1), with a min-heap of the active items' ends: the
+    // nodes beginning before each window's end are pushed in rank order, those ending at or before
+    // its begin popped, and the rest reduced into its accumulator. Where the sweep falls more than
+    // a few tree heights behind a window's begin (e.g. in a gap between windows), it gallops
+    // ahead, seeding the active items by a top-down scan instead of visiting every node in the
+    // gap. return the # of nodes visited.
+    template<class Acc, class Reduce>
+    size_t aggregate_sweep(const std::pair<Pos, Pos>* windows, size_t w0, size_t w1, Acc* out,
+                           Reduce& reduce) const {
+        struct active {
+            Pos end;
+            Rank r;
+            bool operator<(const active& rhs) const { return end > rhs.end; }  // for the min-heap
+        };
+        std::vector<active> heap;
+        size_t cost = 0;
+        Rank r = 0;
+        for (size_t w = w0; w < w1; ++w) {
+            const Pos wb = windows[w].first, we = windows[w].second;
+            if (r < nodes.size() && nodes[r].beg() < wb) {
+                const Rank rt = gallop(r, wb, std::numeric_limits<size_t>::max(), cost);
+                if (w == w0 || rt - r > 2*(root_level+1)) {
+                    auto seed = [&](const Item& it) {
+                        const Rank ri = rank_of(it);
+                        if (ri >= r) {
+                            heap.push_back({nodes[ri].end(), ri});
+                            std::push_heap(heap.begin(), heap.end());
+                        }
+                    };
+                    scan_visit(root, root_level, wb, wb, seed, cost);
+                    r = rt;
+                }
+            }
+            for (; r < nodes.size() && nodes[r].beg() < we; ++r) {
+                ++cost;
+                if (nodes[r].end() > wb) {
+                    heap.push_back({nodes[r].end(), r});
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+            while (!heap.empty() && heap.front().end <= wb) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+            for (const active& a : heap) {
+                reduce(out[w], item(a.r));
+            }
+        }
+        return cost;
+    }
+
+    // the slices of at least 64Ki nodes each into which the position range is split for threads,
+    // starting at the begin positions of evenly spaced ranks; return the first window index of
+    // each (per first_window(pos)), plus nwin at the end
+    template<class FirstWindow>
+    std::vector<size_t> window_slices(unsigned threads, size_t nwin, FirstWindow first_window) const {
+        const size_t slices = std::max(size_t(1), std::min(size_t(std::max(threads, 1U)), nodes.size() >> 16));
+        std::vector<size_t> ans(slices+1, nwin);
+        ans[0] = 0;
+        for (size_t c = 1; c < slices; ++c) {
+            ans[c] = std::max(ans[c-1], std::min(nwin, first_window(nodes[nodes.size()*c/slices].beg())));
+        }
+        return ans;
+    }
+
+    // write the index file. The subclass fills in hdr's model fields and provides any extra
+    // sections (indexed by iit_file_header section id).
+    void write_file(const std::string& filename, iit_file_header& hdr,
+                    std::vector<std::pair<const void*, size_t>> sections = {}) const {
+        static_assert(std::is_trivially_copyable<Node>::value && std::is_trivially_copyable<Item>::value,
+                      "saving the index requires trivially copyable Pos and Item types");
+        sections.resize(iit_file_header::MAX_SECTIONS, std::make_pair(nullptr, 0));
+        sections[iit_file_header::NODES] =
+            std::make_pair(nodes.size() ? &nodes[0] : nullptr, nodes.size()*sizeof(Node));
+        sections[iit_file_header::ITEMS] =
+            std::make_pair(items.size() ? &items[0] : nullptr, items.size()*sizeof(Item));
+        hdr.pos_size = sizeof(Pos);
+        hdr.item_size = sizeof(Item);
+        hdr.node_size = sizeof(Node);
+        hdr.has_item = Node::has_item;
+        hdr.nodes = nodes.size();
+        hdr.full_size = full_size;
+        hdr.root = root;
+        hdr.root_level = root_level;
+
+        auto align = [](uint64_t ofs) { return (ofs + 63) / 64 * 64; };
+        uint64_t ofs = align(sizeof(hdr));
+        for (size_t i = 0; i < sections.size(); ++i) {
+            hdr.sections[i].offset = sections[i].second ? ofs : 0;
+            hdr.sections[i].bytes = sections[i].second;
+            ofs = align(ofs + sections[i].second);
+        }
+
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        for (size_t i = 0; i < sections.size(); ++i) {
+            if (sections[i].second) {
+                const std::string padding(hdr.sections[i].offset - uint64_t(out.tellp()), '\0');
+                out.write(padding.data(), padding.size());
+                out.write(reinterpret_cast<const char*>(sections[i].first), sections[i].second);
+            }
+        }
+        out.close();
+        if (out.fail()) {
+            throw std::runtime_error("Failed to write " + filename);
+        }
+    }
+
+    // load n T's from a file section into arr: viewing them in place if zero_copy (which requires
+    // NodeArray = iit_mapped_array), or else copying them.
+    template<class T>
+    static void load_array(NodeArray<T>& arr, const std::shared_ptr<const iit_file_mapping>& m,
+                           const iit_file_header& hdr, size_t section, size_t n, bool zero_copy) {
+        if (hdr.sections[section].bytes != n*sizeof(T)) {
+            throw std::runtime_error("corrupt iitii index file");
+        }
+        const T* data = reinterpret_cast<const T*>(m->data() + hdr.sections[section].offset);
+        if constexpr (iit_is_mapped_array<NodeArray<T>>::value) {
+            if (zero_copy) {
+                arr = NodeArray<T>::view(data, n, m);
+                return;
+            }
+        }
+        assert(!zero_copy);
+        arr = NodeArray<T>();
+        arr.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            arr.push_back(data[i]);
+        }
+    }
+
+    // map an index file & load the tree from it into this (default-constructed) object. Returns
+    // the header and mapping, from which the subclass can load its model.
+    iit_file_header read_file(const std::string& filename, bool zero_copy,
+                              std::shared_ptr<const iit_file_mapping>& m) {
+        static_assert(std::is_trivially_copyable<Node>::value && std::is_trivially_copyable<Item>::value,
+                      "loading the index requires trivially copyable Pos and Item types");
+        m = iit_file_mapping::open(filename);
+        iit_file_header hdr;
+        if (m->size() < sizeof(hdr)) {
+            throw std::runtime_error(filename + " isn't an iitii index file");
+        }
+        memcpy(&hdr, m->data(), sizeof(hdr));
+        hdr.check(filename, m->size());
+        if (hdr.pos_size != sizeof(Pos) || hdr.item_size != sizeof(Item) ||
+            hdr.node_size != sizeof(Node) || hdr.has_item != Node::has_item) {
+            throw std::runtime_error(filename + " holds a different type of index");
+        }
+        full_size = hdr.full_size;
+        root = hdr.root;
+        root_level = hdr.root_level;
+        load_array(nodes, m, hdr, iit_file_header::NODES, hdr.nodes, zero_copy);
+        if (!Node::has_item) {
+            load_array(items, m, hdr, iit_file_header::ITEMS, hdr.nodes, zero_copy);
+        }
+        build_top_keys();
+        return hdr;
+    }
+
+    iit_base()
+        : full_size(0)
+        , root(0)
+        , root_level(0)
+        {}
+
+    iit_base(NodeArray<BuildNode>& nodes_, unsigned threads)
+        : root_level(0)
+        , root(std::numeric_limits<Rank>::max())
+    {
+        if constexpr (std::is_same<BuildNode, Node>::value) {
+            nodes = std::move(nodes_);
+        } else {
+            // split the sorted nodes into keys & items
+            nodes.reserve(nodes_.size());
+            items.reserve(nodes_.size());
+            for (auto& bn : nodes_) {
+                nodes.push_back(Node(bn.item));
+                items.push_back(std::move(bn.item));
+            }
+            nodes_ = NodeArray<BuildNode>();
+        }
+
+        // compute the implied tree geometry
+        for (root_level = 0, full_size = 0; full_size < nodes.size();
+             ++root_level, full_size = (size_t(1)<<(root_level+1)) - 1);
+        root = (Rank(1) << root_level) - 1;
+
+        if (nodes.size()) {
+            #ifndef NDEBUG
+            for (Rank r = 0; r < nodes.size()-1; ++r) {
+                assert(nodes[r].beg() <= nodes[r+1].beg());
+            }
+            #endif
+
+            // Memoize the path from the rightmost leaf up to the root. This will trace the border
+            // between the real and imaginary nodes (if any), which we'll refer to in indexing
+            // below. Some of these border nodes may be imaginary.
+            std::vector<Rank> right_border_nodes({
+                nodes.size() - (2 - nodes.size() % 2)  // rightmost real leaf
+            });
+            while (right_border_nodes.back() != root) {
+                right_border_nodes.push_back(parent2(right_border_nodes.back()));
+            }
+
+            // bottom-up indexing; the nodes on each level depend only on the level below, so each
+            // level can be spread across threads
+            Pos right_border_ime = nodes[right_border_nodes[0]].inside_max_end();
+            for (Level k=1; k <= root_level; ++k) {
+                // for each in nodes on this level
+                const size_t x = size_t(1)<<(k-1), step = x<<2, first = (x<<1)-1;
+                const size_t count = first < nodes.size() ? (nodes.size()-first+step-1)/step : 0;
+                iit_parallel_for(count, threads, 16384, [&](size_t lo, size_t hi) {
+                    for (Rank n = first + lo*step; n < first + hi*step && n < nodes.size(); n += step) {
+                        // figure inside_max_end
+                        Pos ime = nodes[n].end();
+                        ime = std::max(ime, nodes[left(n,k)].inside_max_end());
+                        if (right(n,k) < nodes.size()) {
+                            ime = std::max(ime, nodes[right(n,k)].inside_max_end());
+                        } else {
+                            // right child is imaginary; take the last border observation
+                            ime = std::max(ime, right_border_ime);
+                        }
+                        assert(ime != Node::npos || Node::compact);
+                        nodes[n].set_inside_max_end(ime);
+                    }
+                });
+                if (right_border_nodes[k] < nodes.size()) {
+                    // track inside_max_end of the real nodes on the border
+                    right_border_ime = nodes[right_border_nodes[k]].inside_max_end();
+                }
+            }
+        }
+        build_top_keys();
+    }
+
+public:
+    // whether copies of the index may share its arrays rather than copying them, as with
+    // NodeArray = iit_mapped_array viewing a file mapped by load_mmap()
+    static const bool shared_storage = iit_is_mapped_array<NodeArray<Node>>::value;
+
+    // overlap query; fill ans, in ascending order of (begin, end), and return query cost (number
+    // of tree nodes visited)
+    virtual size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        ans.clear();
+        return scan(root, root_level, qbeg, qend, ans);
+    }
+
+    // overlap query, return vector of results
+    std::vector<const Item*> overlap(Pos qbeg, Pos qend) const {
+        std::vector<const Item*> ans;
+        overlap(qbeg, qend, ans);
+        return ans;
+    }
+
+    // overlap query calling f(const Item&) on each result, in the same order overlap() returns
+    // them, without materializing a result vector. If f returns bool, then returning false stops
+    // the query early. return query cost.
+    template<class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        size_t cost = 0;
+        scan_visit(root, root_level, qbeg, qend, f, cost);
+        return cost;
+    }
+
+    // count the items overlapping [qbeg,qend)
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        size_t ans = 0;
+        overlap_visit(qbeg, qend, [&ans](const Item&) { ++ans; });
+        return ans;
+    }
+
+    // test whether any item overlaps [qbeg,qend), stopping at the first one found
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        bool ans = false;
+        overlap_visit(qbeg, qend, [&ans](const Item&) { ans = true; return false; });
+        return ans;
+    }
+
+    // Overlap query yielding the results' ranks, i.e. their indexes in the sorted order of all the
+    // items (see item_at()), in place of pointers. In the same order as overlap(), the ranks
+    // ascend, so that results from several queries or indexes can be merged or intersected as
+    // plain integers. return query cost.
+    size_t overlap_ranks(Pos qbeg, Pos qend, std::vector<size_t>& ans) const {
+        ans.clear();
+        return overlap_visit(qbeg, qend, rank_collector(ans));
+    }
+
+    // overlap_ranks() with each run of consecutive ranks coalesced into one [first, last] pair
+    size_t overlap_rank_runs(Pos qbeg, Pos qend, std::vector<std::pair<size_t, size_t>>& ans) const {
+        ans.clear();
+        return overlap_visit(qbeg, qend, rank_run_collector(ans));
+    }
+
+    // number of items indexed
+    size_t size() const {
+        return nodes.size();
+    }
+
+    // the item ranked r, r < size(), in ascending order of (begin, end)
+    const Item& item_at(size_t r) const {
+        assert(r < nodes.size());
+        return item(r);
+    }
+
+    // the rank of an item held by this index, e.g. a result of overlap() (inverse of item_at())
+    size_t item_rank(const Item& it) const {
+        return rank_of(it);
+    }
+
+    // Nearest-interval query: fill ans with the k items nearest the position qpos, in ascending
+    // order of distance, ties broken in favour of the later-beginning item (high rank). The
+    // distance of an item overlapping qpos is zero; otherwise, it's the distance from qpos to the
+    // nearest position the item contains, i.e. beg-qpos downstream, or qpos-(end-1) upstream. dir
+    // restricts the query to the items ending at or before qpos (upstream), or those beginning
+    // after it (downstream). Fewer than k results are returned only if the index has fewer such
+    // items. return query cost.
+    size_t k_nearest(Pos qpos, size_t k, std::vector<const Item*>& ans,
+                     iit_direction dir = iit_direction::both) const {
+        size_t cost = 0;
+        const Rank R = seek(qpos, cost);
+        return nearest_from(R, qpos, k, dir, ans, cost);
+    }
+
+    std::vector<const Item*> k_nearest(Pos qpos, size_t k, iit_direction dir = iit_direction::both) const {
+        std::vector<const Item*> ans;
+        k_nearest(qpos, k, ans, dir);
+        return ans;
+    }
+
+    // the nearest item to qpos (or nullptr if the index is empty), as with k_nearest(qpos, 1)
+    const Item* nearest(Pos qpos, iit_direction dir = iit_direction::both) const {
+        std::vector<const Item*> ans;
+        k_nearest(qpos, 1, ans, dir);
+        return ans.empty() ? nullptr : ans[0];
+    }
+
+    // the nearest item ending at or before qpos / beginning after qpos (or nullptr if none)
+    const Item* nearest_upstream(Pos qpos) const {
+        return nearest(qpos, iit_direction::upstream);
+    }
+
+    const Item* nearest_downstream(Pos qpos) const {
+        return nearest(qpos, iit_direction::downstream);
+    }
+
+    // Lazy overlap query: a forward iterator over the items overlapping [qbeg,qend), in the same
+    // (ascending begin, then end) order overlap() returns them, which is also a range for range-based for.
+    // It drives the resumable scan of scan_state, so it holds no heap state and visits each node
+    // only when advanced to it; abandoning it partway costs nothing further. It refers to the
+    // tree, which must outlive it.
+    class overlap_cursor {
+        const iit_base* tree_ = nullptr;
+        Pos qbeg_, qend_;
+        scan_state st_;
+        const Item* cur_ = nullptr;
+        size_t cost_ = 0;
+
+        // advance cur_ to the next result, or nullptr when the scan is done
+        void advance() {
+            auto f = [this](const Item& item) { cur_ = &item; return false; };
+            if (!tree_->template scan_run<false>(st_, qbeg_, qend_, f, cost_)) {
+                cur_ = nullptr;
+            }
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Item value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Item* pointer;
+        typedef const Item& reference;
+
+        // the end of any cursor
+        overlap_cursor() = default;
+
+        // scan subtree (at level k) for [qbeg,qend), having already spent cost getting there
+        overlap_cursor(const iit_base& tree, Rank subtree, Level k, Pos qbeg, Pos qend, size_t cost = 0)
+            : tree_(&tree), qbeg_(qbeg), qend_(qend), cost_(cost) {
+            tree.scan_push(st_, subtree, k, cost_);
+            advance();
+        }
+
+        reference operator*() const { return *cur_; }
+        pointer operator->() const { return cur_; }
+        overlap_cursor& operator++() {
+            advance();
+            return *this;
+        }
+        overlap_cursor operator++(int) {
+            overlap_cursor ans = *this;
+            advance();
+            return ans;
+        }
+        bool operator==(const overlap_cursor& rhs) const { return cur_ == rhs.cur_; }
+        bool operator!=(const overlap_cursor& rhs) const { return cur_ != rhs.cur_; }
+
+        overlap_cursor begin() const { return *this; }
+        overlap_cursor end() const { return overlap_cursor(); }
+
+        // query cost (as returned by overlap()) incurred so far
+        size_t cost() const { return cost_; }
+    };
+
+    overlap_cursor overlap_range(Pos qbeg, Pos qend) const {
+        return overlap_cursor(*this, root, root_level, qbeg, qend);
+    }
+
+    // batch of n overlap queries [qbegs[i], qends[i]), executed with up to inflight queries
+    // interleaved to hide memory latency. Results are returned in CSR form: query i's results are
+    // items[offsets[i]] ... items[offsets[i+1]-1], in the same order overlap() gives them. return
+    // the total query cost.
+    size_t overlap_batch(const Pos* qbegs, const Pos* qends, size_t n,
+                         std::vector<size_t>& offsets, std::vector<const Item*>& items,
+                         size_t inflight = 8) const {
+        return run_batch(qbegs, qends, n, inflight, offsets, items,
+                         [this](batch_slot& s) { scan_push(s.scan, root, root_level, s.cost); },
+                         [](batch_slot&) { assert(false); });
+    }
+
+    // Join with another index over the same Pos type (e.g. an iit with an iitii, or with another
+    // index of this type), like bedtools intersect: call f(const Item& a, const OtherItem& b) on
+    // each pair of overlapping items, a from this index and b from other. Rather than querying one
+    // index for each item of the other, a single sweep merges the two sorted node arrays, keeping
+    // a short list of the active items of each, so the cost is linear in the sizes of the two
+    // indexes plus the number of pairs (so when other is much smaller than this index, querying
+    // for each of its items may be faster). Pairs are reported in ascending order of the later of
+    // their two begin positions. If f returns bool, then returning false stops the join.
+    //
+    // With threads > 1, the position range is split into slices holding equal numbers of this
+    // index's items, which are swept concurrently, each seeded with the items overlapping its
+    // start by a top-down scan; then f must be safe to call concurrently, and the pairs are only
+    // ordered within each slice. return the number of pairs reported.
+    template<typename OItem, class ONode, template<class> class ONodeArray, unsigned OTopLevels, unsigned OLeafLevel, class F>
+    size_t join(const iit_base<Pos, OItem, ONode, ONodeArray, OTopLevels, OLeafLevel>& other, F&& f,
+                unsigned threads = 1) const {
+        if (nodes.empty() || other.nodes.empty()) {
+            return 0;
+        }
+        // slices of at least 64Ki items each, starting at the begin positions of evenly spaced
+        // ranks of this index
+        const size_t slices = std::max(size_t(1), std::min(size_t(std::max(threads, 1U)),
+                                                           (nodes.size() + other.nodes.size()) >> 16));
+        std::vector<Pos> los(slices);
+        std::vector<Rank> ras(slices+1, nodes.size()), rbs(slices+1, other.nodes.size());
+        ras[0] = rbs[0] = 0;
+        for (size_t c = 1; c < slices; ++c) {
+            los[c] = nodes[nodes.size()*c/slices].beg();
+            ras[c] = lower_rank(los[c]);
+            rbs[c] = other.lower_rank(los[c]);
+        }
+        std::vector<size_t> pairs(slices, 0);
+        std::atomic<bool> stop(false);
+        iit_parallel_for(slices, threads, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                if (!join_sweep(other, ras[c], ras[c+1], rbs[c], rbs[c+1], c > 0, los[c], f, pairs[c], stop)) {
+                    return;
+                }
+            }
+        });
+        size_t ans = 0;
+        for (size_t p : pairs) {
+            ans += p;
+        }
+        return ans;
+    }
+
+    // Coverage of [beg, end) in consecutive windows of the given length (the last one possibly
+    // shorter): fill out with one iit_coverage_window for each, giving its item count & depth
+    // (window = 1 gives the depth of each position). Instead of a query per window, one sweep
+    // over the nodes in begin order tracks the active items' ends in a min-heap, reading the
+    // node array sequentially, with cost linear in the number of items & windows in the range.
+    // With threads > 1, the range is split into slices of equal item counts, swept concurrently.
+    // return the number of nodes visited.
+    size_t coverage(Pos beg, Pos end, Pos window, std::vector<iit_coverage_window<Pos>>& out,
+                    unsigned threads = 1) const {
+        if (!(window > 0)) {
+            throw std::runtime_error("iit coverage: window must be positive");
+        }
+        out.clear();
+        if (!(beg < end)) {
+            return 0;
+        }
+        size_t nwin;
+        if constexpr (std::is_integral<Pos>::value) {
+            nwin = size_t((end - beg - 1)/window) + 1;
+        } else {
+            nwin = size_t(std::ceil((end - beg)/window));
+            while (nwin > 1 && !(Pos(beg + Pos(nwin-1)*window) < end)) {
+                --nwin;
+            }
+        }
+        out.resize(nwin);
+        const auto bounds = window_slices(threads, nwin, [&](Pos pos) {
+            return pos <= beg ? size_t(0) : pos >= end ? nwin : size_t((pos - beg)/window);
+        });
+        std::vector<size_t> costs(bounds.size()-1, 0);
+        iit_parallel_for(costs.size(), threads, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                costs[c] = coverage_sweep(beg, end, window, bounds[c], bounds[c+1], out.data());
+            }
+        });
+        size_t ans = 0;
+        for (size_t c : costs) {
+            ans += c;
+        }
+        return ans;
+    }
+
+    // Windowed aggregation: for each window [windows[w].first, windows[w].second), call
+    // reduce(Acc& out[w], const Item&) on every item overlapping it (as overlap() finds them, but in
+    // no particular order), after out is resized to hold a value-initialized Acc per window. The
+    // windows must be sorted by begin, with nondecreasing ends (e.g. non-overlapping), and are
+    // answered by one sweep as with coverage(), skipping the stretches between windows by
+    // top-down scans. With threads > 1, reduce is called concurrently, but only on distinct
+    // windows. return the number of nodes visited.
+    template<class Acc, class Reduce>
+    size_t aggregate(const std::vector<std::pair<Pos, Pos>>& windows, std::vector<Acc>& out,
+                     Reduce reduce, unsigned threads = 1) const {
+        for (size_t w = 1; w < windows.size(); ++w) {
+            if (windows[w].first < windows[w-1].first || windows[w].second < windows[w-1].second) {
+                throw std::runtime_error("iit aggregate: windows must be sorted");
+            }
+        }
+        out.assign(windows.size(), Acc());
+        const auto bounds = window_slices(threads, windows.size(), [&](Pos pos) {
+            return size_t(std::lower_bound(windows.begin(), windows.end(), pos,
+                                           [](const std::pair<Pos, Pos>& wnd, Pos p) { return wnd.first < p; })
+                          - windows.begin());
+        });
+        std::vector<size_t> costs(bounds.size()-1, 0);
+        iit_parallel_for(costs.size(), threads, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                costs[c] = aggregate_sweep(windows.data(), bounds[c], bounds[c+1], out.data(), reduce);
+            }
+        });
+        size_t ans = 0;
+        for (size_t c : costs) {
+            ans += c;
+        }
+        return ans;
+    }
+};
+
+// Wrapper for std::sort; the sorting algorithm can be customized by providing a different function
+// to the builder constructor.
+template<class NodeArray>
+void iit_sort(NodeArray& vec) {
+    std::sort(vec.begin(), vec.end());
+}
+
+// Merge the sorted runs vec[bounds[i], bounds[i+1]) (bounds running from 0 to vec.size()) by
+// merging adjacent pairs of runs, concurrently, until one remains.
+template<class NodeArray, class Compare = std::less<>>
+void iit_merge_runs(NodeArray& vec, std::vector<size_t> bounds, unsigned threads, Compare less = Compare()) {
+    const size_t n = vec.size();
+    auto it = vec.begin();
+    while (bounds.size() > 2) {
+        const size_t pairs = (bounds.size()-1)/2;
+        iit_parallel_for(pairs, threads, 1, [&](size_t lo, size_t hi) {
+            for (size_t p = lo; p < hi; ++p) {
+                std::inplace_merge(it + bounds[2*p], it + bounds[2*p+1], it + bounds[2*p+2], less);
+            }
+        });
+        std::vector<size_t> merged;
+        for (size_t b = 0; b < bounds.size(); b += 2) {
+            merged.push_back(bounds[b]);
+        }
+        if (merged.back() != n) {
+            merged.push_back(n);
+        }
+        bounds = std::move(merged);
+    }
+}
+
+// Parallel version of iit_sort, which the builder uses in place of the default when given more
+// than one thread: sort contiguous chunks concurrently, then merge them with iit_merge_runs.
+template<class NodeArray, class Compare = std::less<>>
+void iit_parallel_sort(NodeArray& vec, unsigned threads, Compare less = Compare()) {
+    const size_t n = vec.size(), grain = 65536;
+    size_t chunks = std::min(size_t(std::max(threads, 1U)), std::max(n/grain, size_t(1)));
+    if (chunks <= 1) {
+        std::sort(vec.begin(), vec.end(), less);
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (size_t c = 0; c <= chunks; ++c) {
+        bounds.push_back(n*c/chunks);
+    }
+    auto it = vec.begin();
+    iit_parallel_for(chunks, chunks, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            std::sort(it + bounds[c], it + bounds[c+1], less);
+        }
+    });
+    iit_merge_runs(vec, bounds, threads, less);
+}
+
+// template for the builder class exposed by each user-facing class, which takes in items either
+// all at once from InputIterator, or streaming one-by-one
+template<class iitT, typename Item, class Node, template<class> class NodeArray>
+class iit_builder_base {
+    NodeArray<Node> nodes_;
+    std::function<void(NodeArray<Node>&)> sort_;
+    bool default_sort_;
+    unsigned threads_ = 1;
+
+public:
+    iit_builder_base(void sort(NodeArray<Node>&) = iit_sort<NodeArray<Node>>)
+        : sort_(sort)
+        , default_sort_(sort == iit_sort<NodeArray<Node>>)
+        {}
+
+    template<typename InputIterator>
+    iit_builder_base(InputIterator begin, InputIterator end, void sort(NodeArray<Node>&) = iit_sort<NodeArray<Node>>) 
+        : sort_(sort)
+        , default_sort_(sort == iit_sort<NodeArray<Node>>) {
+        add(begin, end);
+    }
+
+    // Set the number of threads build() may use for sorting (unless a custom sort function was
+    // given), indexing and model training. The resulting index answers queries identically for
+    // any thread count (only the order of items with equal begin & end positions may differ).
+    iit_builder_base& threads(unsigned n) {
+        threads_ = std::max(n, 1U);
+        return *this;
+    }
+
+    void add(const Item& it) {
+        nodes_.push_back(Node(it));
+    }
+
+    void add(Item&& it) {
+        nodes_.push_back(Node(std::move(it)));
+    }
+
+    // construct an Item in place from args
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        nodes_.push_back(Node(Item(std::forward<Args>(args)...)));
+    }
+
+    // add the items in [begin, end), moving them if given move iterators
+    template<typename InputIterator>
+    void add(InputIterator begin, InputIterator end) {
+        if constexpr (std::is_base_of<std::forward_iterator_tag,
+                      typename std::iterator_traits<InputIterator>::iterator_category>::value) {
+            reserve(nodes_.size() + std::distance(begin, end));
+        }
+        for (; begin != end; ++begin) {
+            add(*begin);
+        }
+    }
+
+    void reserve(size_t n) {
+        nodes_.reserve(n);
+    }
+
+    template<typename... Args>
+    iitT build(Args&&... args) {
+        if (default_sort_ && threads_ > 1) {
+            iit_parallel_sort(nodes_, threads_);
+        } else {
+            sort_(nodes_);
+        }
+        return iitT(nodes_, threads_, std::forward<Args>(args)...);
+    }
+
+    // build() for items added in (mostly) sorted order, e.g. from a coordinate-sorted file. One
+    // linear pass finds the sorted runs; if there are at most max_runs, they're merged with
+    // iit_merge_runs instead of sorting (otherwise, it sorts as build() would).
+    static const size_t max_runs = 64;
+    template<typename... Args>
+    iitT build_presorted(Args&&... args) {
+        std::vector<size_t> bounds(1, 0);
+        for (size_t i = 1; i < nodes_.size() && bounds.size() <= max_runs; ++i) {
+            if (nodes_[i] < nodes_[i-1]) {
+                bounds.push_back(i);
+            }
+        }
+        if (bounds.size() > max_runs) {
+            return build(std::forward<Args>(args)...);
+        }
+        bounds.push_back(nodes_.size());
+        iit_merge_runs(nodes_, bounds, threads_);
+        return iitT(nodes_, threads_, std::forward<Args>(args)...);
+    }
+};
+
+// Basic implicit interval tree (a reimplementation of cgranges)
+// The optional fifth template parameter can substitute a different NodeArray implementation, and
+// the sixth selects the node Layout (iit_aos or iit_soa).
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector, class Layout = iit_aos>
+class iit : public iit_base<Pos, Item, typename Layout::template node<Pos, Item, get_beg, get_end>, NodeArray, Layout::top_levels, Layout::template leaf_level<Pos>> {
+    using Node = typename Layout::template node<Pos, Item, get_beg, get_end>;
+    using BuildNode = typename Node::build_node;
+
+    iit(NodeArray<BuildNode>& nodes_, unsigned threads)
+        : iit_base<Pos, Item, Node, NodeArray, Layout::top_levels, Layout::template leaf_level<Pos>>(nodes_, threads)
+        {}
+    iit() = default;
+
+    static iit load_(const std::string& filename, bool zero_copy) {
+        iit ans;
+        std::shared_ptr<const iit_file_mapping> m;
+        if (ans.read_file(filename, zero_copy, m).has_model) {
+            throw std::runtime_error(filename + " holds a different type of index");
+        }
+        return ans;
+    }
+
+public:
+    // save the index to a file, which load() or load_mmap() can read back. Requires trivially
+    // copyable Pos & Item.
+    void save(const std::string& filename) const {
+        iit_file_header hdr;
+        this->write_file(filename, hdr);
+    }
+
+    // load an index saved by save(), copying it into memory
+    static iit load(const std::string& filename) {
+        return load_(filename, false);
+    }
+
+    // load an index saved by save() by mapping the file into memory, without copying: the index
+    // is read-only and its pages are shared with other processes mapping the same file. Requires
+    // NodeArray = iit_mapped_array.
+    static iit load_mmap(const std::string& filename) {
+        static_assert(iit_is_mapped_array<NodeArray<Node>>::value, "load_mmap requires NodeArray = iit_mapped_array");
+        return load_(filename, true);
+    }
+
+    using builder = iit_builder_base<iit<Pos, Item, get_beg, get_end, NodeArray, Layout>, Item, BuildNode, NodeArray>;
+    friend builder;    
+    template<typename P, typename I, P gb(const I&), P ge(const I&), class S, class L, class U>
+    friend class iitii_updatable;
+    template<typename P, typename I, P gb(const I&), P ge(const I&), template<class> class A, class S, class L>
+    friend class iitii_sharded;
+};
+
+
+// iitii-specialized node type, extending either iit_node_base or iit_key_node
+template<typename Pos, typename Item, class Base>
+struct iitii_node : public Base {
+    typedef typename std::conditional<Base::has_item, iitii_node<Pos, Item, Base>,
+                                      typename Base::build_node>::type build_node;
+    static const bool has_outside_max_end = true;
+
+    // Additional augment value for iitii nodes, which helps us prove when we can stop climbing in
+    // the bottom-up search for a subtree root which must contain all query results beneath it.
+    Pos outside_max_end_;
+    // outside_max_end of node n is the maximum m.end() of all nodes m outside of n & its subtree
+    //     with m.beg() < n.beg(); -infinity if there are no such nodes.
+    //
+    // Furthermore,
+    // outside_min_beg of node n is the minimum m.beg() of all nodes m outside of n & its subtree
+    //     with m.beg() >= n.beg(); infinity if there are no such nodes.
+    // But we don't need to store outside_min_beg, because we can compute it in constant time using
+    // rank offsets in the beg-sorted node array.
+    //
+    // Suppose during a query for [qbeg, qend) we climb up to a node n with,
+    //   (i) n.outside_max_end <= qbeg; AND
+    //  (ii) qend <= n.outside_min_beg
+    // By (i), any node outside n & subtree with beg < n's cannot overlap the query. By (ii), any
+    // node outside n & subtree with beg >= n's cannot overlap the query. This exhausts all nodes
+    // outside of n & subtree, so we need not climb past n.
+
+    iitii_node(const Item& item_)
+        : Base(item_)
+        , outside_max_end_(std::numeric_limits<Pos>::min())
+        {}
+    iitii_node(Item&& item_)
+        : Base(std::move(item_))
+        , outside_max_end_(std::numeric_limits<Pos>::min())
+        {}
+    inline Pos outside_max_end() const {
+        return outside_max_end_;
+    }
+    inline void set_outside_max_end(Pos ome) {
+        outside_max_end_ = ome;
+    }
+};
+
+// iitii node extending iit_compact_node: outside_max_end is stored as a signed offset from beg,
+// rounded up where it doesn't fit (which only makes the climbs more cautious), with the extreme
+// values standing for -infinity & infinity.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), typename Offset>
+struct iitii_node<Pos, Item, iit_compact_node<Pos, Item, get_beg, get_end, Offset>>
+    : public iit_compact_node<Pos, Item, get_beg, get_end, Offset> {
+    using Base = iit_compact_node<Pos, Item, get_beg, get_end, Offset>;
+    typedef typename Base::build_node build_node;
+    static const bool has_outside_max_end = true;
+    typedef typename std::make_signed<Offset>::type SignedOffset;
+    static const SignedOffset ninf = std::numeric_limits<SignedOffset>::min(),
+                              pinf = std::numeric_limits<SignedOffset>::max();
+
+    SignedOffset outside_max_end_;
+
+    iitii_node(const Item& item_)
+        : Base(item_)
+        , outside_max_end_(ninf)
+        {}
+    inline Pos outside_max_end() const {
+        using UPos = typename Base::UPos;
+        if (outside_max_end_ == ninf) {
+            return std::numeric_limits<Pos>::min();
+        } else if (outside_max_end_ == pinf) {
+            return std::numeric_limits<Pos>::max();
+        }
+        return outside_max_end_ >= 0 ? Pos(UPos(Base::beg_) + UPos(outside_max_end_))
+                                     : Pos(UPos(Base::beg_) - UPos(-outside_max_end_));
+    }
+    inline void set_outside_max_end(Pos ome) {
+        using UPos = typename Base::UPos;
+        const Pos beg = Base::beg_;
+        if (ome == std::numeric_limits<Pos>::min()) {
+            outside_max_end_ = ninf;
+        } else if (ome >= beg) {
+            const UPos ofs = UPos(ome) - UPos(beg);
+            outside_max_end_ = ofs < UPos(pinf) ? SignedOffset(ofs) : pinf;
+        } else {
+            // round up to the furthest representable position below beg
+            const UPos ofs = std::min(UPos(beg) - UPos(ome), UPos(pinf));
+            outside_max_end_ = SignedOffset(-SignedOffset(ofs));
+        }
+    }
+};
+
+// simple linear regression of y ~ x, accumulated one point at a time (Welford's updates of the
+// means & co-moments, so no points need be kept)
+struct iit_regression {
+    size_t n = 0;
+    double mean_x = 0.0, mean_y = 0.0, cov = 0.0, var = 0.0;
+
+    void add(double x, double y) {
+        ++n;
+        const double dx = x - mean_x;
+        mean_x += dx/n;
+        mean_y += (y - mean_y)/n;
+        cov += dx*(y - mean_y);
+        var += dx*(x - mean_x);
+    }
+
+    // (intercept, slope), or (0, 0) given fewer than two distinct x
+    std::pair<double,double> fit() const {
+        if (n <= 1 || var == 0.0) {
+            return std::make_pair(0.0, 0.0);
+        }
+        const double m = cov / var;
+        return std::make_pair(mean_y - m*mean_x, m);
+    }
+};
+
+// simple linear regression of y ~ x given points [(x,y)], returning (intercept, slope)
+template<typename XT, typename YT>
+std::pair<double,double> regress(const std::vector<std::pair<XT,YT>>& points) {
+    iit_regression reg;
+    for (const auto& pt : points) {
+        reg.add(double(pt.first), double(pt.second));
+    }
+    return reg.fit();
+}
+
+// Query statistics policies, selected by the Stats template parameter of iitii. Each provides
+//     void record(size_t climb_cost) const    called once for each query
+//     size_t queries() const                  number of queries recorded
+//     size_t total_climb_cost() const         sum of climb_cost over them
+// The default iitii_stats_none records nothing, so the query path writes no shared memory at all
+// and concurrent queries on a shared index are safe (as with iit).
+struct iitii_stats_none {
+    static const bool histograms = false;   // see iitii_stats_histograms
+    inline void record(size_t) const {}
+    size_t queries() const { return 0; }
+    size_t total_climb_cost() const { return 0; }
+};
+
+// relaxed atomic counters, padded to their own cache line so they don't false-share with the
+// index itself. Correct under concurrency, but every query bounces that cache line between cores.
+class alignas(64) iitii_stats_atomic {
+    mutable std::atomic<size_t> queries_{0}, total_climb_cost_{0};
+
+public:
+    static const bool histograms = false;
+    iitii_stats_atomic() = default;
+    iitii_stats_atomic(const iitii_stats_atomic& rhs)
+        : queries_(rhs.queries())
+        , total_climb_cost_(rhs.total_climb_cost())
+        {}
+    iitii_stats_atomic& operator=(const iitii_stats_atomic& rhs) {
+        queries_.store(rhs.queries(), std::memory_order_relaxed);
+        total_climb_cost_.store(rhs.total_climb_cost(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    inline void record(size_t climb_cost) const {
+        queries_.fetch_add(1, std::memory_order_relaxed);
+        total_climb_cost_.fetch_add(climb_cost, std::memory_order_relaxed);
+    }
+    size_t queries() const { return queries_.load(std::memory_order_relaxed); }
+    size_t total_climb_cost() const { return total_climb_cost_.load(std::memory_order_relaxed); }
+};
+
+// per-thread sharded counters: each thread is assigned one of SHARDS cache lines, which it updates
+// without any atomic read-modify-write, and the readers sum over all shards. Exact as long as
+// there are at most SHARDS concurrent query threads; beyond that, colliding threads may
+// occasionally lose an update (but it's still free of data races).
+class iitii_stats_sharded {
+    static const size_t SHARDS = 64;
+    struct alignas(64) shard {
+        std::atomic<size_t> queries{0}, total_climb_cost{0};
+    };
+    std::unique_ptr<shard[]> shards_;
+
+    static size_t my_shard() {
+        static std::atomic<size_t> next_shard{0};
+        thread_local const size_t mine = next_shard.fetch_add(1, std::memory_order_relaxed);
+        return mine % SHARDS;
+    }
+
+    template<class F>
+    size_t sum(F f) const {
+        size_t ans = 0;
+        for (size_t i = 0; i < SHARDS; ++i) {
+            ans += f(shards_[i]).load(std::memory_order_relaxed);
+        }
+        return ans;
+    }
+
+public:
+    static const bool histograms = false;
+
+    iitii_stats_sharded()
+        : shards_(new shard[SHARDS])
+        {}
+    iitii_stats_sharded(const iitii_stats_sharded& rhs)
+        : iitii_stats_sharded() {
+        *this = rhs;
+    }
+    iitii_stats_sharded& operator=(const iitii_stats_sharded& rhs) {
+        for (size_t i = 0; i < SHARDS; ++i) {
+            shards_[i].queries.store(rhs.shards_[i].queries.load(std::memory_order_relaxed),
+                                     std::memory_order_relaxed);
+            shards_[i].total_climb_cost.store(
+                rhs.shards_[i].total_climb_cost.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+        }
+        return *this;
+    }
+
+    inline void record(size_t climb_cost) const {
+        shard& s = shards_[my_shard()];
+        s.queries.store(s.queries.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s.total_climb_cost.store(s.total_climb_cost.load(std::memory_order_relaxed) + climb_cost,
+                                 std::memory_order_relaxed);
+    }
+    size_t queries() const {
+        return sum([](const shard& s) -> const std::atomic<size_t>& { return s.queries; });
+    }
+    size_t total_climb_cost() const {
+        return sum([](const shard& s) -> const std::atomic<size_t>& { return s.total_climb_cost; });
+    }
+};
+
+// write a value for iitii_write_tsv/iitii_write_json, integers without an exponent
+inline void iitii_write_value(std::ostream& out, double value) {
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        out << (long long)value;
+    } else {
+        out << value;
+    }
+}
+
+// write a TSV header & row or a JSON object for each of rows, with the columns given by
+// fields(row, f), which calls f(name, value) for each
+template<class Row, class Fields>
+void iitii_write_tsv(std::ostream& out, const std::vector<Row>& rows, Fields fields) {
+    bool first = true;
+    fields(Row(), [&](const char* name, double) {
+        out << (first ? "" : "\t") << name;
+        first = false;
+    });
+    out << '\n';
+    for (const Row& row : rows) {
+        first = true;
+        fields(row, [&](const char*, double value) {
+            out << (first ? "" : "\t");
+            iitii_write_value(out, value);
+            first = false;
+        });
+        out << '\n';
+    }
+}
+template<class Row, class Fields>
+void iitii_write_json(std::ostream& out, const std::vector<Row>& rows, Fields fields) {
+    out << '[';
+    for (size_t i = 0; i < rows.size(); ++i) {
+        bool first = true;
+        out << (i ? ",{" : "{");
+        fields(rows[i], [&](const char* name, double value) {
+            out << (first ? "\"" : ",\"") << name << "\":";
+            if (std::isfinite(value)) {
+                iitii_write_value(out, value);
+            } else {
+                out << "null";
+            }
+            first = false;
+        });
+        out << '}';
+    }
+    out << ']';
+}
+
+// histogram of size_t values in power-of-two buckets: bucket 0 counts zeroes, and bucket b > 0
+// counts the values in [2^(b-1), 2^b)
+struct iitii_histogram {
+    static const size_t BUCKETS = 8*sizeof(size_t)+1;
+    size_t counts[BUCKETS] = {};
+
+    static inline size_t bucket(size_t x) {
+        return x ? 8*sizeof(unsigned long long) - __builtin_clzll(x) : 0;
+    }
+    static size_t bucket_min(size_t b) {
+        return b ? size_t(1) << (b-1) : 0;
+    }
+    size_t total() const {
+        size_t ans = 0;
+        for (size_t c : counts) {
+            ans += c;
+        }
+        return ans;
+    }
+};
+
+// the histograms collected by iitii_stats_histograms, per query:
+//   climb_depth      : levels climbed from the model's prediction
+//   prediction_error : distance in ranks between the prediction and qbeg's place in the nodes
+//   nodes_scanned    : query cost of the top-down scan from the climb's subtree root
+//   results          : number of results
+// Queries with no prediction (in a domain which falls back to searching from the root) are
+// counted only in nodes_scanned & results.
+struct iitii_query_histograms {
+    iitii_histogram climb_depth, prediction_error, nodes_scanned, results;
+
+    struct row {
+        size_t bucket_min, climb_depth, prediction_error, nodes_scanned, results;
+    };
+    std::vector<row> rows() const {
+        std::vector<row> ans;
+        for (size_t b = 0; b < iitii_histogram::BUCKETS; ++b) {
+            if (climb_depth.counts[b] || prediction_error.counts[b] || nodes_scanned.counts[b] || results.counts[b]) {
+                ans.push_back({iitii_histogram::bucket_min(b), climb_depth.counts[b], prediction_error.counts[b],
+                               nodes_scanned.counts[b], results.counts[b]});
+            }
+        }
+        return ans;
+    }
+    template<class F>
+    static void fields(const row& r, F f) {
+        f("bucket_min", r.bucket_min);
+        f("climb_depth", r.climb_depth);
+        f("prediction_error", r.prediction_error);
+        f("nodes_scanned", r.nodes_scanned);
+        f("results", r.results);
+    }
+    // one row per nonempty bucket, with the count of each histogram
+    void write_tsv(std::ostream& out) const {
+        iitii_write_tsv(out, rows(), [](const row& r, auto f) { fields(r, f); });
+    }
+    void write_json(std::ostream& out) const {
+        iitii_write_json(out, rows(), [](const row& r, auto f) { fields(r, f); });
+    }
+};
+
+// opt-in query instrumentation: the counters of iitii_stats_sharded plus iitii_query_histograms,
+// in per-thread shards likewise. Queries through overlap(), overlap_visit(), overlap_count() and
+// overlap_any() are counted in full, while overlap_batch() and overlap_range() record only the
+// climb (as with the other policies). Collecting the prediction errors costs each query a binary
+// search, so this is for diagnosis rather than production.
+class iitii_stats_histograms {
+    static const size_t SHARDS = 64;
+    struct alignas(64) shard {
+        std::atomic<size_t> queries{0}, total_climb_cost{0};
+        std::atomic<size_t> hist[4][iitii_histogram::BUCKETS];
+        shard() {
+            for (auto& h : hist) {
+                for (auto& c : h) {
+                    c.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+    std::unique_ptr<shard[]> shards_;
+
+    static size_t my_shard() {
+        static std::atomic<size_t> next_shard{0};
+        thread_local const size_t mine = next_shard.fetch_add(1, std::memory_order_relaxed);
+        return mine % SHARDS;
+    }
+
+    static inline void bump(std::atomic<size_t>& c, size_t x) {
+        c.store(c.load(std::memory_order_relaxed) + x, std::memory_order_relaxed);
+    }
+
+public:
+    static const bool histograms = true;
+
+    iitii_stats_histograms()
+        : shards_(new shard[SHARDS])
+        {}
+    iitii_stats_histograms(const iitii_stats_histograms& rhs)
+        : iitii_stats_histograms() {
+        *this = rhs;
+    }
+    iitii_stats_histograms& operator=(const iitii_stats_histograms& rhs) {
+        for (size_t i = 0; i < SHARDS; ++i) {
+            shard& s = shards_[i];
+            const shard& t = rhs.shards_[i];
+            s.queries.store(t.queries.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            s.total_climb_cost.store(t.total_climb_cost.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            for (size_t h = 0; h < 4; ++h) {
+                for (size_t b = 0; b < iitii_histogram::BUCKETS; ++b) {
+                    s.hist[h][b].store(t.hist[h][b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+            }
+        }
+        return *this;
+    }
+
+    inline void record(size_t climb_cost) const {
+        shard& s = shards_[my_shard()];
+        bump(s.queries, 1);
+        bump(s.total_climb_cost, climb_cost);
+        bump(s.hist[0][iitii_histogram::bucket(climb_cost)], 1);
+    }
+    // prediction_error is size_t(-1) for a query with no prediction
+    inline void record_scan(size_t prediction_error, size_t nodes_scanned, size_t results) const {
+        shard& s = shards_[my_shard()];
+        if (prediction_error != size_t(-1)) {
+            bump(s.hist[1][iitii_histogram::bucket(prediction_error)], 1);
+        }
+        bump(s.hist[2][iitii_histogram::bucket(nodes_scanned)], 1);
+        bump(s.hist[3][iitii_histogram::bucket(results)], 1);
+    }
+
+    size_t queries() const {
+        size_t ans = 0;
+        for (size_t i = 0; i < SHARDS; ++i) {
+            ans += shards_[i].queries.load(std::memory_order_relaxed);
+        }
+        return ans;
+    }
+    size_t total_climb_cost() const {
+        size_t ans = 0;
+        for (size_t i = 0; i < SHARDS; ++i) {
+            ans += shards_[i].total_climb_cost.load(std::memory_order_relaxed);
+        }
+        return ans;
+    }
+    iitii_query_histograms histograms_snapshot() const {
+        iitii_query_histograms ans;
+        iitii_histogram* hs[4] = { &ans.climb_depth, &ans.prediction_error, &ans.nodes_scanned, &ans.results };
+        for (size_t i = 0; i < SHARDS; ++i) {
+            for (size_t h = 0; h < 4; ++h) {
+                for (size_t b = 0; b < iitii_histogram::BUCKETS; ++b) {
+                    hs[h]->counts[b] += shards_[i].hist[h][b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        return ans;
+    }
+};
+
+// Statistics policy forwarding to a Stats object shared by several indexes, as iitii_genome does
+// for its contigs, so that they keep one set of counters (or shards) between them rather than one
+// each. It records nothing until attached to a Stats object, which must outlive it.
+template<class Stats>
+class iitii_stats_shared {
+    const Stats* stats_ = nullptr;
+
+public:
+    static const bool histograms = Stats::histograms;
+
+    iitii_stats_shared() = default;
+    explicit iitii_stats_shared(const Stats& stats)
+        : stats_(&stats)
+        {}
+
+    inline void record(size_t climb_cost) const {
+        if (stats_) {
+            stats_->record(climb_cost);
+        }
+    }
+    inline void record_scan(size_t prediction_error, size_t nodes_scanned, size_t results) const {
+        if (stats_) {
+            stats_->record_scan(prediction_error, nodes_scanned, results);
+        }
+    }
+    size_t queries() const { return stats_ ? stats_->queries() : 0; }
+    size_t total_climb_cost() const { return stats_ ? stats_->total_climb_cost() : 0; }
+    iitii_query_histograms histograms_snapshot() const {
+        return stats_ ? stats_->histograms_snapshot() : iitii_query_histograms();
+    }
+};
+
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), size_t get_rid(const Item&), class Stats = iitii_stats_none, class Layout = iit_aos>
+class iitii_genome;
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector, class Stats = iitii_stats_none, class Layout = iit_aos>
+class iitii_sharded;
+
+// How iitii partitions the position range into model domains: into equal-width slices (the
+// original scheme), or so that each domain holds about the same number of items, which fits the
+// models much better where the density of the items varies widely.
+enum class iitii_partition { equal_width, equal_count };
+
+// Options for training the model of each domain, which may be passed to iitii::builder::build()
+// after the domain count & partition. For each candidate level, the regression takes one pass over
+// the domain's nodes on that level, and then the search cost is estimated at the domain's nodes:
+// by default all of them, or else a stratified sample of cost_sample nodes (one drawn from each of
+// cost_sample equal rank ranges), so that training takes time independent of the item count. With
+// early_stop, the levels are abandoned once the cost estimate rises from one to the next (it's
+// usually U-shaped, falling as the prediction errors shrink until the climbing dominates).
+struct iitii_train_options {
+    size_t cost_sample = 0;     // 0 for all
+    bool early_stop = false;
+};
+
+// Passing iitii_auto_domains to iitii::builder::build() in place of the domain count selects the
+// number of domains & the partition automatically: the model is trained for 1, 4, 16, 64, ...
+// domains with each partition, and the configuration with the lowest predicted search cost is
+// kept, as reported by iitii::model_summary(). The cost is train()'s per-domain estimate averaged
+// over all the items. This estimate is in-sample, so more domains always seem at least as good;
+// hence the candidates are limited to at least min_domain_items items per domain on average, and
+// a bigger model is only chosen if it improves the predicted cost by more than the relative
+// tolerance. Each candidate costs about one train() pass over the items.
+struct iitii_auto_domains {
+    size_t max_model_bytes = 256*1024;  // bound on the model parameters & domain boundaries
+    size_t min_domain_items = 64;
+    double tolerance = 0.01;
+    iitii_train_options train;
+};
+
+// Storage type of the iitii model weights for position type Pos: float, so that each domain's row
+// of three takes 12 bytes. The model measures each position as an integer offset from its domain's
+// origin, and evaluates in double, so the precision depends on neither how far along the positions
+// lie nor how wide the domain is: rounding each stored weight to float's 24-bit significand moves
+// the predictions by under one LevelRank, provided the level has fewer than 2^23 nodes. (train()
+// evaluates the rounded weights, so its cost estimates include any such loss.) May be specialized,
+// e.g. to double, to trade model size for precision.
+template<typename Pos>
+struct iitii_model_traits {
+    typedef float weight;
+};
+
+// Compile-time tuning of iitii, its optional eighth template parameter. To specialize an index's
+// hot path for a deployment, derive a struct from iitii_tuning overriding any of:
+//   weight<Pos> : storage type of the model weights (see iitii_model_traits); saved indexes
+//                 load only with the same type
+//   pow2_domains : round the width of equal_width domains up to a power of two, so that finding
+//                  a query's domain is a shift instead of a division (the positions then fill
+//                  between half and all of the domains; so consider doubling the domain count)
+//   train_levels : tree levels at which train() evaluates the model fit, ascending (default a
+//                  Fibonacci-ish series)
+//   climb_cost_factor : weight of each level climbed in the query cost reported by overlap()
+//                  (default 3, since each level's outside_max_end lookup may incur two additional
+//                  cache misses); used only for reporting & not by the queries themselves
+// e.g. struct my_tuning : iitii_tuning { static constexpr bool pow2_domains = true; };
+struct iitii_tuning {
+    template<typename Pos>
+    using weight = typename iitii_model_traits<Pos>::weight;
+    static constexpr bool pow2_domains = false;
+    static constexpr unsigned train_levels[] = {0, 1, 2, 4, 7, 12, 20, 33, 54};
+    static constexpr size_t climb_cost_factor = 3;
+};
+
+// iitii model configuration reported by iitii::model_summary()
+struct iitii_model_summary {
+    size_t domains;
+    iitii_partition partition;
+    double predicted_cost;  // train()'s estimate of the average cost to find the subtree to scan
+    size_t model_bytes;
+};
+
+// per-domain diagnostics of the iitii model, reported by iitii::model_report(). level is -1 for
+// a domain which falls back to searching from the root (then w0 & w1 are meaningless). The
+// expected_cost is train()'s estimate (saved with the index).
+struct iitii_domain_info {
+    size_t domain = 0;
+    double origin = 0;      // lowest position in the domain (converted from Pos)
+    size_t items = 0;
+    int level = -1;
+    double w0 = 0, w1 = 0;  // LevelRank ~ w0 + w1*(beg - origin)
+    double expected_cost = 0;
+
+    template<class F>
+    static void fields(const iitii_domain_info& d, F f) {
+        f("domain", d.domain);
+        f("origin", d.origin);
+        f("items", d.items);
+        f("level", d.level);
+        f("w0", d.w0);
+        f("w1", d.w1);
+        f("expected_cost", d.expected_cost);
+    }
+};
+
+struct iitii_model_report {
+    std::vector<iitii_domain_info> domains;
+    size_t root_domains = 0;    // number of domains with level -1
+
+    // one row per domain
+    void write_tsv(std::ostream& out) const {
+        iitii_write_tsv(out, domains, [](const iitii_domain_info& d, auto f) { iitii_domain_info::fields(d, f); });
+    }
+    // {"root_domains": n, "domains": [...]}
+    void write_json(std::ostream& out) const {
+        out << "{\"root_domains\":" << root_domains << ",\"domains\":";
+        iitii_write_json(out, domains, [](const iitii_domain_info& d, auto f) { iitii_domain_info::fields(d, f); });
+        out << '}';
+    }
+};
+
+// here it is
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector, class Stats = iitii_stats_none, class Layout = iit_aos, class Tuning = iitii_tuning>
+class iitii : public iit_base<Pos, Item, iitii_node<Pos, Item, typename Layout::template node<Pos, Item, get_beg, get_end>>, NodeArray, Layout::top_levels, Layout::template leaf_level<Pos>> {
+    using Node = iitii_node<Pos, Item, typename Layout::template node<Pos, Item, get_beg, get_end>>;
+    using BuildNode = typename Node::build_node;
+    using super = iit_base<Pos, Item, Node, NodeArray, Layout::top_levels, Layout::template leaf_level<Pos>>;
+    using typename super::Rank;
+    using typename super::Level;
+    using super::left;
+    using super::right;
+    using super::leftmost_leaf;
+    using super::leftmost_leaf2;
+    using super::rightmost_leaf;
+    using super::parent;
+    using super::nodes;
+    using super::full_size;
+    using super::nrank;
+    using super::level;
+    using super::root;
+    using super::root_level;
+
+    inline Pos outside_min_beg(Rank subtree, Level k) const {
+        // constant-time computation of outside_min_beg: beg() of the node ranked one higher than
+        // subtree's rightmost child
+        const Rank r = rightmost_leaf(subtree, k);
+        __builtin_prefetch(&(nodes[r+1]));
+        const Pos beg = super::key_beg(subtree, k);
+        const Rank l = leftmost_leaf(subtree, k);
+        if (l && nodes[l-1].beg() == beg) {
+            // corner case: nodes to the left of the subtree can have the same beg as subroot
+            // and outside_min_beg is defined on nodes with beg >= subroot's.
+            return beg;
+        }
+        return r < nodes.size()-1 ? nodes[r+1].beg() : std::numeric_limits<Pos>::max();
+    }
+
+    // should the bottom-up climb for [qbeg,qend) continue past subtree?
+    inline bool climb_further(Rank subtree, Level k, Pos qbeg, Pos qend) const {
+        return subtree != root &&                           // stop at root
+                (subtree >= nodes.size() ||                 // continue climb through imaginary
+                 qbeg < super::key_outside_max_end(subtree, k) ||   // possible outside overlap from left
+                 outside_min_beg(subtree, k) < qend);       // possible outside overlap from right
+    }
+
+    // prefetch the nodes which climb_further() will look at for subtree
+    inline void prefetch_climb(Rank subtree, Level k) const {
+        if (subtree < nodes.size()) {
+            super::prefetch_key(subtree, k);
+            const Rank l = leftmost_leaf(subtree, k);
+            if (l) {
+                super::prefetch(l-1);
+            }
+            super::prefetch(rightmost_leaf(subtree, k)+1);
+        }
+    }
+
+    // Additional tree navigation concept, LevelRank: the rank of a node **within its level**
+    // e.g. a level-k node with LevelRank=1 is the second-lowest (second-leftmost) node on level k
+    typedef std::size_t LevelRank;
+
+    inline Rank rank_of_levelrank(Level k, LevelRank ofs) const {
+        return (size_t(1)<<k)*(2*ofs+1)-1;
+    }
+
+    inline LevelRank levelrank_of_rank(Rank r) const {
+        return ((r+1)/(size_t(1)<<level(r))-1)/2;
+    }
+
+    // Rank prediction model: the [min_beg, max_beg] range is partitioned into a number C of
+    // domains, each covering an equal-sized portion of that range. The domain pertaining to a
+    // position beg is d(beg) = floor((beg-min_beg)*C/(max_beg-min_beg)), bounded to [0,C).
+    // Alternatively (iitii_partition::equal_count), the domains hold equal numbers of nodes, and
+    // d(beg) is the number of the C-1 domain boundary positions <= beg.
+    //
+    // For each domain d, we store three parameters: a Level l[d] ∈ [0,root_level] into which we
+    // will jump, and linear weights w[d,0] and w[d,1] for the regression of LevelRank on Pos,
+    //   lr(beg) ~ w[d(beg),0] + w[d(beg),1]*(beg - o[d(beg)])
+    // where o[d] is the domain's origin (lower bound position). Measuring from the origin keeps the
+    // arithmetic precise far along large position ranges; the weights are stored as Weight (see
+    // iitii_model_traits) and evaluated in double.
+    //
+    // To start a query for qbeg, jump to the node: rank_of_levelrank(l[d(qbeg)], lr(qbeg))
+
+    typedef std::size_t Domain;
+    typedef typename Tuning::template weight<Pos> Weight;
+    static_assert(!Tuning::pow2_domains || std::is_integral<Pos>::value, "pow2_domains requires integral Pos");
+    Domain domains;               // C
+    Pos min_beg = std::numeric_limits<Pos>::max(),
+        domain_size = Node::npos;
+    unsigned domain_shift = 0;    // log2(domain_size), with Tuning::pow2_domains
+    NodeArray<Weight> parameters;   // C rows of three parameters (row-major storage): w[0,d],
+                                    // w[1,d] and l[d]. NB: the third is a Level stored as a Weight.
+    NodeArray<Pos> boundaries;      // equal_count: beg of the first node in domains 1..C-1
+                                    // (empty for equal_width)
+
+    double predicted_cost = std::numeric_limits<double>::quiet_NaN();  // estimate from train()
+    NodeArray<double> domain_costs;     // train()'s estimate for each domain
+    iitii_train_options train_options;  // (not saved)
+
+    Stats stats_;
+
+    inline Domain which_domain(Pos beg) const {
+        if (!boundaries.empty()) {
+            return iit_boundary_count(boundaries.data(), boundaries.size(), beg);
+        }
+        if (beg < min_beg) {
+            return 0;
+        }
+        if constexpr (Tuning::pow2_domains) {
+            return std::min(domains-1, Domain(typename std::make_unsigned<Pos>::type(beg-min_beg) >> domain_shift));
+        }
+        return std::min(domains-1, Domain((beg-min_beg)/domain_size));
+    }
+
+    // the position from which domain d's model measures beg positions: its lower bound
+    inline Pos domain_origin(Domain d) const {
+        if (!d) {
+            return min_beg;
+        }
+        return boundaries.empty() ? Pos(min_beg + Pos(d)*domain_size) : boundaries[d-1];
+    }
+
+    // beg relative to the domain origin, in the model's arithmetic (exact for offsets up to 2^53)
+    static inline double relative(Pos beg, Pos origin) {
+        return beg >= origin ? double(beg - origin) : -double(origin - beg);
+    }
+
+    inline Rank interpolate(Level k, Weight w0, Weight w1, double x) const {
+        // given model parameters within a domain, return the node to start searching for the
+        // position x (relative to the domain origin)
+        const double ofs_f = double(w0) + double(w1)*x;
+        assert(std::isfinite(ofs_f));
+        const Rank r = rank_of_levelrank(k, LevelRank(std::max(0.0, std::round(ofs_f))));
+        assert(r >= nodes.size() || level(r) == k);
+
+        // detail: if rank is imaginary (qbeg is off-scale high), start from rightmost real leaf
+        const auto nsz = nodes.size();
+        return r < nsz ? r : (nsz - (2 - nsz%2));
+    }
+
+    // smallest rank whose node falls in domain d or above (the nodes of each domain are a
+    // contiguous range of ranks, since which_domain() is monotone in beg)
+    Rank domain_first_rank(Domain d) const {
+        Rank lo = 0, hi = nodes.size();
+        while (lo < hi) {
+            const Rank mid = lo + (hi-lo)/2;
+            if (which_domain(nodes[mid].beg()) < d) {
+                lo = mid+1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // set up the partitioning of the nodes into domains_ model domains (untrained)
+    void partition_domains(Domain domains_, iitii_partition partition) {
+        domains = std::max(Domain(1), domains_);
+        domain_size = std::numeric_limits<Pos>::max();
+        domain_shift = 0;
+        parameters = NodeArray<Weight>();
+        parameters.resize(domains*3, Weight(-1));
+        boundaries = NodeArray<Pos>();
+
+        if (nodes.size()) {
+            // equal size (in Pos units) of each domain
+            min_beg = nodes[0].beg();
+            domain_size = 1 + (nodes[nodes.size()-1].beg()-min_beg)/domains;
+            if constexpr (Tuning::pow2_domains) {
+                // round up to a power of two (so the positions may fill only half the domains)
+                domain_shift = domain_size > 1 ? log2ull(uint64_t(domain_size-1)) + 1 : 0;
+                domain_shift = std::min(domain_shift, unsigned(std::numeric_limits<Pos>::digits - 1));
+                domain_size = Pos(1) << domain_shift;
+            }
+            if (partition == iitii_partition::equal_count && domains > 1) {
+                // domain d begins with the node ranked d*N/C. (Nodes sharing its beg position
+                // fall into the domain, so some domains may be empty if there are many such.)
+                boundaries.reserve(domains-1);
+                iit_equal_count_boundaries(nodes.size(), domains, [this](Rank r) { return nodes[r].beg(); },
+                                           boundaries);
+            }
+        }
+    }
+
+    // train the domain models, and set predicted_cost to the average of their estimated search
+    // costs over all nodes (taking root_level for the top-down search of untrained domains).
+    // Given the prior model of an index which these nodes updated, domains whose bounds & node
+    // counts are unchanged reuse its parameters (see reuse_domain) instead of retraining.
+    void train(unsigned threads, const iitii* prior = nullptr) {
+        if (prior && (prior->domains != domains || prior->root_level != root_level ||
+                      prior->boundaries.empty() != boundaries.empty())) {
+            prior = nullptr;
+        }
+        // the domain models are independent, so train them concurrently
+        domain_costs = NodeArray<double>();
+        domain_costs.resize(domains, 0.0);
+        std::vector<double> total_costs(domains, 0.0);
+        iit_parallel_for(domains, threads, 16, [&](size_t lo, size_t hi) {
+            Rank r = domain_first_rank(Domain(lo));
+            for (Domain domain = lo; domain < hi; ++domain) {
+                const Rank r_end = domain_first_rank(domain+1);
+                if (prior && reuse_domain(*prior, domain, r, r_end)) {
+                    domain_costs[domain] = prior->domain_costs.size() == domains
+                                               ? prior->domain_costs[domain] : prior->predicted_cost;
+                } else {
+                    domain_costs[domain] = train_domain(domain, r, r_end);
+                }
+                total_costs[domain] = domain_costs[domain]*(r_end-r);
+                r = r_end;
+            }
+        });
+        double total_cost = 0.0;
+        for (double c : total_costs) {
+            total_cost += c;
+        }
+        predicted_cost = nodes.size() ? total_cost/nodes.size() : 0.0;
+    }
+
+    // if domain d (the nodes ranked [rbeg, rend)) covers the same positions & number of nodes as
+    // in prior, copy its parameters, shifting the intercept by the change of its nodes' ranks.
+    // (Among nodes shifted by s ranks, level-k LevelRanks shift by ~s/2^(k+1).) Any change to
+    // min_beg or domain_size moves every equal-width origin, so that no domain is reused; see
+    // iitii_updatable.
+    bool reuse_domain(const iitii& prior, Domain d, Rank rbeg, Rank rend) {
+        if (!std::isfinite(prior.predicted_cost) ||
+                prior.domain_origin(d) != domain_origin(d) ||
+                (d+1 < domains && prior.domain_origin(d+1) != domain_origin(d+1))) {
+            return false;
+        }
+        const Rank prior_rbeg = prior.domain_first_rank(d);
+        if (prior.domain_first_rank(d+1) - prior_rbeg != rend - rbeg) {
+            return false;
+        }
+        const Weight *pp = &(prior.parameters[3*d]);
+        Weight *qq = &(parameters[3*d]);
+        qq[1] = pp[1];
+        qq[2] = pp[2];
+        qq[0] = pp[0];
+        if (pp[2] >= 0) {
+            qq[0] = Weight(double(pp[0]) + (double(rbeg) - double(prior_rbeg))/double(size_t(2) << Level(pp[2])));
+        }
+        return true;
+    }
+
+    // train the model for one domain, consisting of the nodes ranked [rbeg, rend), returning its
+    // estimated average search cost
+    double train_domain(Domain domain, Rank rbeg, Rank rend) {
+
+        // the nodes at which to estimate the search cost: all, or one pseudorandom node from each
+        // of cost_sample equal strata
+        const size_t n = rend - rbeg,
+                     samples = train_options.cost_sample ? std::min(train_options.cost_sample, n) : n;
+        auto sample = [&](size_t i) -> Rank {
+            if (samples == n) {
+                return rbeg + i;
+            }
+            const size_t lo = i*n/samples, hi = (i+1)*n/samples;
+            uint64_t h = (uint64_t(domain) << 32) ^ i;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+            return rbeg + lo + (h ^ (h >> 31)) % (hi - lo);
+        };
+
+        const Pos origin = domain_origin(domain);
+        double lowest_cost = std::numeric_limits<double>::max(), last_cost = lowest_cost;
+        for (const Level k : Tuning::train_levels) {
+            if (k >= root_level) {
+                break;
+            }
+            // regress LevelRank on position over the level-k nodes in the domain, which are
+            // every 2^(k+1)'th rank starting from 2^k-1
+            const Rank first = rank_of_levelrank(k, 0), step = size_t(2) << k;
+            iit_regression reg;
+            for (Rank r = rbeg > first ? first + (rbeg-first+step-1)/step*step : first; r < rend; r += step) {
+                reg.add(relative(nodes[r].beg(), origin), double(levelrank_of_rank(r)));
+            }
+            if (reg.n <= 1) {
+                break;
+            }
+            auto w = reg.fit();
+            if (w.second) {
+                // calculate estimate of search cost (average over the sampled domain points)
+                size_t cost = 0;
+                for (size_t i = 0; i < samples; ++i) {
+                    const Rank y = sample(i);
+                    const Pos x = nodes[y].beg();
+                    const Rank fx = interpolate(k, Weight(w.first), Weight(w.second), relative(x, origin));
+                    const size_t error = (fx>=y ? fx-y : y-fx)/(size_t(1)<<k);
+                    const size_t error_penalty = error ? 2*(1+log2ull(error)) : 0,
+                        overlap_penalty = nodes[fx].outside_max_end()>x ? 1+(root_level-k)/2 : 0;
+                    cost += k + std::max(error_penalty, overlap_penalty);
+                }
+                double avg_cost = double(cost)/samples;
+                // store parameters if cost estimate is lower than top-down search and lower
+                // than previous levels
+                if (avg_cost < root_level && avg_cost < lowest_cost) {
+                    lowest_cost = avg_cost;
+                    Weight *pp = &(parameters[3*domain]);
+                    pp[0] = Weight(w.first);
+                    pp[1] = Weight(w.second);
+                    pp[2] = Weight(k);
+                }
+                if (train_options.early_stop && avg_cost > last_cost) {
+                    break;
+                }
+                last_cost = avg_cost;
+            }
+        }
+        return std::min(lowest_cost, double(root_level));
+    }
+
+    // Given qbeg, select domain and predict search start node
+    Rank predict(Pos qbeg) const {
+        auto which = which_domain(qbeg);
+        assert(which < domains);
+        const Weight *pp = &(parameters[3*which]);
+
+        const Weight lv_f = pp[2];
+        if (lv_f < 0) {
+            return nrank;
+        }
+        assert(lv_f >= 0 && lv_f <= root_level);
+        const Level k = Level(lv_f);
+
+        return interpolate(k, pp[0], pp[1], relative(qbeg, domain_origin(which)));
+    }
+
+    iitii()
+        : domains(1)
+        {}
+
+    static iitii load_(const std::string& filename, bool zero_copy) {
+        iitii ans;
+        std::shared_ptr<const iit_file_mapping> m;
+        const iit_file_header hdr = ans.read_file(filename, zero_copy, m);
+        if (!hdr.has_model || !hdr.domains) {
+            throw std::runtime_error(filename + " holds a different type of index");
+        }
+        ans.domains = hdr.domains;
+        ans.min_beg = iit_file_header::unpack<Pos>(hdr.min_beg);
+        ans.domain_size = iit_file_header::unpack<Pos>(hdr.domain_size);
+        if constexpr (Tuning::pow2_domains) {
+            if (ans.domain_size <= 0 || (ans.nodes.size() && (ans.domain_size & (ans.domain_size-1)))) {
+                throw std::runtime_error(filename + " holds a different type of index");
+            }
+            ans.domain_shift = log2ull(uint64_t(ans.domain_size));
+        }
+        if (hdr.sections[iit_file_header::BOUNDARIES].bytes) {
+            super::load_array(ans.boundaries, m, hdr, iit_file_header::BOUNDARIES, ans.domains-1, zero_copy);
+        }
+        super::load_array(ans.parameters, m, hdr, iit_file_header::PARAMETERS, 3*ans.domains, zero_copy);
+        // train()'s cost estimates, which sessions use to decide where to gallop
+        if (hdr.sections[iit_file_header::DOMAIN_COSTS].bytes) {
+            super::load_array(ans.domain_costs, m, hdr, iit_file_header::DOMAIN_COSTS, ans.domains, zero_copy);
+            double total_cost = 0.0;
+            Rank r = ans.domain_first_rank(0);
+            for (Domain d = 0; d < ans.domains; ++d) {
+                const Rank r_end = ans.domain_first_rank(d+1);
+                total_cost += ans.domain_costs[d]*(r_end-r);
+                r = r_end;
+            }
+            ans.predicted_cost = ans.nodes.size() ? total_cost/ans.nodes.size() : 0.0;
+        }
+        return ans;
+    }
+
+    iitii(NodeArray<BuildNode>& nodes_, unsigned threads, Domain domains_,
+          iitii_partition partition = iitii_partition::equal_width,
+          const iitii_train_options& train_options_ = iitii_train_options())
+        : super(nodes_, threads)
+        , train_options(train_options_)
+    {
+        partition_domains(domains_, partition);
+        augment(threads, nullptr);
+    }
+
+    // build with the domain count & partition of prior, an index of a subset of the nodes
+    // (typically the previous version of an updated dataset), reusing its model where possible
+    iitii(NodeArray<BuildNode>& nodes_, unsigned threads, const iitii& prior)
+        : super(nodes_, threads)
+        , train_options(prior.train_options)
+    {
+        partition_domains(prior.domains, prior.model_summary().partition);
+        augment(threads, &prior);
+    }
+
+    // compute outside_max_end and train the model (partitioned already)
+    void augment(unsigned threads, const iitii* prior) {
+        predicted_cost = 0.0;
+
+        if (nodes.size()) {
+
+            // compute running max_end along the sorted array, which we'll look up while computing
+            // outside_max_end below. This is a parallel prefix max: each block is scanned
+            // separately, then offset by the maximum of the blocks preceding it.
+            const size_t block = 65536, blocks = (nodes.size()+block-1)/block;
+            iit_scratch_vector<Pos> running_max_end(nodes.size());
+            iit_parallel_for(blocks, threads, 1, [&](size_t lo, size_t hi) {
+                for (size_t b = lo; b < hi; ++b) {
+                    running_max_end[b*block] = nodes[b*block].end();
+                    for (Rank n = b*block+1; n < std::min((b+1)*block, nodes.size()); ++n) {
+                        running_max_end[n] = std::max(running_max_end[n-1], nodes[n].end());
+                    }
+                }
+            });
+            iit_scratch_vector<Pos> carry(blocks);
+            for (size_t b = 1; b < blocks; ++b) {
+                carry[b] = running_max_end[b*block-1];
+                if (b > 1) {
+                    carry[b] = std::max(carry[b], carry[b-1]);
+                }
+            }
+            iit_parallel_for(blocks, threads, 1, [&](size_t lo, size_t hi) {
+                for (size_t b = std::max(lo, size_t(1)); b < hi; ++b) {
+                    for (Rank n = b*block; n < std::min((b+1)*block, nodes.size()); ++n) {
+                        running_max_end[n] = std::max(running_max_end[n], carry[b]);
+                    }
+                }
+            });
+
+            // fill outside_max_end
+            iit_parallel_for(nodes.size(), threads, 65536, [&](size_t lo, size_t hi) {
+                for (Rank n = lo; n < hi; ++n) {
+                    Node& node = nodes[n];
+                    Rank l = leftmost_leaf2(n);
+
+                    if (l>0) {
+                        // outside_max_end is the running_max_end of the highest-ranked node ranked
+                        // below n's leftmost child & has beg strictly below n's
+                        Rank leq = l-1;
+                        while (nodes[leq].beg() == node.beg()) {
+                            if (leq == 0) {
+                                break;
+                            }
+                            --leq;
+                        }
+                        assert(nodes[leq].beg() <= node.beg());
+                        node.set_outside_max_end(nodes[leq].beg() < node.beg()
+                                                    ? running_max_end[leq]
+                                                    : std::numeric_limits<Pos>::min());
+                    }
+                }
+            });
+            super::build_top_keys();
+
+            // train the rank prediction models
+            train(threads, prior);
+        }
+    }
+
+    // build with the domain count & partition selected by iitii_auto_domains (see there)
+    iitii(NodeArray<BuildNode>& nodes_, unsigned threads, const iitii_auto_domains& opts)
+        : iitii(nodes_, threads, 1, iitii_partition::equal_width, opts.train)
+    {
+        const size_t row_bytes = 3*sizeof(Weight);
+        const double tolerance = 1.0 + opts.tolerance;
+        Domain best_domains = domains;
+        iitii_partition best_partition = iitii_partition::equal_width;
+        double best_cost = predicted_cost;
+        for (Domain d = 4; d*std::max(opts.min_domain_items, size_t(1)) <= nodes.size(); d *= 4) {
+            for (auto partition : { iitii_partition::equal_width, iitii_partition::equal_count }) {
+                if (d*row_bytes + (partition == iitii_partition::equal_count ? (d-1)*sizeof(Pos) : 0)
+                        > opts.max_model_bytes) {
+                    continue;
+                }
+                partition_domains(d, partition);
+                train(threads);
+                // the candidates are in order of model size, so a larger one must improve the
+                // predicted cost by the tolerance to be chosen
+                if (predicted_cost*tolerance < best_cost) {
+                    best_cost = predicted_cost;
+                    best_domains = d;
+                    best_partition = partition;
+                }
+            }
+        }
+        if (best_domains != domains || best_partition != model_summary().partition) {
+            partition_domains(best_domains, best_partition);
+            train(threads);
+        }
+    }
+
+public:
+    // iitii::builder::build() takes a size_t argument giving the number of domains to model, and
+    // optionally the iitii_partition & iitii_train_options; or, an iitii_auto_domains to select
+    // them automatically.
+    using builder = iit_builder_base<iitii<Pos, Item, get_beg, get_end, NodeArray, Stats, Layout, Tuning>, Item, BuildNode, NodeArray>;
+    friend builder;
+    template<typename P, typename I, P gb(const I&), P ge(const I&), size_t gr(const I&), class S, class L>
+    friend class iitii_genome;
+    template<typename P, typename I, P gb(const I&), P ge(const I&), class S, class L, class U>
+    friend class iitii_updatable;
+    template<typename P, typename I, P gb(const I&), P ge(const I&), template<class> class A, class S, class L>
+    friend class iitii_sharded;
+
+    // Find the subtree root from which to scan for [qbeg,qend), by climbing from the model's
+    // prediction (or just the root, if there's none). Set k to its level and return it. The cost
+    // accrues the climbing cost: pessimistically, we triple (Tuning::climb_cost_factor) the number
+    // of levels climbed when adding it to the top-down search cost, because the outside_min_beg()
+    // lookup may incur two additional cache misses.
+    Rank climb(Pos qbeg, Pos qend, Level& k, size_t& cost) const {
+        // ask model which leaf we should begin our bottom-up climb at
+        Rank prediction = predict(qbeg);
+        if (prediction == nrank) {
+            // the model did not make a prediction for some reason, so just go to the root
+            k = root_level;
+            return root;
+        }
+        k = level(prediction);
+        return climb_from(prediction, qbeg, qend, k, cost);
+    }
+
+    // climb from subtree (on level k) until our necessary & sufficient criteria are met, or the
+    // root; update k & the cost as climb() does
+    Rank climb_from(Rank subtree, Pos qbeg, Pos qend, Level& k, size_t& cost) const {
+        const Level k0 = k;
+        assert(k0 <= root_level && k0 == level(subtree));
+        if (subtree != root) {
+            super::prefetch_key(parent(subtree, k0), k0+1);
+        }
+
+        while (climb_further(subtree, k, qbeg, qend)) {
+            subtree = parent(subtree, k++);
+            assert(k == level(subtree));
+            if (subtree != root) {
+                super::prefetch_key(parent(subtree, k), k+1);
+            }
+        }
+        const auto climb_cost = k - k0;
+
+        stats_.record(climb_cost);
+        cost += Tuning::climb_cost_factor*climb_cost;
+        return subtree;
+    }
+
+    // start a nearest-interval query by galloping to qpos's rank from the model's prediction (see
+    // iit_base::k_nearest)
+    Rank seek(Pos qpos, size_t& cost) const override {
+        const Rank prediction = predict(qpos);
+        if (prediction == nrank) {
+            return super::seek(qpos, cost);
+        }
+        return super::gallop(prediction, qpos, std::numeric_limits<size_t>::max(), cost);
+    }
+
+    // with Stats collecting histograms, record the query's prediction error, scan cost & results
+    void record_scan(Pos qbeg, size_t scanned, size_t results) const {
+        const Rank prediction = predict(qbeg);
+        size_t error = size_t(-1);
+        if (prediction != nrank) {
+            // qbeg's place among the nodes
+            Rank lo = 0, hi = nodes.size();
+            while (lo < hi) {
+                const Rank mid = lo + (hi-lo)/2;
+                if (nodes[mid].beg() < qbeg) {
+                    lo = mid+1;
+                } else {
+                    hi = mid;
+                }
+            }
+            error = prediction >= lo ? prediction-lo : lo-prediction;
+        }
+        stats_.record_scan(error, scanned, results);
+    }
+
+    size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const override {
+        size_t cost = 0;
+        Level k;
+        const Rank subtree = climb(qbeg, qend, k, cost);
+
+        // scan the subtree for query results.
+        ans.clear();
+        const size_t scanned = super::scan(subtree, k, qbeg, qend, ans);
+        if constexpr (Stats::histograms) {
+            record_scan(qbeg, scanned, ans.size());
+        }
+        return scanned + cost;
+    }
+
+    // overlap_visit, overlap_count & overlap_any as in iit_base, starting from the subtree found
+    // by the middle-out climb
+    template<class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        size_t cost = 0;
+        Level k;
+        const Rank subtree = climb(qbeg, qend, k, cost);
+        return visit_from(subtree, k, qbeg, qend, f, cost);
+    }
+
+    // scan subtree (on level k) for [qbeg,qend) calling f on each result, having already spent
+    // cost finding it. return the total query cost.
+    template<class F>
+    size_t visit_from(Rank subtree, Level k, Pos qbeg, Pos qend, F& f, size_t cost) const {
+        if constexpr (Stats::histograms) {
+            const size_t climb_cost = cost;
+            size_t results = 0;
+            auto g = [&](const Item& item) {
+                ++results;
+                return super::visit(f, item);
+            };
+            super::scan_visit(subtree, k, qbeg, qend, g, cost);
+            record_scan(qbeg, cost - climb_cost, results);
+        } else {
+            super::scan_visit(subtree, k, qbeg, qend, f, cost);
+        }
+        return cost;
+    }
+
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        size_t ans = 0;
+        overlap_visit(qbeg, qend, [&ans](const Item&) { ++ans; });
+        return ans;
+    }
+
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        bool ans = false;
+        overlap_visit(qbeg, qend, [&ans](const Item&) { ans = true; return false; });
+        return ans;
+    }
+
+    // rank-returning queries as in iit_base, starting from the subtree found by the climb
+    size_t overlap_ranks(Pos qbeg, Pos qend, std::vector<size_t>& ans) const {
+        ans.clear();
+        return overlap_visit(qbeg, qend, super::rank_collector(ans));
+    }
+
+    size_t overlap_rank_runs(Pos qbeg, Pos qend, std::vector<std::pair<size_t, size_t>>& ans) const {
+        ans.clear();
+        return overlap_visit(qbeg, qend, super::rank_run_collector(ans));
+    }
+
+    // lazy overlap query as in iit_base, starting from the subtree found by the climb
+    typename super::overlap_cursor overlap_range(Pos qbeg, Pos qend) const {
+        size_t cost = 0;
+        Level k;
+        const Rank subtree = climb(qbeg, qend, k, cost);
+        return typename super::overlap_cursor(*this, subtree, k, qbeg, qend, cost);
+    }
+
+    // Query session for a stream of queries with locality, e.g. walking a coordinate-sorted BAM or
+    // VCF. The session remembers the rank where the last query's qbeg fell among the nodes (the
+    // finger), and can find the next qbeg's rank by galloping (exponential) search from there: a
+    // few cache-hot node visits when it's nearby. The climb then starts from the subtree holding
+    // that rank, on the level where the model's prediction would be. It gallops only where that's
+    // expected to beat the model's prediction, i.e. in domains the model fits poorly (or not at
+    // all), and within max_gallop ranks of the finger; otherwise the query starts from the
+    // prediction as overlap() does. The results & their order are as with overlap().
+    //
+    // The session is mutable query state, so each thread querying the index needs its own (the
+    // index itself is still only read). It refers to the index, which must outlive it.
+    class session {
+        const iitii* tree_;
+        size_t max_gallop_;
+        Rank finger_ = nrank;   // rank found for the last qbeg (or predicted for it), or nrank
+        size_t last_gap_ = 0;   // distance of the last gallop
+        size_t domain_ = size_t(-1);  // domain of the last query, and its penalty (see start)
+        double penalty_ = 0.0;
+
+        // find the subtree root from which to scan for [qbeg,qend), as iitii::climb() does
+        Rank start(Pos qbeg, Pos qend, Level& k, size_t& cost) {
+            const iitii& t = *tree_;
+            if (finger_ != nrank && !t.nodes.empty()) {
+                // Gallop if that's expected to be cheaper than starting from the prediction:
+                // compare the domain's training estimate of the prediction's error penalty (its
+                // cost beyond the descent from the predicted level) with the cost of galloping as
+                // far as the last time (or max_gallop, if that failed).
+                const size_t d = t.which_domain(qbeg);
+                if (d != domain_) {
+                    const Weight lv_f = t.parameters[3*d+2];
+                    domain_ = d;
+                    penalty_ = lv_f < 0 ? double(t.root_level)
+                             : d < t.domain_costs.size() ? t.domain_costs[d] - double(lv_f) : 0.0;
+                }
+                if (2.0*log2ull(last_gap_+1) + 1.0 < penalty_) {
+                    const Weight lv_f = t.parameters[3*d+2];
+                    const Rank r = t.gallop(finger_, qbeg, max_gallop_, cost);
+                    if (r != nrank) {
+                        last_gap_ = r >= finger_ ? r-finger_ : finger_-r;
+                        finger_ = r;
+                        // climb from the subtree holding rank r (or the last node) on the level
+                        // the model would've predicted
+                        k = std::min(std::max(Level(super::leaf_level), lv_f >= 0 ? Level(lv_f) : Level(0)),
+                                     t.root_level);
+                        const Rank r0 = std::min(r, t.nodes.size()-1);
+                        return t.climb_from(((r0 >> (k+1)) << (k+1)) + (Rank(1) << k) - 1, qbeg, qend, k, cost);
+                    }
+                    last_gap_ = max_gallop_;
+                } else {
+                    // forget a long gap gradually, to try galloping again later
+                    last_gap_ -= last_gap_/4;
+                }
+            }
+            // otherwise start as overlap() does, leaving the finger at the prediction
+            const Rank prediction = t.predict(qbeg);
+            finger_ = prediction != nrank ? prediction : t.lower_rank(qbeg);
+            return t.climb(qbeg, qend, k, cost);
+        }
+
+    public:
+        explicit session(const iitii& tree, size_t max_gallop = 256)
+            : tree_(&tree), max_gallop_(max_gallop) {}
+
+        // overlap queries as with iitii
+        size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) {
+            ans.clear();
+            return overlap_visit(qbeg, qend, [&ans](const Item& item) { ans.push_back(&item); });
+        }
+
+        std::vector<const Item*> overlap(Pos qbeg, Pos qend) {
+            std::vector<const Item*> ans;
+            overlap(qbeg, qend, ans);
+            return ans;
+        }
+
+        template<class F>
+        size_t overlap_visit(Pos qbeg, Pos qend, F&& f) {
+            size_t cost = 0;
+            Level k;
+            const Rank subtree = start(qbeg, qend, k, cost);
+            return tree_->visit_from(subtree, k, qbeg, qend, f, cost);
+        }
+
+        size_t overlap_count(Pos qbeg, Pos qend) {
+            size_t ans = 0;
+            overlap_visit(qbeg, qend, [&ans](const Item&) { ++ans; });
+            return ans;
+        }
+
+        bool overlap_any(Pos qbeg, Pos qend) {
+            bool ans = false;
+            overlap_visit(qbeg, qend, [&ans](const Item&) { ans = true; return false; });
+            return ans;
+        }
+
+        size_t overlap_ranks(Pos qbeg, Pos qend, std::vector<size_t>& ans) {
+            ans.clear();
+            return overlap_visit(qbeg, qend, tree_->rank_collector(ans));
+        }
+
+        size_t overlap_rank_runs(Pos qbeg, Pos qend, std::vector<std::pair<size_t, size_t>>& ans) {
+            ans.clear();
+            return overlap_visit(qbeg, qend, tree_->rank_run_collector(ans));
+        }
+    };
+
+    // batched overlap queries with the same interface as iit_base::overlap_batch. Each query's
+    // prediction, climb and scan are executed as resumable steps interleaved with the other
+    // in-flight queries.
+    size_t overlap_batch(const Pos* qbegs, const Pos* qends, size_t n,
+                         std::vector<size_t>& offsets, std::vector<const Item*>& items,
+                         size_t inflight = 8) const {
+        using batch_slot = typename super::batch_slot;
+        auto start = [this](batch_slot& s) {
+            const Rank prediction = predict(s.qbeg);
+            if (prediction == nrank) {
+                super::scan_push(s.scan, root, root_level, s.cost);
+            } else {
+                s.climbing = true;
+                s.subtree = prediction;
+                s.k = s.k0 = level(prediction);
+                prefetch_climb(s.subtree, s.k);
+            }
+        };
+        auto climb_step = [this](batch_slot& s) {
+            if (climb_further(s.subtree, s.k, s.qbeg, s.qend)) {
+                s.subtree = parent(s.subtree, s.k++);
+                prefetch_climb(s.subtree, s.k);
+                return;
+            }
+            const auto climb_cost = s.k - s.k0;
+            stats_.record(climb_cost);
+            s.cost += Tuning::climb_cost_factor*climb_cost;
+            s.climbing = false;
+            super::scan_push(s.scan, s.subtree, s.k, s.cost);
+        };
+        return super::run_batch(qbegs, qends, n, inflight, offsets, items, start, climb_step);
+    }
+
+    // save/load the index & model, as with iit
+    void save(const std::string& filename) const {
+        iit_file_header hdr;
+        hdr.has_model = 1;
+        hdr.domains = domains;
+        hdr.min_beg = iit_file_header::pack(min_beg);
+        hdr.domain_size = iit_file_header::pack(domain_size);
+        std::vector<std::pair<const void*, size_t>> sections(iit_file_header::MAX_SECTIONS);
+        sections[iit_file_header::PARAMETERS] = std::make_pair(&parameters[0], parameters.size()*sizeof(Weight));
+        sections[iit_file_header::BOUNDARIES] = std::make_pair(boundaries.data(), boundaries.size()*sizeof(Pos));
+        sections[iit_file_header::DOMAIN_COSTS] = std::make_pair(domain_costs.data(), domain_costs.size()*sizeof(double));
+        super::write_file(filename, hdr, sections);
+    }
+
+    static iitii load(const std::string& filename) {
+        return load_(filename, false);
+    }
+
+    static iitii load_mmap(const std::string& filename) {
+        static_assert(iit_is_mapped_array<NodeArray<Node>>::value, "load_mmap requires NodeArray = iit_mapped_array");
+        return load_(filename, true);
+    }
+
+    // query statistics collected according to the Stats policy
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    // the configuration of the model
+    iitii_model_summary model_summary() const {
+        iitii_model_summary ans;
+        ans.domains = domains;
+        ans.partition = boundaries.empty() ? iitii_partition::equal_width : iitii_partition::equal_count;
+        ans.predicted_cost = predicted_cost;
+        ans.model_bytes = parameters.size()*sizeof(Weight) + boundaries.size()*sizeof(Pos);
+        return ans;
+    }
+
+    // per-domain diagnostics of the model
+    iitii_model_report model_report() const {
+        iitii_model_report ans;
+        Rank r = domain_first_rank(0);
+        for (Domain d = 0; d < domains; ++d) {
+            const Rank r_end = domain_first_rank(d+1);
+            const Weight *pp = &(parameters[3*d]);
+            iitii_domain_info info;
+            info.domain = d;
+            info.origin = double(domain_origin(d));
+            info.items = r_end - r;
+            info.level = pp[2] < 0 ? -1 : int(pp[2]);
+            info.w0 = pp[0];
+            info.w1 = pp[1];
+            info.expected_cost = domain_costs.size() == domains ? domain_costs[d]
+                                                                : std::numeric_limits<double>::quiet_NaN();
+            ans.root_domains += info.level < 0;
+            ans.domains.push_back(info);
+            r = r_end;
+        }
+        return ans;
+    }
+
+    using super::overlap;
+};
+
+// Genome-wide index: one iitii per contig, dispatched by a dense contig id (e.g. htslib's rid)
+// given by get_rid, so that overlap(rid, qbeg, qend) takes no map lookup. The contigs' nodes,
+// Items, model parameters & cost estimates and top-level keys are each stored in one contiguous
+// allocation, which the per-contig trees view through iit_mapped_array, and the contigs share one
+// Stats object (through iitii_stats_shared, unless it's empty like iitii_stats_none); this saves a
+// lot of per-tree overhead for references with thousands of (mostly tiny) contigs.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), size_t get_rid(const Item&), class Stats, class Layout>
+class iitii_genome {
+    static const bool shared_stats = !std::is_empty<Stats>::value;
+
+public:
+    using tree = iitii<Pos, Item, get_beg, get_end, iit_mapped_array,
+                       typename std::conditional<shared_stats, iitii_stats_shared<Stats>, Stats>::type, Layout>;
+
+private:
+    using Node = typename tree::Node;
+    using BuildNode = typename tree::BuildNode;
+
+    std::vector<tree> contigs_;  // indexed by rid
+    std::unique_ptr<Stats> stats_{new Stats()};  // shared by the contigs
+
+    void attach_stats() {
+        if constexpr (shared_stats) {
+            for (tree& t : contigs_) {
+                t.stats_ = iitii_stats_shared<Stats>(*stats_);
+            }
+        }
+    }
+
+    // move the contents of array get(t) of each tree t into one allocation, and view it from there
+    template<class T, class Get>
+    static void compact(std::vector<tree>& contigs, Get get) {
+        size_t total = 0;
+        for (auto& t : contigs) {
+            total += get(t).size();
+        }
+        auto region = std::make_shared<std::vector<T>>();
+        region->reserve(total);
+        for (auto& t : contigs) {
+            for (auto& x : get(t)) {
+                region->push_back(std::move(x));
+            }
+        }
+        size_t ofs = 0;
+        for (auto& t : contigs) {
+            const size_t n = get(t).size();
+            get(t) = iit_mapped_array<T>::view(region->data() + ofs, n, region);
+            ofs += n;
+        }
+    }
+
+public:
+    class builder {
+        std::vector<BuildNode> nodes_;
+        unsigned threads_ = 1;
+
+    public:
+        builder() = default;
+
+        template<typename InputIterator>
+        builder(InputIterator begin, InputIterator end) {
+            add(begin, end);
+        }
+
+        void add(const Item& it) {
+            nodes_.push_back(BuildNode(it));
+        }
+
+        template<typename InputIterator>
+        void add(InputIterator begin, InputIterator end) {
+            if constexpr (std::is_base_of<std::forward_iterator_tag,
+                          typename std::iterator_traits<InputIterator>::iterator_category>::value) {
+                reserve(nodes_.size() + std::distance(begin, end));
+            }
+            std::for_each(begin, end, [&](const Item& it) { add(it); });
+        }
+
+        // the contigs' nodes become one allocation, so its spare capacity would be kept too
+        void reserve(size_t n) {
+            nodes_.reserve(n);
+        }
+
+        // number of threads for build(); contigs are built concurrently
+        builder& threads(unsigned n) {
+            threads_ = std::max(n, 1U);
+            return *this;
+        }
+
+        // build the index with about `domains` model domains in total, apportioned among the
+        // contigs in proportion to their item counts (at least one each)
+        iitii_genome build(size_t domains, iitii_partition partition = iitii_partition::equal_width) {
+            // sort the nodes by contig, then as usual within each contig
+            iit_parallel_sort(nodes_, threads_, [](const BuildNode& lhs, const BuildNode& rhs) {
+                const size_t lrid = get_rid(lhs.item), rrid = get_rid(rhs.item);
+                return lrid < rrid || (lrid == rrid && lhs < rhs);
+            });
+            const size_t n = nodes_.size();
+            std::vector<size_t> offsets;  // first rank of each contig, plus n at the end
+            for (size_t r = 0; r < n; ++r) {
+                const size_t rid = get_rid(nodes_[r].item);
+                while (offsets.size() <= rid) {
+                    offsets.push_back(r);
+                }
+            }
+            offsets.push_back(n);
+
+            // each contig's tree is built over its slice of the sorted nodes. With the default
+            // layout the slice becomes the tree's node array in place; otherwise the tree splits
+            // it into separate arrays, which are compacted below.
+            iitii_genome ans;
+            const size_t contigs = offsets.size()-1;
+            ans.contigs_.assign(contigs, tree());
+            auto region = std::make_shared<std::vector<BuildNode>>(std::move(nodes_));
+            nodes_.clear();
+            auto build_contig = [&](size_t c, unsigned threads) {
+                const size_t nc = offsets[c+1] - offsets[c];
+                auto slice = iit_mapped_array<BuildNode>::view(region->data() + offsets[c], nc, region);
+                const size_t dc = n ? std::max(size_t(1), size_t(double(domains)*nc/n + 0.5)) : 1;
+                ans.contigs_[c] = tree(slice, threads, dc, partition);
+            };
+            // contigs large enough to keep all the threads busy are built one at a time; the rest
+            // are built concurrently, single-threaded
+            std::vector<size_t> small;
+            for (size_t c = 0; c < contigs; ++c) {
+                if (threads_ > 1 && offsets[c+1] - offsets[c] > n/threads_) {
+                    build_contig(c, threads_);
+                } else {
+                    small.push_back(c);
+                }
+            }
+            std::atomic<size_t> next(0);
+            iit_parallel_for(small.size(), threads_, 1, [&](size_t, size_t) {
+                for (size_t i; (i = next++) < small.size(); ) {
+                    build_contig(small[i], 1);
+                }
+            });
+            region.reset();
+
+            if constexpr (!std::is_same<BuildNode, Node>::value) {
+                compact<Node>(ans.contigs_, [](tree& t) -> iit_mapped_array<Node>& { return t.nodes; });
+                compact<Item>(ans.contigs_, [](tree& t) -> iit_mapped_array<Item>& { return t.items; });
+            }
+            compact<typename tree::Weight>(ans.contigs_, [](tree& t) -> iit_mapped_array<typename tree::Weight>& { return t.parameters; });
+            compact<Pos>(ans.contigs_, [](tree& t) -> iit_mapped_array<Pos>& { return t.boundaries; });
+            compact<double>(ans.contigs_, [](tree& t) -> iit_mapped_array<double>& { return t.domain_costs; });
+            compact<typename tree::top_key>(ans.contigs_, [](tree& t) -> iit_mapped_array<typename tree::top_key>& { return t.top_keys; });
+            ans.attach_stats();
+            return ans;
+        }
+    };
+
+    iitii_genome() = default;
+    // a copy has its own copy of the statistics, as with iitii
+    iitii_genome(const iitii_genome& rhs)
+        : contigs_(rhs.contigs_)
+        , stats_(new Stats(*rhs.stats_)) {
+        attach_stats();
+    }
+    iitii_genome(iitii_genome&&) = default;
+    iitii_genome& operator=(const iitii_genome& rhs) {
+        return *this = iitii_genome(rhs);
+    }
+    iitii_genome& operator=(iitii_genome&&) = default;
+
+    // number of contigs (one more than the highest rid indexed)
+    size_t contigs() const {
+        return contigs_.size();
+    }
+
+    // the index of one contig, for the full query interface. Requires rid < contigs().
+    const tree& contig(size_t rid) const {
+        assert(rid < contigs_.size());
+        return contigs_[rid];
+    }
+
+    // statistics of the queries on all the contigs
+    const Stats& stats() const {
+        return *stats_;
+    }
+
+    // overlap queries as with iitii, on contig rid (no results if rid >= contigs())
+    size_t overlap(size_t rid, Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        if (rid >= contigs_.size()) {
+            ans.clear();
+            return 0;
+        }
+        return contigs_[rid].overlap(qbeg, qend, ans);
+    }
+
+    std::vector<const Item*> overlap(size_t rid, Pos qbeg, Pos qend) const {
+        std::vector<const Item*> ans;
+        overlap(rid, qbeg, qend, ans);
+        return ans;
+    }
+
+    template<typename F>
+    size_t overlap_visit(size_t rid, Pos qbeg, Pos qend, F&& f) const {
+        return rid < contigs_.size() ? contigs_[rid].overlap_visit(qbeg, qend, std::forward<F>(f)) : 0;
+    }
+
+    size_t overlap_count(size_t rid, Pos qbeg, Pos qend) const {
+        return rid < contigs_.size() ? contigs_[rid].overlap_count(qbeg, qend) : 0;
+    }
+
+    bool overlap_any(size_t rid, Pos qbeg, Pos qend) const {
+        return rid < contigs_.size() && contigs_[rid].overlap_any(qbeg, qend);
+    }
+
+    typename tree::overlap_cursor overlap_range(size_t rid, Pos qbeg, Pos qend) const {
+        return rid < contigs_.size() ? contigs_[rid].overlap_range(qbeg, qend) : typename tree::overlap_cursor();
+    }
+
+    // ranks within contig rid's index (see contig(rid).item_at())
+    size_t overlap_ranks(size_t rid, Pos qbeg, Pos qend, std::vector<size_t>& ans) const {
+        if (rid >= contigs_.size()) {
+            ans.clear();
+            return 0;
+        }
+        return contigs_[rid].overlap_ranks(qbeg, qend, ans);
+    }
+
+    size_t overlap_rank_runs(size_t rid, Pos qbeg, Pos qend, std::vector<std::pair<size_t, size_t>>& ans) const {
+        if (rid >= contigs_.size()) {
+            ans.clear();
+            return 0;
+        }
+        return contigs_[rid].overlap_rank_runs(qbeg, qend, ans);
+    }
+
+    // nearest-interval queries as with iitii, on contig rid (no results if rid >= contigs())
+    size_t k_nearest(size_t rid, Pos qpos, size_t k, std::vector<const Item*>& ans,
+                     iit_direction dir = iit_direction::both) const {
+        if (rid >= contigs_.size()) {
+            ans.clear();
+            return 0;
+        }
+        return contigs_[rid].k_nearest(qpos, k, ans, dir);
+    }
+
+    std::vector<const Item*> k_nearest(size_t rid, Pos qpos, size_t k, iit_direction dir = iit_direction::both) const {
+        std::vector<const Item*> ans;
+        k_nearest(rid, qpos, k, ans, dir);
+        return ans;
+    }
+
+    const Item* nearest(size_t rid, Pos qpos, iit_direction dir = iit_direction::both) const {
+        return rid < contigs_.size() ? contigs_[rid].nearest(qpos, dir) : nullptr;
+    }
+
+    const Item* nearest_upstream(size_t rid, Pos qpos) const {
+        return nearest(rid, qpos, iit_direction::upstream);
+    }
+
+    const Item* nearest_downstream(size_t rid, Pos qpos) const {
+        return nearest(rid, qpos, iit_direction::downstream);
+    }
+
+    // query session as with iitii::session, keeping a finger on each contig
+    class session {
+        std::vector<typename tree::session> contigs_;
+
+    public:
+        explicit session(const iitii_genome& genome, size_t max_gallop = 256) {
+            contigs_.reserve(genome.contigs());
+            for (const tree& t : genome.contigs_) {
+                contigs_.emplace_back(t, max_gallop);
+            }
+        }
+
+        size_t overlap(size_t rid, Pos qbeg, Pos qend, std::vector<const Item*>& ans) {
+            if (rid >= contigs_.size()) {
+                ans.clear();
+                return 0;
+            }
+            return contigs_[rid].overlap(qbeg, qend, ans);
+        }
+
+        std::vector<const Item*> overlap(size_t rid, Pos qbeg, Pos qend) {
+            std::vector<const Item*> ans;
+            overlap(rid, qbeg, qend, ans);
+            return ans;
+        }
+
+        template<typename F>
+        size_t overlap_visit(size_t rid, Pos qbeg, Pos qend, F&& f) {
+            return rid < contigs_.size() ? contigs_[rid].overlap_visit(qbeg, qend, std::forward<F>(f)) : 0;
+        }
+
+        size_t overlap_count(size_t rid, Pos qbeg, Pos qend) {
+            return rid < contigs_.size() ? contigs_[rid].overlap_count(qbeg, qend) : 0;
+        }
+
+        bool overlap_any(size_t rid, Pos qbeg, Pos qend) {
+            return rid < contigs_.size() && contigs_[rid].overlap_any(qbeg, qend);
+        }
+    };
+
+    // join with another iitii_genome over the same Pos type (see iit_base::join), contig by contig
+    // in rid order: call f(const Item&, const OtherItem&) on each pair of overlapping items on
+    // the same contig. return the number of pairs reported.
+    template<class OtherGenome, class F>
+    size_t join(const OtherGenome& other, F&& f, unsigned threads = 1) const {
+        std::atomic<bool> stopped(false);
+        auto g = [&](const Item& a, const auto& b) {
+            stopped = !iit_visit_pair(f, a, b);
+            return !stopped;
+        };
+        size_t ans = 0;
+        for (size_t rid = 0; rid < std::min(contigs(), other.contigs()) && !stopped; ++rid) {
+            ans += contigs_[rid].join(other.contig(rid), g, threads);
+        }
+        return ans;
+    }
+};
+
+// Updatable index for a trickle of insertions, in the manner of a log-structured merge tree: a
+// large immutable iitii base, plus a few small delta iits holding the items inserted since the
+// base was built, plus a small unsorted buffer of the latest insertions. Queries merge the
+// results of all of them. When the buffer fills, it's sorted into a new delta, merging it with
+// the newest deltas no larger than it (so there are O(log n) deltas). Once the deltas hold
+// merge_fraction as many items as the base, a background thread merges them into a new base:
+// a linear merge of the presorted runs, retraining the model only for the domains whose bounds
+// or node counts changed (see iitii::train). The next insert() installs the new base when it's
+// ready, so neither inserts nor queries wait for a merge.
+//
+// Equal-width domains' bounds are spaced evenly from the least to the greatest begin position, so
+// inserting beyond either moves every bound and retrains every domain, as appending to the end
+// of a track does. With Tuning::pow2_domains, the width is rounded up to a power of two that
+// changes only when the range of positions doubles, so such appends retrain only the domains
+// receiving them.
+// (Equal-count bounds move as the node count grows, so they can seldom reuse a domain.)
+//
+// As with the standard containers, insert() must not run concurrently with queries; the
+// results of a query remain valid until the next insert(), wait() or compact().
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), class Stats = iitii_stats_none, class Layout = iit_aos, class Tuning = iitii_tuning>
+class iitii_updatable {
+public:
+    using base_tree = iitii<Pos, Item, get_beg, get_end, std::vector, Stats, Layout, Tuning>;
+    using delta_tree = iit<Pos, Item, get_beg, get_end, std::vector, Layout>;
+
+private:
+    using BuildNode = typename base_tree::BuildNode;
+    using DeltaNode = typename delta_tree::BuildNode;
+    using delta_ptr = std::shared_ptr<const delta_tree>;
+    using base_cursor = typename base_tree::overlap_cursor;
+    using delta_cursor = typename delta_tree::overlap_cursor;
+
+    // overlap_visit()'s scratch: the cursors of the deltas with results left, and the buffer's
+    // results, sorted
+    struct visit_scratch {
+        std::vector<delta_cursor> cursors;
+        std::vector<const Item*> buffered;
+    };
+
+    std::shared_ptr<const base_tree> base_;
+    std::vector<delta_ptr> merging_;    // deltas being merged into next_base_
+    std::vector<delta_ptr> deltas_;     // oldest (largest) first
+    std::vector<Item> buffer_;
+    std::future<std::shared_ptr<const base_tree>> next_base_;
+    size_t buffer_items_;
+    double merge_fraction_;
+    unsigned threads_;
+
+    static bool item_less(const Item* lhs, const Item* rhs) {
+        const Pos lbeg = get_beg(*lhs), rbeg = get_beg(*rhs);
+        return lbeg < rbeg || (lbeg == rbeg && get_end(*lhs) < get_end(*rhs));
+    }
+
+    static size_t total_size(const std::vector<delta_ptr>& deltas) {
+        size_t ans = 0;
+        for (const auto& d : deltas) {
+            ans += d->nodes.size();
+        }
+        return ans;
+    }
+
+    // linear merge of the nodes of tree t (already in sorted order) with the sorted run
+    template<class N, class T>
+    static std::vector<N> merge_nodes(const T& t, const std::vector<DeltaNode>& run) {
+        std::vector<N> ans;
+        const size_t n = t.nodes.size();
+        ans.reserve(n + run.size());
+        size_t r = 0, i = 0;
+        for (; r < n; ++r) {
+            N node(t.item(r));
+            while (i < run.size() && run[i] < node) {
+                ans.push_back(N(run[i++].item));
+            }
+            ans.push_back(node);
+        }
+        for (; i < run.size(); ++i) {
+            ans.push_back(N(run[i].item));
+        }
+        return ans;
+    }
+
+    // the nodes of the deltas, merged (newest first, so that the runs being merged stay small)
+    static std::vector<DeltaNode> merge_deltas(const std::vector<delta_ptr>& deltas) {
+        std::vector<DeltaNode> ans;
+        for (auto d = deltas.rbegin(); d != deltas.rend(); ++d) {
+            ans = merge_nodes<DeltaNode>(**d, ans);
+        }
+        return ans;
+    }
+
+    static std::shared_ptr<const base_tree> merge_base(std::shared_ptr<const base_tree> base,
+                                                       std::vector<delta_ptr> deltas, unsigned threads) {
+        std::vector<BuildNode> nodes = merge_nodes<BuildNode>(*base, merge_deltas(deltas));
+        return std::shared_ptr<const base_tree>(new base_tree(nodes, threads, *base));
+    }
+
+    // install the next base, if it's ready (or block until it is)
+    void install(bool block) {
+        if (next_base_.valid() &&
+                (block || next_base_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+            base_ = next_base_.get();
+            merging_.clear();
+        }
+    }
+
+    // sort the buffer into a new delta
+    void flush_buffer() {
+        if (buffer_.empty()) {
+            return;
+        }
+        std::vector<DeltaNode> nodes;
+        nodes.reserve(buffer_.size());
+        for (const Item& it : buffer_) {
+            nodes.push_back(DeltaNode(it));
+        }
+        std::sort(nodes.begin(), nodes.end());
+        while (!deltas_.empty() && deltas_.back()->nodes.size() <= nodes.size()) {
+            nodes = merge_nodes<DeltaNode>(*deltas_.back(), nodes);
+            deltas_.pop_back();
+        }
+        deltas_.push_back(delta_ptr(new delta_tree(nodes, 1)));
+        buffer_.clear();
+    }
+
+public:
+    // start from base; buffer_items, merge_fraction and threads as explained above
+    iitii_updatable(base_tree base, size_t buffer_items = 256, double merge_fraction = 0.125,
+                    unsigned threads = 1)
+        : base_(std::make_shared<const base_tree>(std::move(base)))
+        , buffer_items_(std::max(buffer_items, size_t(1)))
+        , merge_fraction_(merge_fraction)
+        , threads_(std::max(threads, 1U))
+    {
+        buffer_.reserve(buffer_items_);
+    }
+
+    void insert(const Item& it) {
+        install(false);
+        buffer_.push_back(it);
+        if (buffer_.size() < buffer_items_) {
+            return;
+        }
+        flush_buffer();
+        if (!next_base_.valid() &&
+                total_size(deltas_) >= std::max(double(buffer_items_), merge_fraction_*base_->nodes.size())) {
+            merging_ = std::move(deltas_);
+            deltas_.clear();
+            next_base_ = std::async(std::launch::async, merge_base, base_, merging_, threads_);
+        }
+    }
+
+    // wait for a background merge in progress (if any) to finish
+    void wait() {
+        install(true);
+    }
+
+    // merge everything into a new base now
+    void compact() {
+        install(true);
+        flush_buffer();
+        if (!deltas_.empty()) {
+            base_ = merge_base(base_, std::move(deltas_), threads_);
+            deltas_.clear();
+        }
+    }
+
+    // is a background merge in progress?
+    bool merging() const {
+        return next_base_.valid();
+    }
+
+    size_t size() const {
+        return base_->nodes.size() + total_size(merging_) + total_size(deltas_) + buffer_.size();
+    }
+
+    // the current base index (not including the items inserted since it was built)
+    const base_tree& base() const {
+        return *base_;
+    }
+
+    // overlap query merging the results of the base, deltas and buffer, which are returned in
+    // the same order as by iitii::overlap(). return the total query cost.
+    size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        ans.clear();
+        return overlap_visit(qbeg, qend, [&ans](const Item& it) { ans.push_back(&it); });
+    }
+
+    std::vector<const Item*> overlap(Pos qbeg, Pos qend) const {
+        std::vector<const Item*> ans;
+        overlap(qbeg, qend, ans);
+        return ans;
+    }
+
+    // call f on each result, in the same order as overlap(), merging the lazy cursors of the base
+    // and each delta with the buffer's results (as iitii_hybrid merges its two indexes). If f
+    // returns bool, then returning false stops the query. return the total query cost.
+    template<class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        // the cursors & sorted buffer results are held in per-thread scratch, reused between
+        // queries; it's taken rather than borrowed, so a query made from f gets its own.
+        static thread_local visit_scratch pool;
+        visit_scratch s = std::move(pool);
+        s.cursors.clear();
+        s.buffered.clear();
+        size_t cost = buffer_.size();
+        const delta_cursor delta_end{};
+        for (const auto* deltas : { &merging_, &deltas_ }) {
+            for (const auto& d : *deltas) {
+                delta_cursor c = d->overlap_range(qbeg, qend);
+                if (c != delta_end) {
+                    s.cursors.push_back(c);
+                } else {
+                    cost += c.cost();
+                }
+            }
+        }
+        for (const Item& it : buffer_) {
+            if (get_beg(it) < qend && get_end(it) > qbeg) {
+                s.buffered.push_back(&it);
+            }
+        }
+        std::sort(s.buffered.begin(), s.buffered.end(), item_less);
+
+        // each step takes the least current result among the base cursor, the (unexhausted)
+        // delta cursors & the buffer; there are O(log n) deltas.
+        base_cursor base = base_->overlap_range(qbeg, qend);
+        const base_cursor base_end{};
+        size_t b = 0;
+        while (true) {
+            const Item* best = base != base_end ? &*base : nullptr;
+            size_t which = s.cursors.size();   // the delta cursor holding best, if any
+            for (size_t i = 0; i < s.cursors.size(); ++i) {
+                if (!best || item_less(&*s.cursors[i], best)) {
+                    best = &*s.cursors[i];
+                    which = i;
+                }
+            }
+            const bool from_buffer = b < s.buffered.size() && (!best || item_less(s.buffered[b], best));
+            if (from_buffer) {
+                best = s.buffered[b];
+            }
+            if (!best) {
+                break;
+            }
+            bool more = true;
+            if constexpr (std::is_void<decltype(f(*best))>::value) {
+                f(*best);
+            } else {
+                more = f(*best);
+            }
+            if (!more) {
+                break;
+            }
+            if (from_buffer) {
+                ++b;
+            } else if (which < s.cursors.size()) {
+                delta_cursor& c = s.cursors[which];
+                if (++c == delta_end) {
+                    cost += c.cost();
+                    c = s.cursors.back();
+                    s.cursors.pop_back();
+                }
+            } else {
+                ++base;
+            }
+        }
+        cost += base.cost();
+        for (const delta_cursor& c : s.cursors) {
+            cost += c.cost();
+        }
+        pool = std::move(s);
+        return cost;
+    }
+
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        if (base_->overlap_any(qbeg, qend)) {
+            return true;
+        }
+        for (const auto* deltas : { &merging_, &deltas_ }) {
+            for (const auto& d : *deltas) {
+                if (d->overlap_any(qbeg, qend)) {
+                    return true;
+                }
+            }
+        }
+        for (const Item& it : buffer_) {
+            if (get_beg(it) < qend && get_end(it) > qbeg) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        size_t ans = base_->overlap_count(qbeg, qend);
+        for (const auto* deltas : { &merging_, &deltas_ }) {
+            for (const auto& d : *deltas) {
+                ans += d->overlap_count(qbeg, qend);
+            }
+        }
+        for (const Item& it : buffer_) {
+            ans += get_beg(it) < qend && get_end(it) > qbeg;
+        }
+        return ans;
+    }
+};
+
+// Options for choosing iitii_hybrid's length threshold from the length distribution: only the
+// longest long_fraction of the items are moved to the long index, and only those at least
+// min_ratio times as long as the median item, so nothing moves unless the lengths have a long tail.
+struct iitii_long_split {
+    double long_fraction = 0.02;
+    double min_ratio = 16.0;
+};
+
+// merge the overlap results ans[0, n0) & ans[n0, ans.size()) of two indexes, each in the order of
+// iit::overlap() (ascending begin, then end), back to front, with the second run copied past the
+// end of ans (usually within its capacity, unlike inplace_merge's temporary buffer)
 template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&)>
-struct iitii_node : public iit_node_base<Pos, Item, get_beg, get_end> {
-    // Additional augment value for iitii nodes, which helps us prove when we can stop climbing in
-    // the bottom-up search for a subtree root which must contain all query results beneath it.
-    Pos outside_max_end;
-    // outside_max_end of node n is the maximum m.end() of all nodes m outside of n & its subtree
-    //     with m.beg() < n.beg(); -infinity if there are no such nodes.
-    //
-    // Furthermore,
-    // outside_min_beg of node n is the minimum m.beg() of all nodes m outside of n & its subtree
-    //     with m.beg() >= n.beg(); infinity if there are no such nodes.
-    // But we don't need to store outside_min_beg, because we can compute it in constant time using
-    // rank offsets in the beg-sorted node array.
-    //
-    // Suppose during a query for [qbeg, qend) we climb up to a node n with,
-    //   (i) n.outside_max_end <= qbeg; AND
-    //  (ii) qend <= n.outside_min_beg
-    // By (i), any node outside n & subtree with beg < n's cannot overlap the query. By (ii), any
-    // node outside n & subtree with beg >= n's cannot overlap the query. This exhausts all nodes
-    // outside of n & subtree, so we need not climb past n.
+void iit_merge_results(std::vector<const Item*>& ans, size_t n0) {
+    auto less = [](const Item* lhs, const Item* rhs) {
+        const Pos lbeg = get_beg(*lhs), rbeg = get_beg(*rhs);
+        return lbeg < rbeg || (lbeg == rbeg && get_end(*lhs) < get_end(*rhs));
+    };
+    const size_t n = ans.size(), m = n - n0;
+    if (!n0 || !m) {
+        return;
+    }
+    ans.resize(n + m);
+    std::copy(ans.begin() + n0, ans.begin() + n, ans.begin() + n);
+    size_t i = n0, j = m, k = n;
+    while (j) {
+        if (i && less(ans[n + j - 1], ans[i - 1])) {
+            ans[--k] = ans[--i];
+        } else {
+            ans[--k] = ans[n + --j];
+        }
+    }
+    ans.resize(n);
+}
+
+// call f on the results of cursors a & b (see iit_base::overlap_cursor) over the same query, each
+// in the order of iit::overlap(), merged into that order. If f returns bool, then returning false
+// stops. The cursors' cost() then covers the results visited.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), class CursorA, class CursorB, class F>
+void iit_merge_visit(CursorA& a, CursorB& b, F& f) {
+    const CursorA a_end{};
+    const CursorB b_end{};
+    while (a != a_end || b != b_end) {
+        bool take_a = b == b_end;
+        if (!take_a && a != a_end) {
+            const Pos abeg = get_beg(*a), bbeg = get_beg(*b);
+            take_a = !(bbeg < abeg || (bbeg == abeg && get_end(*b) < get_end(*a)));
+        }
+        const Item& it = take_a ? *a : *b;
+        bool more = true;
+        if constexpr (std::is_void<decltype(f(it))>::value) {
+            f(it);
+        } else {
+            more = f(it);
+        }
+        if (!more) {
+            return;
+        }
+        if (take_a) {
+            ++a;
+        } else {
+            ++b;
+        }
+    }
+}
 
-    iitii_node(const Item& item_)
-        : iit_node_base<Pos, Item, get_beg, get_end>(item_)
-        , outside_max_end(std::numeric_limits<Pos>::min())
+// Hybrid index for tracks mixing short & very long intervals, e.g. genes or structural variants
+// among exons or reads. A single long interval keeps outside_max_end large far to its right, so
+// iitii's climbs from predictions across that stretch go most of the way to the root (train()'s
+// overlap_penalty); such tracks see little speedup over iit. The hybrid instead moves the
+// intervals longer than a threshold into a small separate iit, and the iitii indexes only the
+// rest. Each query searches both, merging the results into the same order as iitii::overlap()
+// (ascending begin, then end). The threshold may be given to the builder, or else is chosen
+// according to iitii_long_split.
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector, class Stats = iitii_stats_none, class Layout = iit_aos>
+class iitii_hybrid {
+public:
+    using short_tree = iitii<Pos, Item, get_beg, get_end, NodeArray, Stats, Layout>;
+    using long_tree = iit<Pos, Item, get_beg, get_end, NodeArray, Layout>;
+
+private:
+    short_tree short_;
+    long_tree long_;
+    Pos threshold_;
+    size_t short_size_ = 0, long_size_ = 0;
+
+    iitii_hybrid(short_tree&& short_index, long_tree&& long_index, Pos threshold,
+                 size_t short_size, size_t long_size)
+        : short_(std::move(short_index))
+        , long_(std::move(long_index))
+        , threshold_(threshold)
+        , short_size_(short_size)
+        , long_size_(long_size)
         {}
-};
 
-// simple linear regression of y ~ x given points [(x,y)], returning (intercept, slope)
-template<typename XT, typename YT>
-std::pair<double,double> regress(const std::vector<std::pair<XT,YT>>& points) {
-    if (points.size() <= 1) {
-        return std::make_pair(0.0, 0.0);
+public:
+    class builder {
+        std::vector<Item> items_;
+        unsigned threads_ = 1;
+        bool has_threshold_ = false;
+        Pos threshold_ = Pos();
+        iitii_long_split split_;
+
+    public:
+        builder() = default;
+
+        template<typename InputIterator>
+        builder(InputIterator begin, InputIterator end) {
+            add(begin, end);
+        }
+
+        void add(const Item& it) {
+            items_.push_back(it);
+        }
+
+        void add(Item&& it) {
+            items_.push_back(std::move(it));
+        }
+
+        template<typename InputIterator>
+        void add(InputIterator begin, InputIterator end) {
+            for (; begin != end; ++begin) {
+                add(*begin);
+            }
+        }
+
+        // number of threads for building the two indexes
+        builder& threads(unsigned n) {
+            threads_ = std::max(n, 1U);
+            return *this;
+        }
+
+        // move the items longer than threshold to the long index
+        builder& long_threshold(Pos threshold) {
+            has_threshold_ = true;
+            threshold_ = threshold;
+            return *this;
+        }
+
+        // or choose the threshold with these options (the default)
+        builder& long_split(const iitii_long_split& split) {
+            has_threshold_ = false;
+            split_ = split;
+            return *this;
+        }
+
+        // build with args as for iitii::builder::build(), e.g. the number of domains
+        template<typename... Args>
+        iitii_hybrid build(Args&&... args) {
+            Pos threshold = has_threshold_ ? threshold_ : std::numeric_limits<Pos>::max();
+            if (!has_threshold_ && !items_.empty()) {
+                std::vector<Pos> lengths;
+                lengths.reserve(items_.size());
+                for (const Item& it : items_) {
+                    lengths.push_back(get_end(it) - get_beg(it));
+                }
+                const size_t n = lengths.size(),
+                             q = std::min(n-1, size_t(double(n)*(1.0-split_.long_fraction)));
+                std::nth_element(lengths.begin(), lengths.begin()+q, lengths.end());
+                const Pos quantile = lengths[q];
+                std::nth_element(lengths.begin(), lengths.begin()+n/2, lengths.end());
+                const double floor = double(lengths[n/2])*split_.min_ratio;
+                if (double(quantile) >= floor) {
+                    threshold = quantile;
+                } else if (floor < double(std::numeric_limits<Pos>::max())) {
+                    threshold = Pos(floor);
+                }
+            }
+
+            typename short_tree::builder sb;
+            typename long_tree::builder lb;
+            size_t short_size = 0, long_size = 0;
+            for (Item& it : items_) {
+                if (get_end(it) - get_beg(it) > threshold) {
+                    lb.add(std::move(it));
+                    ++long_size;
+                } else {
+                    sb.add(std::move(it));
+                    ++short_size;
+                }
+            }
+            items_.clear();
+            short_tree short_index = sb.threads(threads_).build(std::forward<Args>(args)...);
+            return iitii_hybrid(std::move(short_index), lb.threads(threads_).build(), threshold,
+                                short_size, long_size);
+        }
+    };
+
+    // the length above which items are in the long index
+    Pos long_threshold() const {
+        return threshold_;
     }
-    double sum_x, sum_y, cov, var;
-    sum_x = sum_y = cov = var = 0.0;
-    for (const auto& pt : points) {
-        sum_x += double(pt.first);
-        sum_y += double(pt.second);
+
+    size_t size() const {
+        return short_size_ + long_size_;
     }
-    const double mean_x = sum_x/points.size(), mean_y = sum_y/points.size();
-    for (const auto& pt : points) {
-        const double x_err = pt.first - mean_x;
-        cov += x_err*(pt.second - mean_y);
-        var += x_err*x_err;
+
+    // the iitii of the short items, and the iit of the long ones, with long_size() items
+    const short_tree& short_index() const {
+        return short_;
     }
-    if (var == 0.0) {
-        return std::make_pair(0.0, 0.0);
+    const long_tree& long_index() const {
+        return long_;
+    }
+    size_t long_size() const {
+        return long_size_;
     }
-    const double m = cov / var;
-    return std::make_pair(mean_y - m*mean_x, m);
-}
-
-// floor(log2(x)) for positive x (quickly)
-inline unsigned log2ull(unsigned long long x) {
-    assert(x);
-    unsigned ans = unsigned(8*sizeof(unsigned long long) - __builtin_clzll(x) - 1);
-    assert(ans == unsigned(floor(log2(double(x)))));
-    return ans;
-}
 
-// here it is
-template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray = std::vector>
-class iitii : public iit_base<Pos, Item, iitii_node<Pos, Item, get_beg, get_end>, NodeArray> {
-    using Node = iitii_node<Pos, Item, get_beg, get_end>;
-    using super = iit_base<Pos, Item, Node, NodeArray>;
-    using typename super::Rank;
-    using typename super::Level;
-    using super::left;
-    using super::right;
-    using super::leftmost_leaf;
-    using super::leftmost_leaf2;
-    using super::rightmost_leaf;
-    using super::parent;
-    using super::nodes;
-    using super::full_size;
-    using super::nrank;
-    using super::level;
-    using super::root;
-    using super::root_level;
+    // overlap query merging the results of both indexes; return the total query cost
+    size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        size_t cost = short_.overlap(qbeg, qend, ans);
+        const size_t n0 = ans.size();
+        cost += long_.overlap_visit(qbeg, qend, [&ans](const Item& it) { ans.push_back(&it); });
+        iit_merge_results<Pos, Item, get_beg, get_end>(ans, n0);
+        return cost;
+    }
 
-    inline Pos outside_min_beg(Rank subtree, Level k) const {
-        // constant-time computation of outside_min_beg: beg() of the node ranked one higher than
-        // subtree's rightmost child
-        const Rank r = rightmost_leaf(subtree, k);
-        __builtin_prefetch(&(nodes[r+1]));
-        const Pos beg = nodes[subtree].beg();
-        const Rank l = leftmost_leaf(subtree, k);
-        if (l && nodes[l-1].beg() == beg) {
-            // corner case: nodes to the left of the subtree can have the same beg as subroot
-            // and outside_min_beg is defined on nodes with beg >= subroot's.
-            return beg;
-        }
-        return r < nodes.size()-1 ? nodes[r+1].beg() : std::numeric_limits<Pos>::max();
+    std::vector<const Item*> overlap(Pos qbeg, Pos qend) const {
+        std::vector<const Item*> ans;
+        overlap(qbeg, qend, ans);
+        return ans;
     }
 
-    // Additional tree navigation concept, LevelRank: the rank of a node **within its level**
-    // e.g. a level-k node with LevelRank=1 is the second-lowest (second-leftmost) node on level k
-    typedef std::size_t LevelRank;
+    // call f on each result, in the same order as overlap() (merging the two indexes' lazy
+    // cursors). If f returns bool, then returning false stops the query. return the total query
+    // cost.
+    template<class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        auto a = short_.overlap_range(qbeg, qend);
+        auto b = long_.overlap_range(qbeg, qend);
+        iit_merge_visit<Pos, Item, get_beg, get_end>(a, b, f);
+        return a.cost() + b.cost();
+    }
 
-    inline Rank rank_of_levelrank(Level k, LevelRank ofs) const {
-        return (size_t(1)<<k)*(2*ofs+1)-1;
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        return short_.overlap_count(qbeg, qend) + long_.overlap_count(qbeg, qend);
     }
 
-    inline LevelRank levelrank_of_rank(Rank r) const {
-        return ((r+1)/(size_t(1)<<level(r))-1)/2;
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        return short_.overlap_any(qbeg, qend) || long_.overlap_any(qbeg, qend);
     }
+};
 
-    // Rank prediction model: the [min_beg, max_beg] range is partitioned into a number C of
-    // domains, each covering an equal-sized portion of that range. The domain pertaining to a
-    // position beg is d(beg) = floor((beg-min_beg)*C/(max_beg-min_beg)), bounded to [0,C).
-    //
-    // For each domain d, we store three parameters: a Level l[d] ∈ [0,root_level] into which we
-    // will jump, and linear weights w[d,0] and w[d,1] for the regression of LevelRank on Pos,
-    //   lr(beg) ~ w[d(beg),0] + w[d(beg),1]*beg
-    //
-    // To start a query for qbeg, jump to the node: rank_of_levelrank(l[d(qbeg)], lr(qbeg))
+// Range-sharded index for interval sets too large for one machine: the begin-position range is
+// split into shards holding about equal numbers of items (equal-count boundaries, as for iitii's
+// model domains), each an independent iitii which can be saved, loaded & queried on its own, e.g.
+// on a different host. An item belongs to the shard holding its begin position; the items which
+// also extend past the shard's upper boundary are kept in the shard's small "spanning" iit rather
+// than its iitii (where they'd spoil its model, as in iitii_hybrid), so the iitii's items all lie
+// within the shard's range. A compact shard_router (the boundaries, plus the furthest end among
+// each shard's spanning items) maps a query [qbeg, qend) to the shards that may hold results: the
+// shards whose ranges it touches, plus the earlier shards whose spanning items reach qbeg. Each
+// shard answers a query in the order of iitii::overlap(), and the shards' results concatenate in
+// that order too, since the shards' begin positions ascend.
+//
+// save(prefix) writes the router to prefix.router and shard s to prefix.s and prefix.s.spanning,
+// so that a host serving shard s needs only load_shard(prefix, s).
+template<typename Pos, typename Item, Pos get_beg(const Item&), Pos get_end(const Item&), template<class> class NodeArray, class Stats, class Layout>
+class iitii_sharded {
+public:
+    using tree = iitii<Pos, Item, get_beg, get_end, NodeArray, Stats, Layout>;
+    using spanning_tree = iit<Pos, Item, get_beg, get_end, NodeArray, Layout>;
 
-    typedef std::size_t Domain;
-    Domain domains;               // C
-    Pos min_beg = std::numeric_limits<Pos>::max(),
-        domain_size = Node::npos;;
-    std::vector<float> parameters;  // C rows of three parameters (row-major storage): w[0,d],
-                                    // w[1,d] and l[d]. NB: the third is a Level stored as a float.
+    // One shard: the iitii of its items within its range, and the iit of the rest
+    class shard_index {
+        tree index_;
+        spanning_tree spanning_;
 
-    inline Domain which_domain(Pos beg) const {
-        if (beg < min_beg) {
-            return 0;
+    public:
+        shard_index() {}  // (empty)
+        shard_index(tree&& index, spanning_tree&& spanning)
+            : index_(std::move(index))
+            , spanning_(std::move(spanning))
+            {}
+
+        const tree& index() const {
+            return index_;
+        }
+        const spanning_tree& spanning() const {
+            return spanning_;
         }
-        return std::min(domains-1, Domain((beg-min_beg)/domain_size));
-    }
 
-    inline Rank interpolate(Level k, float w0, float w1, Pos qbeg) const {
-        // given model parameters within a domain, return the node to start searching for qbeg
-        const float ofs_f = w0 + w1*float(qbeg);
-        assert(std::isfinite(ofs_f));
-        const Rank r = rank_of_levelrank(k, LevelRank(std::max(0.0f, roundf(ofs_f))));
-        assert(r >= nodes.size() || level(r) == k);
+        // overlap query merging the results of both indexes; return the total query cost
+        size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+            size_t cost = index_.overlap(qbeg, qend, ans);
+            const size_t n0 = ans.size();
+            cost += spanning_.overlap_visit(qbeg, qend, [&ans](const Item& it) { ans.push_back(&it); });
+            iit_merge_results<Pos, Item, get_beg, get_end>(ans, n0);
+            return cost;
+        }
 
-        // detail: if rank is imaginary (qbeg is off-scale high), start from rightmost real leaf
-        const auto nsz = nodes.size();
-        return r < nsz ? r : (nsz - (2 - nsz%2));
-    }
+        // call f on each result, in the same order as overlap() (merging the two indexes' lazy
+        // cursors). If f returns bool, then returning false stops the query. return the total
+        // query cost.
+        template<class F>
+        size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+            auto a = index_.overlap_range(qbeg, qend);
+            auto b = spanning_.overlap_range(qbeg, qend);
+            iit_merge_visit<Pos, Item, get_beg, get_end>(a, b, f);
+            return a.cost() + b.cost();
+        }
 
-    void train() {
-        // Fibonacci-ish series of tree levels at which to evaluate interpolation model fit
-        const std::vector<Level> TRAIN_LEVELS = {0, 1, 2, 4, 7, 12, 20, 33, 54};
-
-        // scan the nodes to extract <Pos,Rank> points partitioned by domain
-        std::vector<std::vector<std::pair<Pos,Rank>>> points(domains);
-        for (Rank r = 0; r < nodes.size(); ++r) {
-            points.at(which_domain(nodes[r].beg())).push_back(std::make_pair(nodes[r].beg(), r));
-        }
-        // train each domain-specific model
-        for (Domain domain = 0; domain < domains; ++domain) {
-            // partition the domain points by tree level, converting Ranks to LevelRanks
-            std::vector<std::vector<std::pair<Pos,LevelRank>>> points_by_level(root_level+1);
-            for (const auto& p : points[domain]) {
-                Level k = level(p.second);
-                points_by_level.at(k)
-                               .push_back(std::make_pair(p.first, levelrank_of_rank(p.second)));
-            }
-            // for each level,
-            double lowest_cost = std::numeric_limits<double>::max();
-            for (const Level k : TRAIN_LEVELS) {
-                if (k >= root_level || points_by_level[k].size() <= 1) {
-                    break;
-                }
-                // regress points on this level
-                auto w = regress<Pos,LevelRank>(points_by_level[k]);
-                if (w.second) {
-                    // calculate estimate of search cost (average over all domain points)
-                    size_t cost = 0;
-                    for (const auto& p : points[domain]) {
-                        const Pos x = p.first;
-                        const Rank y = p.second;
-                        const Rank fx = interpolate(k, float(w.first), float(w.second), x);
-                        const size_t error = (fx>=y ? fx-y : y-fx)/(size_t(1)<<k);
-                        const size_t error_penalty = error ? 2*(1+log2ull(error)) : 0,
-                            overlap_penalty = nodes[fx].outside_max_end>x ? 1+(root_level-k)/2 : 0;
-                        cost += k + std::max(error_penalty, overlap_penalty);
-                    }
-                    double avg_cost = double(cost)/points[domain].size();
-                    // store parameters if cost estimate is lower than top-down search and lower
-                    // than previous levels
-                    if (avg_cost < root_level && avg_cost < lowest_cost) {
-                        lowest_cost = avg_cost;
-                        float *pp = &(parameters[3*domain]);
-                        pp[0] = float(w.first);
-                        pp[1] = float(w.second);
-                        pp[2] = float(k);
+        size_t overlap_count(Pos qbeg, Pos qend) const {
+            return index_.overlap_count(qbeg, qend) + spanning_.overlap_count(qbeg, qend);
+        }
+
+        bool overlap_any(Pos qbeg, Pos qend) const {
+            return index_.overlap_any(qbeg, qend) || spanning_.overlap_any(qbeg, qend);
+        }
+
+        // save to filename & filename.spanning
+        void save(const std::string& filename) const {
+            index_.save(filename);
+            spanning_.save(filename + ".spanning");
+        }
+
+        static shard_index load(const std::string& filename) {
+            return shard_index(tree::load(filename), spanning_tree::load(filename + ".spanning"));
+        }
+
+        static shard_index load_mmap(const std::string& filename) {
+            return shard_index(tree::load_mmap(filename), spanning_tree::load_mmap(filename + ".spanning"));
+        }
+    };
+
+    // Maps queries to shards
+    class shard_router {
+        std::vector<Pos> boundaries_;        // begin position of shards 1..S-1
+        std::vector<Pos> spanning_end_;      // furthest end of each shard's spanning items
+        std::vector<uint64_t> sizes_;        // items in each shard (including spanning)
+        std::vector<uint64_t> spanning_sizes_;
+        std::vector<uint64_t> reach_from_;   // lowest shard whose spanning items reach into shard s
+
+        friend class iitii_sharded;
+
+        struct file_header {
+            char magic[8];
+            uint32_t version, pos_size;
+            uint64_t shards;
+        };
+
+        // set reach_from_ from the other members
+        void index() {
+            const size_t n = shards();
+            reach_from_.resize(n);
+            for (size_t s = 0; s < n; ++s) {
+                reach_from_[s] = s;
+            }
+            for (size_t s = 0; s < n; ++s) {
+                if (spanning_sizes_[s]) {
+                    // the spanning items of shard s reach into the shards whose lower boundaries
+                    // are below their furthest end
+                    const size_t last = std::lower_bound(boundaries_.begin(), boundaries_.end(), spanning_end_[s])
+                                        - boundaries_.begin();
+                    for (size_t t = s+1; t <= last; ++t) {
+                        reach_from_[t] = std::min(reach_from_[t], uint64_t(s));
                     }
                 }
             }
-            points[domain].clear(); // free a little memory
-            /*
-            std::cout << "domain = " << domain << " level = " << Level(parameters[3*domain+2])
-                      << " E[cost] = " << lowest_cost << std::endl;
-            */
         }
-    }
 
-    // Given qbeg, select domain and predict search start node
-    Rank predict(Pos qbeg) const {
-        auto which = which_domain(qbeg);
-        assert(which < domains);
-        const float *pp = &(parameters[3*which]);
+    public:
+        size_t shards() const {
+            return sizes_.size();
+        }
 
-        const float lv_f = pp[2];
-        if (lv_f < 0) {
-            return nrank;
+        // the shard holding items beginning at beg
+        size_t which_shard(Pos beg) const {
+            return iit_boundary_count(boundaries_.data(), boundaries_.size(), beg);
         }
-        assert(lv_f >= 0 && lv_f <= root_level);
-        const Level k = Level(lv_f);
 
-        return interpolate(k, pp[0], pp[1], qbeg);
-    }
+        // shard s holds the items beginning in [lower(s), lower(s+1)), unbounded at either end
+        const std::vector<Pos>& boundaries() const {
+            return boundaries_;
+        }
 
-    iitii(NodeArray<Node>& nodes_, Domain domains_)
-        : super(nodes_)
-        , domains(std::max(Domain(1),domains_))
-        , domain_size(std::numeric_limits<Pos>::max())
-    {
-        parameters.resize(domains*3, -1.0f);
+        size_t shard_size(size_t s) const {
+            return sizes_.at(s);
+        }
+        size_t spanning_size(size_t s) const {
+            return spanning_sizes_.at(s);
+        }
 
-        if (nodes.size()) {
-            // equal size (in Pos units) of each domain
-            min_beg = nodes[0].beg();
-            domain_size = 1 + (nodes[nodes.size()-1].beg()-min_beg)/domains;
+        // set out to the shards which may hold items overlapping [qbeg, qend), in ascending order
+        void route(Pos qbeg, Pos qend, std::vector<size_t>& out) const {
+            out.clear();
+            if (!shards()) {
+                return;
+            }
+            const size_t s0 = which_shard(qbeg);
+            for (size_t s = reach_from_[s0]; s < s0; ++s) {
+                if (spanning_sizes_[s] && spanning_end_[s] > qbeg) {
+                    out.push_back(s);
+                }
+            }
+            // through the last shard beginning before qend
+            const size_t s1 = std::max(s0, size_t(std::lower_bound(boundaries_.begin(), boundaries_.end(), qend) - boundaries_.begin()));
+            for (size_t s = s0; s <= s1; ++s) {
+                if (sizes_[s]) {
+                    out.push_back(s);
+                }
+            }
+        }
 
-            // compute running max_end along the sorted array, which we'll look up while computing
-            // outside_max_end below
-            std::vector<Pos> running_max_end { nodes[0].end() };
-            for (Rank n = 1; n < nodes.size(); ++n) {
-                running_max_end.push_back(std::max(running_max_end[n-1], nodes[n].end()));
+        std::vector<size_t> route(Pos qbeg, Pos qend) const {
+            std::vector<size_t> ans;
+            route(qbeg, qend, ans);
+            return ans;
+        }
+
+        void save(const std::string& filename) const {
+            static_assert(std::is_trivially_copyable<Pos>::value, "saving the router requires trivially copyable Pos");
+            file_header hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            memcpy(hdr.magic, "iitiisr\0", 8);
+            hdr.version = 1;
+            hdr.pos_size = sizeof(Pos);
+            hdr.shards = shards();
+            std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+            out.write(reinterpret_cast<const char*>(boundaries_.data()), boundaries_.size()*sizeof(Pos));
+            out.write(reinterpret_cast<const char*>(spanning_end_.data()), spanning_end_.size()*sizeof(Pos));
+            out.write(reinterpret_cast<const char*>(sizes_.data()), sizes_.size()*sizeof(uint64_t));
+            out.write(reinterpret_cast<const char*>(spanning_sizes_.data()), spanning_sizes_.size()*sizeof(uint64_t));
+            out.close();
+            if (out.fail()) {
+                throw std::runtime_error("Failed to write " + filename);
             }
+        }
 
-            // fill outside_max_end
-            for (Rank n = 0; n < nodes.size(); ++n) {
-                Node& node = nodes[n];
-                Rank l = leftmost_leaf2(n);
-
-                if (l>0) {
-                    // outside_max_end is the running_max_end of the highest-ranked node ranked
-                    // below n's leftmost child & has beg strictly below n's
-                    Rank leq = l-1;
-                    while (nodes[leq].beg() == node.beg()) {
-                        if (leq == 0) {
-                            break;
+        static shard_router load(const std::string& filename) {
+            auto m = iit_file_mapping::open(filename);
+            file_header hdr;
+            if (m->size() < sizeof(hdr)) {
+                throw std::runtime_error(filename + " isn't an iitii shard router file");
+            }
+            memcpy(&hdr, m->data(), sizeof(hdr));
+            if (memcmp(hdr.magic, "iitiisr\0", 8) || hdr.version != 1) {
+                throw std::runtime_error(filename + " isn't an iitii shard router file");
+            }
+            if (hdr.pos_size != sizeof(Pos)) {
+                throw std::runtime_error(filename + " holds a different type of index");
+            }
+            if (!hdr.shards || m->size() != sizeof(hdr) + (2*hdr.shards - 1)*sizeof(Pos) + 2*hdr.shards*sizeof(uint64_t)) {
+                throw std::runtime_error(filename + " is truncated");
+            }
+            shard_router ans;
+            const char* p = m->data() + sizeof(hdr);
+            auto read = [&p](auto& vec, size_t n) {
+                vec.resize(n);
+                memcpy(vec.data(), p, n*sizeof(vec[0]));
+                p += n*sizeof(vec[0]);
+            };
+            read(ans.boundaries_, hdr.shards - 1);
+            read(ans.spanning_end_, hdr.shards);
+            read(ans.sizes_, hdr.shards);
+            read(ans.spanning_sizes_, hdr.shards);
+            ans.index();
+            return ans;
+        }
+    };
+
+private:
+    shard_router router_;
+    std::vector<shard_index> shards_;
+
+public:
+    class builder {
+        std::vector<Item> items_;
+        unsigned threads_ = 1;
+
+    public:
+        builder() = default;
+
+        template<typename InputIterator>
+        builder(InputIterator begin, InputIterator end) {
+            add(begin, end);
+        }
+
+        void add(const Item& it) {
+            items_.push_back(it);
+        }
+
+        void add(Item&& it) {
+            items_.push_back(std::move(it));
+        }
+
+        template<typename InputIterator>
+        void add(InputIterator begin, InputIterator end) {
+            for (; begin != end; ++begin) {
+                add(*begin);
+            }
+        }
+
+        void reserve(size_t n) {
+            items_.reserve(n);
+        }
+
+        // number of threads for sorting the items & building the shards (concurrently)
+        builder& threads(unsigned n) {
+            threads_ = std::max(n, 1U);
+            return *this;
+        }
+
+        // build the given number of shards, each with args as for iitii::builder::build(), e.g. the
+        // number of domains of each shard's model
+        template<typename... Args>
+        iitii_sharded build(size_t shards, const Args&... args) {
+            shards = std::max(shards, size_t(1));
+            iit_parallel_sort(items_, threads_, [](const Item& lhs, const Item& rhs) {
+                const Pos lbeg = get_beg(lhs), rbeg = get_beg(rhs);
+                return lbeg < rbeg || (lbeg == rbeg && get_end(lhs) < get_end(rhs));
+            });
+            iitii_sharded ans;
+            shard_router& router = ans.router_;
+            if (items_.empty()) {
+                router.boundaries_.assign(shards-1, Pos());
+            } else {
+                router.boundaries_.reserve(shards-1);
+                iit_equal_count_boundaries(items_.size(), shards, [this](size_t i) { return get_beg(items_[i]); },
+                                           router.boundaries_);
+            }
+            router.spanning_end_.assign(shards, Pos());
+            router.sizes_.assign(shards, 0);
+            router.spanning_sizes_.assign(shards, 0);
+
+            // shard s holds the (sorted) items [offsets[s], offsets[s+1])
+            std::vector<size_t> offsets(1, 0);
+            for (size_t s = 0; s+1 < shards; ++s) {
+                const Pos b = router.boundaries_[s];
+                offsets.push_back(std::lower_bound(items_.begin() + offsets.back(), items_.end(), b,
+                                                   [](const Item& it, Pos x) { return get_beg(it) < x; })
+                                  - items_.begin());
+            }
+            offsets.push_back(items_.size());
+
+            ans.shards_.resize(shards);
+            std::atomic<size_t> next(0);
+            iit_parallel_for(shards, threads_, 1, [&](size_t, size_t) {
+                for (size_t s; (s = next++) < shards; ) {
+                    typename tree::builder ib;
+                    typename spanning_tree::builder sb;
+                    ib.reserve(offsets[s+1] - offsets[s]);
+                    for (size_t i = offsets[s]; i < offsets[s+1]; ++i) {
+                        Item& it = items_[i];
+                        if (s+1 < shards && get_end(it) > router.boundaries_[s]) {
+                            router.spanning_end_[s] = router.spanning_sizes_[s]++
+                                                          ? std::max(router.spanning_end_[s], get_end(it)) : get_end(it);
+                            sb.add(std::move(it));
+                        } else {
+                            ib.add(std::move(it));
                         }
-                        --leq;
                     }
-                    assert(nodes[leq].beg() <= node.beg());
-                    node.outside_max_end = nodes[leq].beg() < node.beg()
-                                                ? running_max_end[leq]
-                                                : std::numeric_limits<Pos>::min();
+                    router.sizes_[s] = offsets[s+1] - offsets[s];
+                    ans.shards_[s] = shard_index(ib.build_presorted(args...), sb.build_presorted());
                 }
-            }
+            });
+            items_.clear();
+            router.index();
+            return ans;
+        }
+    };
 
-            // train the rank prediction models
-            train();
+    size_t shards() const {
+        return shards_.size();
+    }
+
+    const shard_router& router() const {
+        return router_;
+    }
+
+    const shard_index& shard(size_t s) const {
+        assert(s < shards_.size());
+        return shards_[s];
+    }
+
+    size_t size() const {
+        size_t ans = 0;
+        for (size_t s = 0; s < router_.shards(); ++s) {
+            ans += router_.shard_size(s);
         }
+        return ans;
     }
 
-public:
-    // iitii::builder::build() takes a size_t argument giving the number of domains to model
-    using builder = iit_builder_base<iitii<Pos, Item, get_beg, get_end>, Item, Node, NodeArray>;
-    friend builder;
+    // overlap query fanned out to the shards routed; return the total query cost
+    size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const {
+        ans.clear();
+        std::vector<size_t> route;
+        router_.route(qbeg, qend, route);
+        size_t cost = 0;
+        std::vector<const Item*> results;
+        for (size_t s : route) {
+            cost += shards_[s].overlap(qbeg, qend, results);
+            ans.insert(ans.end(), results.begin(), results.end());
+        }
+        return cost;
+    }
 
-    size_t overlap(Pos qbeg, Pos qend, std::vector<const Item*>& ans) const override {
-        // ask model which leaf we should begin our bottom-up climb at
-        Rank prediction = predict(qbeg);
-        if (prediction == nrank) {
-            // the model did not make a prediction for some reason, so just go to the root
-            return super::overlap(qbeg, qend, ans);
+    std::vector<const Item*> overlap(Pos qbeg, Pos qend) const {
+        std::vector<const Item*> ans;
+        overlap(qbeg, qend, ans);
+        return ans;
+    }
+
+    // call f on each result, shard by shard, in the same order as overlap()
+    template<class F>
+    size_t overlap_visit(Pos qbeg, Pos qend, F&& f) const {
+        std::vector<size_t> route;
+        router_.route(qbeg, qend, route);
+        bool stopped = false;
+        size_t cost = 0;
+        for (size_t s = 0; s < route.size() && !stopped; ++s) {
+            cost += shards_[route[s]].overlap_visit(qbeg, qend, [&](const Item& it) {
+                if constexpr (std::is_void<decltype(f(it))>::value) {
+                    f(it);
+                } else {
+                    stopped = !f(it);
+                }
+                return !stopped;
+            });
         }
-        const Level k0 = level(prediction);
-        assert(k0 <= root_level);
-        __builtin_prefetch(&(nodes[parent(prediction, k0)]));
+        return cost;
+    }
 
-        // climb until our necessary & sufficient criteria are met, or the root
-        Rank subtree = prediction;
-        Level k = k0;
-        while (subtree != root &&                           // stop at root
-                (subtree >= nodes.size() ||                 // continue climb through imaginary
-                 qbeg < nodes[subtree].outside_max_end ||   // possible outside overlap from left
-                 outside_min_beg(subtree, k) < qend)) {        // possible outside overlap from right
-            subtree = parent(subtree, k++);
-            assert(k == level(subtree));
-            __builtin_prefetch(&(nodes[parent(subtree, k)]));
+    size_t overlap_count(Pos qbeg, Pos qend) const {
+        std::vector<size_t> route;
+        router_.route(qbeg, qend, route);
+        size_t ans = 0;
+        for (size_t s : route) {
+            ans += shards_[s].overlap_count(qbeg, qend);
         }
-        const auto climb_cost = k - k0;
+        return ans;
+    }
 
-        auto self = const_cast<iitii<Pos, Item, get_beg, get_end>*>(this);  // getting around const
-        self->queries++;
-        self->total_climb_cost += climb_cost;
+    bool overlap_any(Pos qbeg, Pos qend) const {
+        std::vector<size_t> route;
+        router_.route(qbeg, qend, route);
+        for (size_t s : route) {
+            if (shards_[s].overlap_any(qbeg, qend)) {
+                return true;
+            }
+        }
+        return false;
+    }
 
-        // scan the subtree for query results.
-        // pessimistically, we triple the climbing cost when adding it to the top-down search cost,
-        // because the outside_min_beg() lookup may incur two additional cache misses.
-        ans.clear();
-        return super::scan(subtree, k, qbeg, qend, ans) + 3*climb_cost;
+    static std::string router_filename(const std::string& prefix) {
+        return prefix + ".router";
+    }
+    static std::string shard_filename(const std::string& prefix, size_t s) {
+        return prefix + "." + std::to_string(s);
     }
 
-    size_t queries = 0;
-    size_t total_climb_cost = 0;
+    // save the router & every shard (see above)
+    void save(const std::string& prefix) const {
+        router_.save(router_filename(prefix));
+        for (size_t s = 0; s < shards_.size(); ++s) {
+            shards_[s].save(shard_filename(prefix, s));
+        }
+    }
 
-    using super::overlap;
+    static shard_router load_router(const std::string& prefix) {
+        return shard_router::load(router_filename(prefix));
+    }
+
+    static shard_index load_shard(const std::string& prefix, size_t s) {
+        return shard_index::load(shard_filename(prefix, s));
+    }
+
+    // load the router & all the shards, copying them into memory or (load_mmap) mapping them
+    static iitii_sharded load(const std::string& prefix) {
+        return load_(prefix, false);
+    }
+
+    static iitii_sharded load_mmap(const std::string& prefix) {
+        static_assert(iit_is_mapped_array<NodeArray<Item>>::value, "load_mmap requires NodeArray = iit_mapped_array");
+        return load_(prefix, true);
+    }
+
+private:
+    static iitii_sharded load_(const std::string& prefix, bool zero_copy) {
+        iitii_sharded ans;
+        ans.router_ = load_router(prefix);
+        for (size_t s = 0; s < ans.router_.shards(); ++s) {
+            const std::string fn = shard_filename(prefix, s);
+            if constexpr (iit_is_mapped_array<NodeArray<Item>>::value) {
+                if (zero_copy) {
+                    ans.shards_.push_back(shard_index::load_mmap(fn));
+                    continue;
+                }
+            }
+            ans.shards_.push_back(shard_index::load(fn));
+        }
+        return ans;
+    }
 };
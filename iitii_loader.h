@@ -0,0 +1,329 @@
+/*
+Parallel interval file loader for iitii (requires zlib: link with -lz)
+
+Reads BED, VCF & GTF/GFF files, plain or BGZF-compressed, on several threads into sorted runs of
+Items for the builder's build_presorted(), e.g.
+
+    iit_interval_loader loader("genes.bed.gz", iit_interval_format_of("genes.bed.gz"));
+    auto runs = loader.load<my_item>(
+        [](const iit_interval_record& rec, std::vector<my_item>& out) {
+            out.push_back({ rec.beg, rec.end });
+            return true;
+        },
+        [](const my_item& a, const my_item& b) {
+            return a.beg < b.beg || (a.beg == b.beg && a.end < b.end);
+        });
+    my_iitii::builder br;
+    iit_add_runs(br, std::move(runs));
+    auto db = br.build_presorted(1024);
+*/
+
+#pragma once
+#include "iitii.h"
+#include <string_view>
+#include <charconv>
+#include <exception>
+#include <zlib.h>
+
+// Parallel loader for BED, VCF & GTF/GFF files, plain or BGZF-compressed (bgzip, as for tabix),
+// which yields the records' Items as runs ready for the builder's build_presorted():
+//
+// 1. The file is mapped, and its BGZF blocks located by hopping from one header to the next
+//    (without decompressing anything). A plain text file is taken as 1 MiB "blocks".
+// 2. The blocks are split into chunks of about equal compressed size, each decompressed & parsed
+//    on its own thread, streaming one block at a time through a small buffer. A line belongs to
+//    the chunk holding the newline before it, so each chunk skips its partial first line & reads
+//    past its end to finish its last one.
+// 3. Each line is split in place into only as many tab-separated fields as the format's key
+//    columns need, and the key columns (contig, begin & end) parsed into an iit_interval_record
+//    of string_views into the buffer. make(const iit_interval_record&, std::vector<Item>& out)
+//    then adds the record's Items to the chunk's output (or skips it); returning false stops the
+//    chunk.
+// 4. Each chunk's Items are sorted by less (normally a no-op, for a coordinate-sorted file), so
+//    that the chunks in file order are at most max_chunks sorted runs, which build_presorted()
+//    merges without a global re-sort (for that, max_chunks mustn't exceed max_runs = 64).
+
+enum class iit_interval_format { bed, vcf, gtf };
+
+// format by file extension (ignoring .gz/.bgz): .vcf, .gtf/.gff/.gff3, or else BED
+inline iit_interval_format iit_interval_format_of(std::string fn) {
+    for (const char* ext : { ".gz", ".bgz" }) {
+        if (fn.size() > strlen(ext) && fn.compare(fn.size() - strlen(ext), std::string::npos, ext) == 0) {
+            fn.resize(fn.size() - strlen(ext));
+        }
+    }
+    const auto ext = fn.substr(std::min(fn.size(), fn.rfind('.')));
+    if (ext == ".vcf") {
+        return iit_interval_format::vcf;
+    }
+    return ext == ".gtf" || ext == ".gff" || ext == ".gff3" ? iit_interval_format::gtf : iit_interval_format::bed;
+}
+
+// One record's key columns as a 0-based, half-open interval on the named contig, plus the line's
+// fields (string_views into the loader's buffer, valid only during the make() call). Only the
+// first few fields are split off: BED chrom, start, end & name, VCF CHROM, POS, ID, REF & ALT, and
+// GTF seqname through end; the last field holds the rest of the line.
+struct iit_interval_record {
+    static const size_t max_fields = 6;
+    std::string_view contig;
+    int64_t beg, end;
+    std::string_view fields[max_fields];
+    size_t nfields;
+};
+
+class iit_interval_loader {
+    std::shared_ptr<const iit_file_mapping> map_;
+    std::string filename_;
+    iit_interval_format format_;
+    bool bgzf_ = false;
+    // blocks: offset of each block in the file, and of its data when decompressed (plus the
+    // total sizes at the end)
+    std::vector<uint64_t> offsets_, uoffsets_;
+
+    static uint32_t le(const unsigned char* p, size_t bytes) {
+        uint32_t ans = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            ans |= uint32_t(p[i]) << (8*i);
+        }
+        return ans;
+    }
+
+    [[noreturn]] void corrupt() const {
+        throw std::runtime_error(filename_ + ": corrupt BGZF file");
+    }
+
+    // locate the blocks
+    void index() {
+        const auto data = reinterpret_cast<const unsigned char*>(map_->data());
+        const uint64_t size = map_->size();
+        bgzf_ = size >= 2 && data[0] == 31 && data[1] == 139;
+        offsets_.push_back(0);
+        uoffsets_.push_back(0);
+        if (!bgzf_) {
+            for (uint64_t ofs = 0; ofs < size; ) {
+                ofs = std::min(size, ofs + (uint64_t(1) << 20));
+                offsets_.push_back(ofs);
+                uoffsets_.push_back(ofs);
+            }
+            return;
+        }
+        for (uint64_t ofs = 0; ofs < size; ) {
+            // gzip member header with the BGZF extra subfield 'BC' giving the block size - 1
+            const unsigned char* h = data + ofs;
+            if (size - ofs < 26 || h[0] != 31 || h[1] != 139 || h[2] != 8 || !(h[3] & 4)) {
+                throw std::runtime_error(filename_ + " isn't BGZF-compressed (try bgzip)");
+            }
+            const uint32_t xlen = le(h+10, 2);
+            uint32_t bsize = 0;
+            for (uint32_t x = 0; x + 4 <= xlen; x += 4 + le(h+12+x+2, 2)) {
+                if (h[12+x] == 'B' && h[12+x+1] == 'C' && le(h+12+x+2, 2) == 2) {
+                    bsize = le(h+12+x+4, 2) + 1;
+                }
+            }
+            if (!bsize || bsize < 12 + xlen + 8 || bsize > size - ofs) {
+                throw std::runtime_error(filename_ + " isn't BGZF-compressed (try bgzip)");
+            }
+            offsets_.push_back(ofs += bsize);
+            uoffsets_.push_back(uoffsets_.back() + le(data + ofs - 4, 4));
+        }
+    }
+
+    // append the decompressed block b to buf
+    void read_block(size_t b, std::vector<char>& buf, z_stream& zs) const {
+        const size_t n = uoffsets_[b+1] - uoffsets_[b], tail = buf.size();
+        buf.resize(tail + n);
+        const auto block = reinterpret_cast<const unsigned char*>(map_->data()) + offsets_[b];
+        if (!bgzf_) {
+            memcpy(buf.data() + tail, block, n);
+            return;
+        }
+        if (!n) {
+            return;  // e.g. the EOF marker block
+        }
+        const uint32_t xlen = le(block+10, 2);
+        if (inflateReset(&zs) != Z_OK) {
+            corrupt();
+        }
+        zs.next_in = const_cast<unsigned char*>(block + 12 + xlen);
+        zs.avail_in = uInt(offsets_[b+1] - offsets_[b] - 12 - xlen - 8);
+        zs.next_out = reinterpret_cast<unsigned char*>(buf.data() + tail);
+        zs.avail_out = uInt(n);
+        if (inflate(&zs, Z_FINISH) != Z_STREAM_END || zs.avail_out) {
+            corrupt();
+        }
+    }
+
+    // split line into the record's fields & parse its key columns; false for a header/comment
+    bool parse(std::string_view line, iit_interval_record& rec) const {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line[0] == '#' || line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0) {
+            return false;
+        }
+        const size_t want = format_ == iit_interval_format::bed ? 5 : iit_interval_record::max_fields;
+        rec.nfields = 0;
+        while (rec.nfields+1 < want) {
+            const size_t tab = line.find('\t');
+            if (tab == std::string_view::npos) {
+                break;
+            }
+            rec.fields[rec.nfields++] = line.substr(0, tab);
+            line.remove_prefix(tab+1);
+        }
+        rec.fields[rec.nfields++] = line;
+
+        auto malformed = [&]() {
+            const std::string_view head = rec.fields[0].substr(0, 100);
+            throw std::runtime_error(filename_ + ": malformed line beginning " + std::string(head));
+        };
+        auto number = [&](size_t i) {
+            int64_t ans = 0;
+            if (i >= rec.nfields) {
+                malformed();
+            }
+            const std::string_view f = rec.fields[i];
+            const auto res = std::from_chars(f.data(), f.data() + f.size(), ans);
+            if (f.empty() || res.ec != std::errc() || res.ptr != f.data() + f.size()) {
+                malformed();
+            }
+            return ans;
+        };
+        rec.contig = rec.fields[0];
+        switch (format_) {
+        case iit_interval_format::bed:
+            rec.beg = number(1);
+            rec.end = number(2);
+            break;
+        case iit_interval_format::vcf:
+            // 1-based POS, spanning the REF allele
+            rec.beg = number(1) - 1;
+            if (rec.nfields < 5) {
+                malformed();
+            }
+            rec.end = rec.beg + int64_t(rec.fields[3].size());
+            break;
+        case iit_interval_format::gtf:
+            // 1-based, closed
+            rec.beg = number(3) - 1;
+            rec.end = number(4);
+            break;
+        }
+        return true;
+    }
+
+    // decompress & parse the lines belonging to the chunk of blocks [b0, b1) (see above)
+    template<class Item, class Make>
+    void load_chunk(size_t b0, size_t b1, Make& make, std::vector<Item>& out) const {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -15) != Z_OK) {
+            throw std::runtime_error("inflateInit2");
+        }
+        std::unique_ptr<z_stream, int(*)(z_stream*)> zs_end(&zs, inflateEnd);
+
+        const uint64_t owned_end = uoffsets_[b1];  // the last line owned begins at most here
+        uint64_t base = uoffsets_[b0];              // file position of buf[0]
+        bool skip = b0 > 0, done = false;
+        std::vector<char> buf;
+        iit_interval_record rec;
+        auto line = [&](const char* p, size_t n) {
+            if (skip) {
+                skip = false;
+            } else if (parse(std::string_view(p, n), rec) && !make(rec, out)) {
+                done = true;
+            }
+        };
+        for (size_t b = b0; b+1 < offsets_.size() && !done; ++b) {
+            read_block(b, buf, zs);
+            size_t cursor = 0;
+            while (!done) {
+                if (base + cursor > owned_end) {
+                    done = true;
+                    break;
+                }
+                const char* nl = static_cast<const char*>(memchr(buf.data() + cursor, '\n', buf.size() - cursor));
+                if (!nl) {
+                    break;
+                }
+                line(buf.data() + cursor, nl - (buf.data() + cursor));
+                cursor = nl + 1 - buf.data();
+            }
+            buf.erase(buf.begin(), buf.begin() + cursor);
+            base += cursor;
+        }
+        if (!done && !buf.empty() && base <= owned_end) {
+            line(buf.data(), buf.size());  // final line without a newline
+        }
+    }
+
+public:
+    iit_interval_loader(const std::string& filename, iit_interval_format format)
+        : map_(iit_file_mapping::open(filename)), filename_(filename), format_(format) {
+        index();
+    }
+
+    size_t blocks() const {
+        return offsets_.size() - 1;
+    }
+
+    // total size of the file's (decompressed) text
+    uint64_t text_size() const {
+        return uoffsets_.back();
+    }
+
+    // load the Items in chunks as described above, using up to threads threads
+    template<class Item, class Make, class Less>
+    std::vector<std::vector<Item>> load(Make make, Less less, unsigned threads = std::thread::hardware_concurrency(),
+                              size_t max_chunks = 64) const {
+        threads = std::max(threads, 1U);
+        const size_t chunks = std::max(size_t(1), std::min({ blocks(), size_t(4)*threads, max_chunks }));
+        // chunk c holds the blocks [bounds[c], bounds[c+1]), splitting the file at about equal offsets
+        std::vector<size_t> bounds(chunks+1, blocks());
+        bounds[0] = 0;
+        for (size_t c = 1; c < chunks; ++c) {
+            const uint64_t target = map_->size()*c/chunks;
+            bounds[c] = std::max(bounds[c-1], size_t(std::lower_bound(offsets_.begin(), offsets_.end(), target) - offsets_.begin()));
+            bounds[c] = std::min(bounds[c], blocks());
+        }
+
+        std::vector<std::vector<Item>> ans(chunks);
+        std::vector<std::exception_ptr> errors(chunks);
+        iit_parallel_for(chunks, threads, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                try {
+                    if (bounds[c] < bounds[c+1]) {
+                        load_chunk(bounds[c], bounds[c+1], make, ans[c]);
+                        if (!std::is_sorted(ans[c].begin(), ans[c].end(), less)) {
+                            std::sort(ans[c].begin(), ans[c].end(), less);
+                        }
+                    }
+                } catch (...) {
+                    errors[c] = std::current_exception();
+                }
+            }
+        });
+        for (const auto& e : errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+        return ans;
+    }
+};
+
+// add the loaded runs to builder, in order (then to be built by build_presorted())
+template<class Builder, class Item>
+void iit_add_runs(Builder& builder, std::vector<std::vector<Item>>&& runs) {
+    size_t n = 0;
+    for (const auto& run : runs) {
+        n += run.size();
+    }
+    builder.reserve(n);
+    for (auto& run : runs) {
+        for (auto& it : run) {
+            builder.add(std::move(it));
+        }
+        std::vector<Item>().swap(run);
+    }
+}
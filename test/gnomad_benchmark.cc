@@ -2,6 +2,14 @@
 #include <fstream>
 #include <random>
 
+// double model weights, to compare the default float weights' climb costs with on full-length
+// chromosomes (where positions run far past float's 24-bit significand)
+struct double_weight_tuning : iitii_tuning {
+    template<typename Pos>
+    using weight = double;
+};
+using variant_iitii_double = iitii<int, variant, variant_beg, variant_end, std::vector, iitii_stats_none, iit_aos, double_weight_tuning>;
+
 template <class tree>
 size_t run_queries(const vector<variant>& variants, const tree& t, int max_end, int queries, size_t& cost) {
     default_random_engine R(42);
@@ -28,6 +36,58 @@ size_t run_queries(const vector<variant>& variants, const tree& t, int max_end,
     return ans;
 }
 
+// same query workload as run_queries, issued through overlap_batch in batches of 4096 queries
+// with the given number of queries in flight
+template <class tree>
+size_t run_batch_queries(const vector<variant>& variants, const tree& t, int max_end, int queries,
+                         size_t inflight, size_t& cost) {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, max_end);
+    uniform_int_distribution<size_t> vtD(0, variants.size()-1);
+    const size_t batch = 4096;
+    vector<int> qbegs, qends;
+    vector<size_t> offsets;
+    vector<const variant*> results;
+    size_t ans = 0;
+    cost = 0;
+    for (int i = 0; i < queries; i++) {
+        if (i % 2 == 1) {
+            const auto& vt = variants.at(vtD(R));
+            qbegs.push_back(vt.beg);
+            qends.push_back(vt.end);
+        } else {
+            qbegs.push_back(begD(R));
+            qends.push_back(qbegs.back()+10);
+        }
+        if (qbegs.size() == batch || i == queries-1) {
+            cost += t.overlap_batch(qbegs.data(), qends.data(), qbegs.size(), offsets, results,
+                                    inflight);
+            ans += results.size();
+            qbegs.clear();
+            qends.clear();
+        }
+    }
+    return ans;
+}
+
+template <class tree, typename... Args>
+size_t run_batch_experiment(const vector<variant>& variants, const size_t N, size_t inflight,
+                            uint32_t& queries_ms, size_t& cost, Args&&... args) {
+    vector<variant> variantsN(variants.begin(), variants.begin()+N);
+    int max_end = -1;
+    for (const auto& vt : variantsN) {
+        max_end = std::max(max_end, vt.end);
+    }
+    auto t = typename tree::builder(variantsN.begin(), variantsN.end()).build_presorted(forward<Args>(args)...);
+
+    cost = 0;
+    size_t result_count = 0;
+    queries_ms = milliseconds_to([&](){
+        result_count = run_batch_queries<tree>(variantsN, t, max_end, 40000000, inflight, cost);
+    });
+    return result_count;
+}
+
 template <class tree, typename... Args>
 size_t run_experiment(const vector<variant>& variants, const size_t N,
                       uint32_t& build_ms, uint32_t& queries_ms, size_t& cost, Args&&... args) {
@@ -38,7 +98,8 @@ size_t run_experiment(const vector<variant>& variants, const size_t N,
     }
     unique_ptr<tree> ptree;
     build_ms = milliseconds_to([&](){
-        auto t = typename tree::builder(variantsN.begin(), variantsN.end()).build(forward<Args>(args)...);
+        // main() loaded the variants as sorted runs, which build_presorted() merges
+        auto t = typename tree::builder(variantsN.begin(), variantsN.end()).build_presorted(forward<Args>(args)...);
         ptree.reset(new tree(move(t)));
     });
 
@@ -61,29 +122,28 @@ int main(int argc, char** argv) {
     const int megabases = 24;
     #endif
 
-    ifstream vcf(filename), tbi(filename + ".tbi");
-    if (!(vcf.good() && tbi.good())) {
+    ifstream vcf(filename);
+    if (!vcf.good()) {
         cerr << "This program requires " << filename
-             << " and .tbi to be present. Download them to that location from " << url << endl;
+             << " to be present. Download it to that location from " << url << endl;
         return 1;
     }
 
-    auto variants = load_variants_parallel(filename, 0, megabases);
+    // the loader yields the variants as a few sorted runs, in file order, so they needn't be
+    // sorted again: build_presorted() merges the runs of each prefix variantsN
+    vector<variant> variants;
+    uint32_t load_ms = milliseconds_to([&](){
+        for (auto& run : load_variant_runs(filename, 0, megabases)) {
+            variants.insert(variants.end(), make_move_iterator(run.begin()), make_move_iterator(run.end()));
+        }
+    });
     int max_len = -1, max_end = -1;
     for (const auto& vt : variants) {
         max_len = max(max_len, vt.end - vt.beg);
         max_end = max(max_end, vt.end);
     }
     cerr << variants.size() << " variants, max END = " << max_end
-         << ", max rlen = " << max_len << endl;
-
-    std::sort(variants.begin(), variants.end(), [](const variant& lhs, const variant& rhs) {
-        auto begl = lhs.beg, begr = rhs.beg;
-        if (begl == begr) {
-            return lhs.end < rhs.end;
-        }
-        return begl < begr;
-    });
+         << ", max rlen = " << max_len << ", load_ms = " << load_ms << endl;
 
     cout << "#tree_type\tN\tbuild_ms\tqueries_ms\tqueries_cost\tresult_count" << endl;
     for(size_t N = variants.size(); N >= 10000; N /= 4) {
@@ -96,6 +156,50 @@ int main(int argc, char** argv) {
                 throw runtime_error("RED ALERT: inconsistent results");
             }
             cout << "iitii(" << domains << ")\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+            // the same with double model weights
+            if (result_count != run_experiment<variant_iitii_double>(variants, N, build_ms, queries_ms, cost, domains)) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << "iitii_double(" << domains << ")\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+            // equal-count domain partitioning
+            if (result_count != run_experiment<variant_iitii>(variants, N, build_ms, queries_ms, cost, domains, iitii_partition::equal_count)) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << "iitii_ec(" << domains << ")\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        }
+        // automatically selected domains
+        if (result_count != run_experiment<variant_iitii>(variants, N, build_ms, queries_ms, cost, iitii_auto_domains())) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+        cout << "iitii(auto)\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        // structure-of-arrays layout
+        if (result_count != run_experiment<variant_iit_soa>(variants, N, build_ms, queries_ms, cost)) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+        cout << "iit_soa\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        if (result_count != run_experiment<variant_iitii_soa>(variants, N, build_ms, queries_ms, cost, 4096)) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+        cout << "iitii_soa(4096)\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        // plus Eytzinger-ordered top levels
+        if (result_count != run_experiment<variant_iit_eytzinger>(variants, N, build_ms, queries_ms, cost)) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+        cout << "iit_soa_eytzinger\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        if (result_count != run_experiment<variant_iitii_eytzinger>(variants, N, build_ms, queries_ms, cost, 4096)) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+        cout << "iitii_soa_eytzinger(4096)\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        // batched queries with varying numbers in flight (build_ms not measured)
+        for (size_t inflight = 1; inflight <= 16; inflight *= 4) {
+            if (result_count != run_batch_experiment<variant_iit>(variants, N, inflight, queries_ms, cost)) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << "iit_batch" << inflight << "\t" << N << "\t\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+            if (result_count != run_batch_experiment<variant_iitii>(variants, N, inflight, queries_ms, cost, 4096)) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << "iitii(4096)_batch" << inflight << "\t" << N << "\t\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
         }
     }
 
@@ -15,6 +15,18 @@ uint32_t ideal_end(const ideal_item& it) { return it.end; }
 using ideal_iit = iit<uint32_t, ideal_item, ideal_beg, ideal_end>;
 using ideal_iitii = iitii<uint32_t, ideal_item, ideal_beg, ideal_end>;
 
+// compile-time specialized variants (see iitii_tuning & iit_leaf_blocks)
+struct ideal_pow2_tuning : iitii_tuning {
+    static constexpr bool pow2_domains = true;
+};
+struct ideal_double_tuning : iitii_tuning {
+    template<typename Pos>
+    using weight = double;
+};
+using ideal_iitii_pow2 = iitii<uint32_t, ideal_item, ideal_beg, ideal_end, std::vector, iitii_stats_none, iit_aos, ideal_pow2_tuning>;
+using ideal_iitii_double = iitii<uint32_t, ideal_item, ideal_beg, ideal_end, std::vector, iitii_stats_none, iit_aos, ideal_double_tuning>;
+using ideal_iitii_leaf_cache = iitii<uint32_t, ideal_item, ideal_beg, ideal_end, std::vector, iitii_stats_none, iit_leaf_blocks<iit_aos>>;
+
 vector<ideal_item> generate(size_t N) {
     // each item ranked i has begin position 10*i, with geometrically distributed length mean 20.
     default_random_engine R(42);
@@ -78,6 +90,17 @@ int main(int argc, char** argv) {
             throw runtime_error("RED ALERT: inconsistent results");
         }
         cout << "iitii\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+
+        auto report = [&](const string& name, size_t variant_results) {
+            if (result_count != variant_results) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << name << "\t" << N << "\t" << build_ms << "\t" << queries_ms << "\t" << cost << "\t" << result_count << endl;
+        };
+        report("iitii(1024)", run_experiment<ideal_iitii>(items, build_ms, queries_ms, cost, 1024));
+        report("iitii_pow2(1024)", run_experiment<ideal_iitii_pow2>(items, build_ms, queries_ms, cost, 1024));
+        report("iitii_double(1024)", run_experiment<ideal_iitii_double>(items, build_ms, queries_ms, cost, 1024));
+        report("iitii_leaf_cache(1024)", run_experiment<ideal_iitii_leaf_cache>(items, build_ms, queries_ms, cost, 1024));
     }
 
     return 0;
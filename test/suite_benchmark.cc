@@ -0,0 +1,623 @@
+// benchmark suite comparing the index variants on several workloads resembling real annotation
+// tracks, rather than the uniform synthetic data of ideal_benchmark.cc:
+//   clustered       items concentrated around hotspots of Zipf-distributed popularity, with
+//                   heavy-tailed (Pareto) lengths
+//   long_intervals  short reads mixed with gene-like (lognormal) and structural-variant-like
+//                   (log-uniform up to 5 Mbp) intervals, the case that defeats iit's max_end pruning
+//   many_contigs    thousands of contigs of power-law sizes, as in unplaced-scaffold assemblies
+// plus any BED or GTF/GFF files named on the command line. Each is queried with point stabs,
+// short windows & wide windows, half of them anchored at random items and half uniform across
+// the genome. For each tree type we report the build time, the peak & retained heap bytes per
+// item during/after the build, and for each query mix the throughput and p50/p99/p999 latency,
+// at 1, 2, 4, ... threads sharing the index (latencies pooled across the threads). Then, each
+// dataset is intersected with a set of short intervals by queries & by join(). Then, the
+// nearest item to each point stab is found by nearest(), and by overlap queries over windows
+// widening until one has results. Finally, the item counts & depth in 1 kbp windows across the
+// whole position range are computed by a query per window, and by the coverage() sweep.
+//
+// usage: suite_benchmark [-n items] [-q queries] [-t max_threads] [intervals.bed|genes.gtf ...]
+//
+// Multi-contig data are indexed as one position range with the contigs laid end to end, except
+// by iitii_genome which gets one tree per contig. The updatable index is built from 90% of the
+// items, with the other 10% then inserted (included in its build time) and queried as is.
+
+#include "util.h"
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <optional>
+#include <malloc.h>
+
+// heap accounting: the global allocation functions are replaced to track the live & peak bytes
+static std::atomic<size_t> heap_live(0), heap_peak(0);
+
+static void* heap_note(void* p) {
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    const size_t live = heap_live += malloc_usable_size(p);
+    size_t peak = heap_peak.load();
+    while (live > peak && !heap_peak.compare_exchange_weak(peak, live));
+    return p;
+}
+
+static void* heap_aligned(size_t n, std::align_val_t al) {
+    const size_t a = size_t(al);
+    return heap_note(aligned_alloc(a, (std::max(n, size_t(1)) + a - 1) / a * a));
+}
+
+static void heap_free(void* p) noexcept {
+    if (p) {
+        heap_live -= malloc_usable_size(p);
+        free(p);
+    }
+}
+
+void* operator new(size_t n) { return heap_note(malloc(std::max(n, size_t(1)))); }
+void* operator new[](size_t n) { return heap_note(malloc(std::max(n, size_t(1)))); }
+void* operator new(size_t n, std::align_val_t al) { return heap_aligned(n, al); }
+void* operator new[](size_t n, std::align_val_t al) { return heap_aligned(n, al); }
+void operator delete(void* p) noexcept { heap_free(p); }
+void operator delete[](void* p) noexcept { heap_free(p); }
+void operator delete(void* p, size_t) noexcept { heap_free(p); }
+void operator delete[](void* p, size_t) noexcept { heap_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { heap_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { heap_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { heap_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { heap_free(p); }
+
+struct suite_item {
+    uint32_t beg;
+    uint32_t end;
+    uint32_t rid;
+};
+
+uint32_t suite_beg(const suite_item& it) { return it.beg; }
+uint32_t suite_end(const suite_item& it) { return it.end; }
+size_t suite_rid(const suite_item& it) { return it.rid; }
+
+using suite_iit = iit<uint32_t, suite_item, suite_beg, suite_end>;
+using suite_iit_soa = iit<uint32_t, suite_item, suite_beg, suite_end, std::vector, iit_soa>;
+using suite_iit_eytzinger = iit<uint32_t, suite_item, suite_beg, suite_end, std::vector, iit_eytzinger<iit_soa>>;
+using suite_iitii = iitii<uint32_t, suite_item, suite_beg, suite_end>;
+using suite_iitii_soa = iitii<uint32_t, suite_item, suite_beg, suite_end, std::vector, iitii_stats_none, iit_soa>;
+using suite_iitii_compact = iitii<uint32_t, suite_item, suite_beg, suite_end, std::vector, iitii_stats_none, iit_compact<uint16_t>>;
+using suite_iitii_eytzinger = iitii<uint32_t, suite_item, suite_beg, suite_end, std::vector, iitii_stats_none, iit_eytzinger<iit_soa>>;
+using suite_genome = iitii_genome<uint32_t, suite_item, suite_beg, suite_end, suite_rid>;
+using suite_genome_sharded = iitii_genome<uint32_t, suite_item, suite_beg, suite_end, suite_rid, iitii_stats_sharded>;
+using suite_updatable = iitii_updatable<uint32_t, suite_item, suite_beg, suite_end>;
+using suite_hybrid = iitii_hybrid<uint32_t, suite_item, suite_beg, suite_end>;
+using suite_iitii_hugepage = iitii<uint32_t, suite_item, suite_beg, suite_end, iit_hugepage_array>;
+
+// items & contigs of one workload. Item positions are offset by their contig's start in the
+// concatenated position range.
+struct dataset {
+    string name;
+    vector<uint32_t> contig_offsets;  // start of each contig, plus the total length at the end
+    vector<suite_item> items;
+};
+
+// clamp [beg, beg+len) to contig rid and add it
+void add_item(dataset& ds, size_t rid, int64_t beg, int64_t len) {
+    const int64_t contig_len = int64_t(ds.contig_offsets[rid+1]) - ds.contig_offsets[rid];
+    beg = std::max(int64_t(0), std::min(beg, contig_len - 1));
+    const int64_t end = std::min(beg + std::max(len, int64_t(1)), contig_len);
+    ds.items.push_back({uint32_t(ds.contig_offsets[rid] + beg), uint32_t(ds.contig_offsets[rid] + end), uint32_t(rid)});
+}
+
+dataset generate_clustered(size_t N) {
+    const uint32_t genome_len = 250000000;
+    const size_t hotspots = 2000;
+    default_random_engine R(42);
+    dataset ans{"clustered", {0, genome_len}, {}};
+    uniform_int_distribution<uint32_t> centerD(0, genome_len-1);
+    vector<uint32_t> centers;
+    vector<double> popularity;
+    for (size_t i = 0; i < hotspots; i++) {
+        centers.push_back(centerD(R));
+        popularity.push_back(1.0/(i+1));
+    }
+    discrete_distribution<size_t> hotspotD(popularity.begin(), popularity.end());
+    normal_distribution<double> offsetD(0, 10000);
+    uniform_real_distribution<double> U(0, 1);
+    for (size_t i = 0; i < N; i++) {
+        // Pareto lengths with shape 1.2 from 20 bp, capped at 1 Mbp
+        const double len = std::min(20.0*pow(1.0 - U(R), -1.0/1.2), 1e6);
+        add_item(ans, 0, int64_t(centers[hotspotD(R)] + offsetD(R)), int64_t(len));
+    }
+    return ans;
+}
+
+dataset generate_long_intervals(size_t N) {
+    const uint32_t genome_len = 250000000;
+    default_random_engine R(42);
+    dataset ans{"long_intervals", {0, genome_len}, {}};
+    uniform_int_distribution<uint32_t> begD(0, genome_len-1);
+    geometric_distribution<uint32_t> readD(1.0/150);
+    lognormal_distribution<double> geneD(log(20000.0), 1.0);
+    uniform_real_distribution<double> svD(log(50.0), log(5e6));
+    uniform_real_distribution<double> U(0, 1);
+    for (size_t i = 0; i < N; i++) {
+        const double kind = U(R);
+        double len;
+        if (kind < 0.6) {
+            len = readD(R);
+        } else if (kind < 0.9) {
+            len = std::min(geneD(R), 2.5e6);
+        } else {
+            len = exp(svD(R));
+        }
+        add_item(ans, 0, begD(R), int64_t(len));
+    }
+    return ans;
+}
+
+dataset generate_many_contigs(size_t N) {
+    const size_t contigs = 3000;
+    default_random_engine R(42);
+    dataset ans{"many_contigs", {0}, {}};
+    vector<double> lengths;
+    for (size_t i = 0; i < contigs; i++) {
+        lengths.push_back(std::max(1000.0, 250e6/pow(i+1, 1.3)));
+        ans.contig_offsets.push_back(ans.contig_offsets.back() + uint32_t(lengths.back()));
+    }
+    discrete_distribution<size_t> ridD(lengths.begin(), lengths.end());
+    geometric_distribution<uint32_t> lenD(0.01);
+    for (size_t i = 0; i < N; i++) {
+        const size_t rid = ridD(R);
+        uniform_int_distribution<uint32_t> begD(0, uint32_t(lengths[rid])-1);
+        add_item(ans, rid, begD(R), lenD(R));
+    }
+    return ans;
+}
+
+// load the intervals of a BED file, or of a GTF/GFF file (by its extension), numbering the
+// contigs in order of first appearance; each contig's length is taken to be its greatest end.
+dataset load_intervals(const string& fn) {
+    ifstream in(fn);
+    if (!in) {
+        throw runtime_error("couldn't open " + fn);
+    }
+    const auto ext = fn.substr(std::min(fn.size(), fn.rfind('.')));
+    const bool gff = ext == ".gtf" || ext == ".gff" || ext == ".gff3";
+    unordered_map<string, size_t> rids;
+    vector<uint64_t> contig_lens;
+    vector<tuple<size_t, uint64_t, uint64_t>> intervals;
+    string line, chrom, field;
+    for (size_t lineno = 1; getline(in, line); lineno++) {
+        if (line.empty() || line[0] == '#' || line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0) {
+            continue;
+        }
+        istringstream fields(line);
+        vector<string> cols;
+        while (cols.size() < 5 && getline(fields, field, '\t')) {
+            cols.push_back(field);
+        }
+        uint64_t beg, end;
+        try {
+            if (gff && cols.size() >= 5) {
+                // 1-based, closed
+                beg = stoull(cols[3]) - 1;
+                end = stoull(cols[4]);
+            } else if (!gff && cols.size() >= 3) {
+                beg = stoull(cols[1]);
+                end = stoull(cols[2]);
+            } else {
+                throw invalid_argument("too few columns");
+            }
+        } catch (std::logic_error&) {
+            throw runtime_error(fn + ": malformed line " + to_string(lineno));
+        }
+        auto rid = rids.emplace(cols[0], rids.size()).first->second;
+        if (rid == contig_lens.size()) {
+            contig_lens.push_back(0);
+        }
+        contig_lens[rid] = std::max(contig_lens[rid], end);
+        intervals.emplace_back(rid, beg, end);
+    }
+
+    dataset ans{fn.substr(fn.rfind('/') + 1), {0}, {}};
+    uint64_t total = 0;
+    for (auto len : contig_lens) {
+        total += len + 1;
+        if (total > numeric_limits<uint32_t>::max()) {
+            throw runtime_error(fn + ": the contigs are too long for 32-bit positions");
+        }
+        ans.contig_offsets.push_back(uint32_t(total));
+    }
+    for (const auto& iv : intervals) {
+        add_item(ans, get<0>(iv), get<1>(iv), int64_t(get<2>(iv)) - int64_t(get<1>(iv)));
+    }
+    return ans;
+}
+
+// a query in both the concatenated position range and its contig's own coordinates
+struct suite_query {
+    uint32_t beg, end;
+    size_t rid;
+    uint32_t local_beg, local_end;
+};
+
+struct query_mix {
+    string name;
+    uint32_t min_len, max_len;  // query lengths are log-uniform in [min_len, max_len]
+    size_t queries;
+};
+
+vector<suite_query> generate_queries(const dataset& ds, const query_mix& mix, unsigned seed) {
+    default_random_engine R(seed);
+    uniform_int_distribution<size_t> itemD(0, ds.items.size()-1);
+    uniform_int_distribution<uint32_t> posD(0, ds.contig_offsets.back()-1);
+    uniform_real_distribution<double> lenD(log(double(mix.min_len)), log(double(mix.max_len)));
+    vector<suite_query> ans;
+    for (size_t i = 0; i < mix.queries; i++) {
+        const uint32_t len = uint32_t(exp(lenD(R)) + 0.5);
+        uint32_t beg = posD(R);
+        if (i%2 == 0) {
+            const auto& it = ds.items[itemD(R)];
+            beg = it.beg - std::min(it.beg, len/2);
+        }
+        suite_query q;
+        q.rid = std::upper_bound(ds.contig_offsets.begin(), ds.contig_offsets.end(), beg) - ds.contig_offsets.begin() - 1;
+        beg = std::max(beg, ds.contig_offsets[q.rid]);
+        q.beg = beg;
+        q.end = std::min(uint64_t(beg) + len, uint64_t(ds.contig_offsets[q.rid+1]));
+        q.local_beg = q.beg - ds.contig_offsets[q.rid];
+        q.local_end = q.end - ds.contig_offsets[q.rid];
+        ans.push_back(q);
+    }
+    return ans;
+}
+
+struct config {
+    size_t N = 1 << 22;
+    size_t queries = 1 << 20;
+    size_t max_threads = std::max(1U, thread::hardware_concurrency());
+};
+
+struct query_result {
+    double queries_per_sec;
+    double p50_ns, p99_ns, p999_ns;
+    size_t result_count;
+};
+
+// run all the queries on each of the threads concurrently (each starting at a different point
+// in the list); time each query
+template <class tree, class Query>
+query_result run_queries(const tree& t, const vector<suite_query>& queries, size_t threads, Query& query) {
+    vector<thread> workers;
+    vector<vector<uint32_t>> latencies(threads);
+    size_t result_count = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+            vector<const suite_item*> results;
+            auto& ns = latencies[i];
+            ns.reserve(queries.size());
+            size_t ans = 0;
+            for (size_t j = 0, k = i*queries.size()/threads; j < queries.size(); j++, k = (k+1)%queries.size()) {
+                auto q0 = chrono::steady_clock::now();
+                query(t, queries[k], results);
+                auto q1 = chrono::steady_clock::now();
+                ns.push_back(uint32_t(std::min(chrono::duration_cast<chrono::nanoseconds>(q1 - q0).count(),
+                                               int64_t(numeric_limits<uint32_t>::max()))));
+                ans += results.size();
+            }
+            if (i == 0) {
+                result_count = ans;
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    vector<uint32_t> ns;
+    for (const auto& l : latencies) {
+        ns.insert(ns.end(), l.begin(), l.end());
+    }
+    std::sort(ns.begin(), ns.end());
+    auto pct = [&ns](double p) { return double(ns[std::min(ns.size()-1, size_t(p*ns.size()))]); };
+    return {threads*queries.size()/std::max(secs, 1e-9), pct(0.5), pct(0.99), pct(0.999), result_count};
+}
+
+// build with build(), measuring its time & heap footprint, then run each query mix at each
+// thread count. The result counts must agree with those of the first tree type run on the
+// dataset, which are recorded in expected_results.
+template <class Build, class Query>
+void run_experiment(const string& name, const dataset& ds, const vector<vector<suite_query>>& mixes_queries,
+                    const vector<query_mix>& mixes, const config& cfg, vector<size_t>& expected_results,
+                    Build build, Query query) {
+    const size_t heap0 = heap_live;
+    heap_peak = heap0;
+    auto t0 = chrono::steady_clock::now();
+    std::optional<decltype(build())> t;
+    try {
+        t.emplace(build());
+    } catch (std::runtime_error& exn) {
+        cerr << "# " << ds.name << " " << name << " skipped: " << exn.what() << endl;
+        return;
+    }
+    const double build_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    const double peak_per_item = double(heap_peak - heap0)/ds.items.size();
+    const double retained_per_item = double(heap_live - heap0)/ds.items.size();
+
+    for (size_t m = 0; m < mixes.size(); m++) {
+        for (size_t threads = 1; threads <= cfg.max_threads; threads *= 2) {
+            auto res = run_queries(*t, mixes_queries[m], threads, query);
+            if (expected_results.size() <= m) {
+                expected_results.push_back(res.result_count);
+            } else if (expected_results[m] != res.result_count) {
+                throw runtime_error("RED ALERT: inconsistent results");
+            }
+            cout << ds.name << "\t" << name << "\t" << ds.items.size() << "\t" << size_t(build_ms) << "\t"
+                 << peak_per_item << "\t" << retained_per_item << "\t" << mixes[m].name << "\t" << threads << "\t"
+                 << mixes_queries[m].size() << "\t" << size_t(res.queries_per_sec) << "\t" << res.p50_ns << "\t"
+                 << res.p99_ns << "\t" << res.p999_ns << "\t" << res.result_count << endl;
+        }
+    }
+}
+
+template <class tree>
+void run_tree(const string& name, const dataset& ds, const vector<vector<suite_query>>& mixes_queries,
+              const vector<query_mix>& mixes, const config& cfg, vector<size_t>& expected_results) {
+    run_experiment(name, ds, mixes_queries, mixes, cfg, expected_results,
+        [&]() { return typename tree::builder(ds.items.begin(), ds.items.end()).build(); },
+        [](const tree& t, const suite_query& q, vector<const suite_item*>& results) {
+            t.overlap(q.beg, q.end, results);
+        });
+}
+
+template <class tree, typename... Args>
+void run_iitii(const string& name, const dataset& ds, const vector<vector<suite_query>>& mixes_queries,
+               const vector<query_mix>& mixes, const config& cfg, vector<size_t>& expected_results,
+               Args... args) {
+    run_experiment(name, ds, mixes_queries, mixes, cfg, expected_results,
+        [&]() { return typename tree::builder(ds.items.begin(), ds.items.end()).build(args...); },
+        [](const tree& t, const suite_query& q, vector<const suite_item*>& results) {
+            t.overlap(q.beg, q.end, results);
+        });
+}
+
+void run_dataset(const dataset& ds, const config& cfg) {
+    // wide windows return many results each, so fewer of them are run
+    const vector<query_mix> mixes = {
+        {"stab", 1, 1, cfg.queries},
+        {"short", 50, 2000, cfg.queries},
+        {"wide", 100000, 1000000, std::max(cfg.queries/64, size_t(1))}
+    };
+    vector<vector<suite_query>> mixes_queries;
+    for (size_t m = 0; m < mixes.size(); m++) {
+        mixes_queries.push_back(generate_queries(ds, mixes[m], unsigned(m)));
+    }
+    vector<size_t> expected_results;
+
+    run_tree<suite_iit>("iit", ds, mixes_queries, mixes, cfg, expected_results);
+    run_tree<suite_iit_soa>("iit_soa", ds, mixes_queries, mixes, cfg, expected_results);
+    run_tree<suite_iit_eytzinger>("iit_eytzinger", ds, mixes_queries, mixes, cfg, expected_results);
+    for (size_t domains : {1, 1024, 65536}) {
+        run_iitii<suite_iitii>("iitii(" + to_string(domains) + ")", ds, mixes_queries, mixes, cfg, expected_results,
+                               domains);
+    }
+    run_iitii<suite_iitii>("iitii_equal_count(1024)", ds, mixes_queries, mixes, cfg, expected_results,
+                           1024, iitii_partition::equal_count);
+    run_iitii<suite_iitii>("iitii_auto", ds, mixes_queries, mixes, cfg, expected_results, iitii_auto_domains());
+    run_iitii<suite_iitii_soa>("iitii_soa(1024)", ds, mixes_queries, mixes, cfg, expected_results, 1024);
+    run_iitii<suite_iitii_compact>("iitii_compact16(1024)", ds, mixes_queries, mixes, cfg, expected_results, 1024);
+    run_iitii<suite_iitii_eytzinger>("iitii_eytzinger(1024)", ds, mixes_queries, mixes, cfg, expected_results, 1024);
+    run_iitii<suite_iitii_hugepage>("iitii_hugepage(1024)", ds, mixes_queries, mixes, cfg, expected_results, 1024);
+    run_iitii<suite_hybrid>("iitii_hybrid(1024)", ds, mixes_queries, mixes, cfg, expected_results, 1024);
+
+    vector<suite_item> local_items(ds.items);
+    for (auto& it : local_items) {
+        it.beg -= ds.contig_offsets[it.rid];
+        it.end -= ds.contig_offsets[it.rid];
+    }
+    run_experiment("iitii_genome(1024)", ds, mixes_queries, mixes, cfg, expected_results,
+        [&]() { return suite_genome::builder(local_items.begin(), local_items.end()).build(1024); },
+        [](const suite_genome& t, const suite_query& q, vector<const suite_item*>& results) {
+            t.overlap(q.rid, q.local_beg, q.local_end, results);
+        });
+    // with statistics, which the contigs share
+    run_experiment("iitii_genome_stats_sharded(1024)", ds, mixes_queries, mixes, cfg, expected_results,
+        [&]() { return suite_genome_sharded::builder(local_items.begin(), local_items.end()).build(1024); },
+        [](const suite_genome_sharded& t, const suite_query& q, vector<const suite_item*>& results) {
+            t.overlap(q.rid, q.local_beg, q.local_end, results);
+        });
+
+    const size_t base_items = ds.items.size() - ds.items.size()/10;
+    run_experiment("iitii_updatable(1024)", ds, mixes_queries, mixes, cfg, expected_results,
+        [&]() {
+            suite_updatable ans(suite_iitii::builder(ds.items.begin(), ds.items.begin() + base_items).build(1024));
+            for (auto it = ds.items.begin() + base_items; it != ds.items.end(); ++it) {
+                ans.insert(*it);
+            }
+            ans.wait();
+            return ans;
+        },
+        [](const suite_updatable& t, const suite_query& q, vector<const suite_item*>& results) {
+            t.overlap(q.beg, q.end, results);
+        });
+}
+
+// intersect the dataset with a set of short intervals (those of the short-window query mix), by
+// one query per interval and by the sweep join of two indexes
+void run_join(const dataset& ds, const config& cfg) {
+    const query_mix mix = {"short", 50, 2000, cfg.queries};
+    vector<suite_item> others;
+    for (const auto& q : generate_queries(ds, mix, 42)) {
+        others.push_back({q.beg, q.end, uint32_t(q.rid)});
+    }
+    auto a = suite_iitii::builder(ds.items.begin(), ds.items.end()).build(1024);
+    auto b = suite_iit::builder(others.begin(), others.end()).build();
+    auto report = [&](const string& method, size_t threads, double ms, size_t pairs) {
+        cout << ds.name << "\t" << method << "\t" << ds.items.size() << "\t" << others.size() << "\t"
+             << threads << "\t" << size_t(ms) << "\t" << pairs << endl;
+    };
+
+    size_t expected = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (const auto& it : others) {
+        expected += a.overlap_count(it.beg, it.end);
+    }
+    report("iitii(1024)_queries", 1, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(), expected);
+
+    for (size_t threads = 1; threads <= cfg.max_threads; threads *= 2) {
+        std::atomic<size_t> pairs(0);
+        t0 = chrono::steady_clock::now();
+        a.join(b, [&pairs](const suite_item&, const suite_item&) { pairs.fetch_add(1, memory_order_relaxed); }, threads);
+        report("join", threads, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(), pairs);
+        if (pairs != expected) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+    }
+}
+
+// distance of an item from pos, as defined by iit_base::k_nearest
+uint32_t nearest_distance(const suite_item& it, uint32_t pos) {
+    return it.beg > pos ? it.beg - pos : it.end > pos ? 0 : pos - it.end + 1;
+}
+
+// find the nearest item to each point stab by nearest(), and by the widening overlap windows
+// it replaces; report the time & the sum of the nearest distances (which must agree)
+void run_nearest(const dataset& ds, const config& cfg) {
+    const query_mix mix = {"point", 1, 1, cfg.queries};
+    const auto queries = generate_queries(ds, mix, 42);
+    auto report = [&](const string& method, double ms, size_t cost, uint64_t dist) {
+        cout << ds.name << "\t" << method << "\t" << ds.items.size() << "\t" << queries.size() << "\t"
+             << size_t(ms) << "\t" << double(cost)/queries.size() << "\t" << dist << endl;
+    };
+    auto iit_tree = suite_iit::builder(ds.items.begin(), ds.items.end()).build();
+    auto iitii_tree = suite_iitii::builder(ds.items.begin(), ds.items.end()).build(1024);
+    vector<const suite_item*> results;
+
+    uint64_t expected = 0;
+    size_t cost = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (const auto& q : queries) {
+        uint32_t best = numeric_limits<uint32_t>::max();
+        // a window of radius w holds every item within distance w of the query position
+        for (uint32_t w = 1000; best == numeric_limits<uint32_t>::max(); w *= 2) {
+            cost += iitii_tree.overlap(q.beg >= w ? q.beg - w : 0, q.beg + w + 1, results);
+            for (auto p : results) {
+                best = std::min(best, nearest_distance(*p, q.beg));
+            }
+            if (w >= ds.contig_offsets.back()) {
+                break;
+            }
+        }
+        expected += best;
+    }
+    report("iitii(1024)_widening", chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(), cost, expected);
+
+    auto run = [&](const string& method, const auto& t) {
+        uint64_t dist = 0;
+        size_t cost = 0;
+        auto t0 = chrono::steady_clock::now();
+        for (const auto& q : queries) {
+            cost += t.k_nearest(q.beg, 1, results);
+            dist += nearest_distance(*results[0], q.beg);
+        }
+        report(method, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(), cost, dist);
+        if (dist != expected) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+    };
+    run("iit_nearest", iit_tree);
+    run("iitii(1024)_nearest", iitii_tree);
+}
+
+// per-window item counts & depth across the position range, by an overlap query per window and
+// by the coverage() sweep at 1, 2, 4, ... threads; report the time & the total item count and
+// depth (which must agree)
+void run_coverage(const dataset& ds, const config& cfg) {
+    const uint32_t window = 1000, len = ds.contig_offsets.back();
+    auto t = suite_iitii::builder(ds.items.begin(), ds.items.end()).build(1024);
+    auto report = [&](const string& method, size_t threads, double ms, size_t items, uint64_t depth) {
+        cout << ds.name << "\t" << method << "\t" << ds.items.size() << "\t" << (len + window - 1)/window << "\t"
+             << threads << "\t" << size_t(ms) << "\t" << items << "\t" << depth << endl;
+    };
+
+    size_t items = 0;
+    uint64_t depth = 0;
+    vector<const suite_item*> results;
+    auto t0 = chrono::steady_clock::now();
+    for (uint32_t b = 0; b < len; b += window) {
+        const uint32_t e = std::min(len, b + window);
+        t.overlap(b, e, results);
+        items += results.size();
+        for (auto p : results) {
+            depth += std::min(e, p->end) - std::max(b, p->beg);
+        }
+    }
+    report("iitii(1024)_queries", 1, chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count(), items, depth);
+
+    vector<iit_coverage_window<uint32_t>> out;
+    for (size_t threads = 1; threads <= cfg.max_threads; threads *= 2) {
+        t0 = chrono::steady_clock::now();
+        t.coverage(0, len, window, out, threads);
+        const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        size_t cov_items = 0;
+        uint64_t cov_depth = 0;
+        for (const auto& w : out) {
+            cov_items += w.items;
+            cov_depth += w.depth_sum;
+        }
+        report("iitii(1024)_coverage", threads, ms, cov_items, cov_depth);
+        if (cov_items != items || cov_depth != depth) {
+            throw runtime_error("RED ALERT: inconsistent results");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    config cfg;
+    vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if ((arg == "-n" || arg == "-q" || arg == "-t") && i+1 < argc) {
+            const size_t v = std::max(size_t(1), size_t(stoull(argv[++i])));
+            (arg == "-n" ? cfg.N : arg == "-q" ? cfg.queries : cfg.max_threads) = v;
+        } else if (arg[0] == '-') {
+            cerr << "usage: suite_benchmark [-n items] [-q queries] [-t max_threads] [intervals.bed|genes.gtf ...]" << endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    cout << "#dataset\ttree_type\tN\tbuild_ms\tbuild_peak_bytes_per_item\tindex_bytes_per_item\tquery_mix\tthreads\t"
+         << "queries\tqueries_per_sec\tp50_ns\tp99_ns\tp999_ns\tresult_count" << endl;
+    vector<dataset> datasets;
+    datasets.push_back(generate_clustered(cfg.N));
+    datasets.push_back(generate_long_intervals(cfg.N));
+    datasets.push_back(generate_many_contigs(cfg.N));
+    for (const auto& fn : files) {
+        auto ds = load_intervals(fn);
+        if (!ds.items.empty()) {
+            datasets.push_back(std::move(ds));
+        }
+    }
+    for (const auto& ds : datasets) {
+        run_dataset(ds, cfg);
+    }
+
+    cout << "#dataset\tjoin_method\tN\tM\tthreads\tjoin_ms\tpairs" << endl;
+    for (const auto& ds : datasets) {
+        run_join(ds, cfg);
+    }
+
+    cout << "#dataset\tnearest_method\tN\tqueries\tqueries_ms\tmean_cost\tdistance_sum" << endl;
+    for (const auto& ds : datasets) {
+        run_nearest(ds, cfg);
+    }
+
+    cout << "#dataset\tcoverage_method\tN\twindows\tthreads\tcoverage_ms\titems\tdepth_sum" << endl;
+    for (const auto& ds : datasets) {
+        run_coverage(ds, cfg);
+    }
+
+    return 0;
+}
@@ -1,6 +1,9 @@
 #include "util.h"
 #include <random>
 #include <math.h>
+#include <sstream>
+#include <mutex>
+#include <fstream>
 #define CATCH_CONFIG_MAIN
 #include "catch2/catch.hpp"
 
@@ -25,6 +28,21 @@ auto build_iitii(const vector<pospair>& examples, size_t domains) {
     return iitii<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(domains);
 }
 
+// the default layout with Layout's leaf level (which may be deeper for iit_soa, with the
+// vectorized leaf kernel), so that the query costs compare
+template<class Layout>
+using default_layout_like = iit_leaf_blocks<iit_aos, Layout::template leaf_level<pos>>;
+
+template<class Layout>
+auto build_iit_like(const vector<pospair>& examples) {
+    return typename iit<pos, pospair, &get_beg, &get_end, std::vector, default_layout_like<Layout>>::builder(examples.begin(), examples.end()).build();
+}
+
+template<class Layout>
+auto build_iitii_like(const vector<pospair>& examples, size_t domains) {
+    return typename iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, default_layout_like<Layout>>::builder(examples.begin(), examples.end()).build(domains);
+}
+
 TEST_CASE("cgranges example") {
     auto tree = build_iit({ { 12, 34 }, { 0, 23 }, { 34, 56 } });
 
@@ -155,35 +173,2140 @@ TEST_CASE("fuzz") {
     }
 }
 
-TEST_CASE("gnomAD chr2") {
-    const int rid = 0;
-    #ifdef NDEBUG
-    const int megabases = 244;
-    #else
-    const int megabases = 24;
-    #endif
-    // Newer gnomAD versions have far larger files but not that many additional variants (a lot more metadata)
-    const string filename = "/tmp/gnomad.genomes.r2.0.2.sites.chr2.vcf.bgz";
-    const string url = "https://storage.googleapis.com/gnomad-public/release/2.0.2/vcf/genomes/gnomad.genomes.r2.0.2.sites.chr2.vcf.bgz";
+TEST_CASE("structure-of-arrays layout") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
 
-    ifstream vcf(filename), tbi(filename + ".tbi");
-    if (!(vcf.good() && tbi.good())) {
-        WARN("Skipping test because " + filename + " and .tbi aren't present. Download them to that location from " + url);
-    } else {
-        auto variants = load_variants_parallel(filename, rid, megabases);
-        int max_len = -1, max_end = -1;
-        for (const auto& vt : variants) {
-            max_len = std::max(max_len, vt.end - vt.beg);
-            max_end = std::max(max_end, vt.end);
+    for (int N = 10; N < 200000; N *= 7) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
         }
-        cout << "Loaded " << variants.size() << " variants from first " << megabases << "Mbp, max len =  " << max_len << endl;
+        const size_t domains = N >= 100 ? 10 : 1;
+        auto tree = build_iit_like<iit_soa>(examples);
+        auto treeii = build_iitii_like<iit_soa>(examples, domains);
+        auto tree_soa = iit<pos, pospair, &get_beg, &get_end, std::vector, iit_soa>::builder(examples.begin(), examples.end()).build();
+        auto treeii_soa = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_soa>::builder(examples.begin(), examples.end()).build(domains);
+
+        // same results & costs as the default layout
+        bool alleq = true;
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            auto qend = qbeg + (i%3 ? 42 : 1000);
+            vector<const pospair*> ans, ans_soa;
+            alleq = alleq && tree.overlap(qbeg, qend, ans) == tree_soa.overlap(qbeg, qend, ans_soa);
+            alleq = alleq && ans.size() == ans_soa.size() && equal(ans.begin(), ans.end(), ans_soa.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+            alleq = alleq && treeii.overlap(qbeg, qend, ans) == treeii_soa.overlap(qbeg, qend, ans_soa);
+            alleq = alleq && ans.size() == ans_soa.size() && equal(ans.begin(), ans.end(), ans_soa.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+            alleq = alleq && treeii.overlap_count(qbeg, qend) == treeii_soa.overlap_count(qbeg, qend);
+        }
+        REQUIRE(alleq);
+    }
+}
+
+template<class Layout>
+bool same_as_default_layout(const vector<pospair>& examples, size_t domains, const vector<pair<pos,pos>>& queries) {
+    auto tree = build_iit_like<Layout>(examples);
+    auto treeii = build_iitii_like<Layout>(examples, domains);
+    auto tree_l = typename iit<pos, pospair, &get_beg, &get_end, std::vector, Layout>::builder(examples.begin(), examples.end()).build();
+    auto treeii_l = typename iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, Layout>::builder(examples.begin(), examples.end()).build(domains);
+
+    bool alleq = true;
+    auto same = [](const vector<const pospair*>& a1, const vector<const pospair*>& a2) {
+        return a1.size() == a2.size() && equal(a1.begin(), a1.end(), a2.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+    };
+    vector<pos> qbegs, qends;
+    for (const auto& q : queries) {
+        vector<const pospair*> ans, ans_l;
+        alleq = alleq && tree.overlap(q.first, q.second, ans) == tree_l.overlap(q.first, q.second, ans_l) && same(ans, ans_l);
+        alleq = alleq && treeii.overlap(q.first, q.second, ans) == treeii_l.overlap(q.first, q.second, ans_l) && same(ans, ans_l);
+        qbegs.push_back(q.first);
+        qends.push_back(q.second);
+    }
+    vector<size_t> offsets, offsets_l;
+    vector<const pospair*> items, items_l;
+    alleq = alleq && treeii.overlap_batch(qbegs.data(), qends.data(), qbegs.size(), offsets, items) ==
+                     treeii_l.overlap_batch(qbegs.data(), qends.data(), qbegs.size(), offsets_l, items_l);
+    alleq = alleq && offsets == offsets_l && same(items, items_l);
+    return alleq;
+}
+
+TEST_CASE("Eytzinger top levels") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N = 0; N < 300000; N = N*5+1) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        vector<pair<pos,pos>> queries;
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 1000) });
+        }
+        const size_t domains = N >= 100 ? 10 : 1;
+        // top levels in the side array, across the tree heights
+        REQUIRE(same_as_default_layout<iit_eytzinger<>>(examples, domains, queries));
+        REQUIRE(same_as_default_layout<iit_eytzinger<iit_soa, 5>>(examples, domains, queries));
+        REQUIRE(same_as_default_layout<iit_eytzinger<iit_aos, 64>>(examples, domains, queries));
+    }
+}
+
+// 64-bit positions, for the compact layout
+template<template<class> class NodeArray>
+bool same_as_default_array(const vector<pospair>& examples, size_t domains, const vector<pair<pos,pos>>& queries) {
+    auto treeii = build_iitii(examples, domains);
+    auto treeii_a = typename iitii<pos, pospair, &get_beg, &get_end, NodeArray>::builder(examples.begin(), examples.end()).build(domains);
+    auto treeii_soa = typename iitii<pos, pospair, &get_beg, &get_end, NodeArray, iitii_stats_none, iit_soa>::builder(examples.begin(), examples.end()).build(domains);
+    bool alleq = true;
+    vector<const pospair*> ans, ans_a;
+    for (const auto& q : queries) {
+        alleq = alleq && treeii.overlap(q.first, q.second, ans) == treeii_a.overlap(q.first, q.second, ans_a);
+        alleq = alleq && ans.size() == ans_a.size() && equal(ans.begin(), ans.end(), ans_a.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+        treeii_soa.overlap(q.first, q.second, ans_a);
+        alleq = alleq && ans.size() == ans_a.size() && equal(ans.begin(), ans.end(), ans_a.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+    }
+    return alleq;
+}
+
+TEST_CASE("node storage allocators") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 10000000);
+    geometric_distribution<uint16_t> lenD(0.01);
+    vector<pair<pos,pos>> queries;
+    for (int i = 0; i < 1000; ++i) {
+        auto qbeg = begD(R);
+        queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 10000) });
+    }
+
+    // small arrays use operator new, large ones are mapped
+    REQUIRE(iit_hugepage_allocator<uint64_t>::mapped_bytes(1000) == 0);
+    REQUIRE(iit_hugepage_allocator<uint64_t>::mapped_bytes(1000000) == size_t(8) << 20);
+    iit_hugepage_array<uint64_t> big(1000000, 42);
+    REQUIRE(reinterpret_cast<uintptr_t>(big.data()) % (size_t(1) << 21) == 0);
+    REQUIRE(big[999999] == 42);
+
+    iit_arena arena(size_t(1) << 20);
+    for (int N : { 0, 1000, 300000 }) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        REQUIRE(same_as_default_array<iit_hugepage_array>(examples, 100, queries));
+        REQUIRE(same_as_default_array<iit_arena_array>(examples, 100, queries));
+        {
+            iit_arena::scope scope(arena);
+            REQUIRE(iit_arena::current() == &arena);
+            REQUIRE(same_as_default_array<iit_arena_array>(examples, 100, queries));
+            const size_t capacity = arena.capacity();
+            // the scratch arrays of repeated builds reuse the arena's memory
+            REQUIRE(same_as_default_array<std::vector>(examples, 100, queries));
+            REQUIRE(same_as_default_array<std::vector>(examples, 100, queries));
+            REQUIRE(arena.capacity() == capacity);
+        }
+        REQUIRE(iit_arena::current() == nullptr);
+        arena.reset();
+
+        // NUMA replicas, detected and with a made-up topology of two nodes on the CPU at hand
+        auto treeii = build_iitii(examples, 100);
+        iit_numa_replicated<decltype(treeii)> local(build_iitii(examples, 100));
+        REQUIRE(local.replicas() == iit_numa_topology::detect().node_cpus.size());
+        iit_numa_topology two;
+        const unsigned cpu = unsigned(std::max(sched_getcpu(), 0));
+        two.node_cpus = { { cpu }, { cpu } };
+        iit_numa_replicated<decltype(treeii)> replicated(build_iitii(examples, 100), two);
+        REQUIRE(replicated.replicas() == 2);
+        REQUIRE((examples.empty() || &replicated.replica(0).item_at(0) != &replicated.replica(1).item_at(0)));
+        static_assert(!decltype(treeii)::shared_storage && iitii<pos, pospair, get_beg, get_end, iit_mapped_array>::shared_storage, "");
+        bool alleq = true;
+        vector<const pospair*> ans, ans_r;
+        for (const auto& q : queries) {
+            treeii.overlap(q.first, q.second, ans);
+            for (size_t node = 0; node < 2; ++node) {
+                replicated.replica(node).overlap(q.first, q.second, ans_r);
+                alleq = alleq && ans.size() == ans_r.size() && equal(ans.begin(), ans.end(), ans_r.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; });
+            }
+            alleq = alleq && replicated.overlap_count(q.first, q.second) == ans.size()
+                          && local.overlap(q.first, q.second).size() == ans.size()
+                          && local.overlap_any(q.first, q.second) == !ans.empty();
+        }
+        REQUIRE(alleq);
+        REQUIRE(&replicated.replica(0) != &replicated.replica(1));
+    }
+    REQUIRE(iit_numa_topology::parse_list("0-3,8,10-11") == vector<unsigned>({ 0, 1, 2, 3, 8, 10, 11 }));
+}
+
+struct pos64_item {
+    uint64_t beg, end;
+};
+uint64_t pos64_item_beg(const pos64_item& it) { return it.beg; }
+uint64_t pos64_item_end(const pos64_item& it) { return it.end; }
+
+template<class tree1, class tree2>
+bool same_items(const tree1& t1, const tree2& t2, uint64_t qbeg, uint64_t qend) {
+    auto a1 = t1.overlap(qbeg, qend), a2 = t2.overlap(qbeg, qend);
+    return a1.size() == a2.size() &&
+           equal(a1.begin(), a1.end(), a2.begin(), [](const auto* p1, const auto* p2) { return *p1 == *p2; });
+}
+
+TEST_CASE("compact keys") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N = 10; N < 200000; N *= 7) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        examples.push_back({ 1000, 66535 });    // longest length that fits in 16 bits
+        const size_t domains = N >= 100 ? 10 : 1;
+
+        // with 16-bit offsets, many of the augmentation values saturate; the results must still
+        // be identical (though the costs may be higher)
+        auto tree = build_iit(examples);
+        auto treeii = build_iitii(examples, domains);
+        auto tree_c = iit<pos, pospair, &get_beg, &get_end, std::vector, iit_compact<uint16_t>>::builder(examples.begin(), examples.end()).build();
+        auto treeii_c = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_compact<uint16_t>>::builder(examples.begin(), examples.end()).build(domains);
+        auto treeii_ce = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_eytzinger<iit_compact<uint16_t>>>::builder(examples.begin(), examples.end()).build(domains);
+        bool alleq = true;
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            auto qend = qbeg + (i%3 ? 42 : 1000);
+            alleq = alleq && same_items(tree, tree_c, qbeg, qend) && same_items(treeii, treeii_c, qbeg, qend) &&
+                    same_items(treeii, treeii_ce, qbeg, qend);
+            alleq = alleq && treeii.overlap_count(qbeg, qend) == treeii_c.overlap_count(qbeg, qend);
+        }
+        REQUIRE(alleq);
+    }
+
+    // items too long for the offsets
+    vector<pospair> too_long = { { 0, 10 }, { 1000, 66536 } };
+    REQUIRE_THROWS(iit<pos, pospair, &get_beg, &get_end, std::vector, iit_compact<uint16_t>>::builder(too_long.begin(), too_long.end()).build());
+
+    // 64-bit positions far from zero, with 32-bit offsets which don't saturate here: the same
+    // results & costs as iit_soa
+    uniform_int_distribution<uint64_t> beg64D(1000000000000ULL, 1000000000000ULL + 10000000);
+    vector<pos64_item> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = beg64D(R);
+        examples.push_back({ beg, beg+lenD(R) });
+    }
+    using tree64 = iitii<uint64_t, pos64_item, pos64_item_beg, pos64_item_end, std::vector, iitii_stats_none, iit_soa>;
+    using tree64_c = iitii<uint64_t, pos64_item, pos64_item_beg, pos64_item_end, std::vector, iitii_stats_none, iit_compact<>>;
+    auto t = tree64::builder(examples.begin(), examples.end()).build(100);
+    auto t_c = tree64_c::builder(examples.begin(), examples.end()).build(100);
+    bool alleq = true;
+    for (size_t i = 0; i < 10000; ++i) {
+        auto qbeg = beg64D(R);
+        auto qend = qbeg + (i%3 ? 42 : 1000);
+        vector<const pos64_item*> ans, ans_c;
+        alleq = alleq && t.overlap(qbeg, qend, ans) == t_c.overlap(qbeg, qend, ans_c) && ans.size() == ans_c.size();
+        for (size_t j = 0; alleq && j < ans.size(); ++j) {
+            alleq = ans[j]->beg == ans_c[j]->beg && ans[j]->end == ans_c[j]->end;
+        }
+    }
+    REQUIRE(alleq);
+}
+
+TEST_CASE("leaf scan kernel") {
+    // positions around the sign bit & near the top of the range, for the vectorized comparisons
+    default_random_engine R(42);
+    geometric_distribution<uint32_t> lenD(0.05);
+    for (uint32_t base : { 0U, 2147483000U, 4294000000U }) {
+        uniform_int_distribution<uint32_t> begD(base, base + 20000);
+        vector<pospair> examples;
+        for (int i = 0; i < 5000; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg + 1 + lenD(R) });
+        }
+        vector<pair<pos,pos>> queries;
+        for (size_t i = 0; i < 2000; ++i) {
+            auto qbeg = begD(R);
+            queries.push_back({ qbeg, qbeg + (i%3 ? 1 : 100) });
+        }
+        REQUIRE(same_as_default_layout<iit_soa>(examples, 4, queries));
+
+        // and against brute force
+        auto tree_soa = iit<pos, pospair, &get_beg, &get_end, std::vector, iit_soa>::builder(examples.begin(), examples.end()).build();
+        bool alleq = true;
+        for (const auto& q : queries) {
+            size_t naive = 0;
+            for (const auto& p : examples) {
+                naive += q.first < p.second && p.first < q.second;
+            }
+            alleq = alleq && tree_soa.overlap_count(q.first, q.second) == naive;
+        }
+        REQUIRE(alleq);
+    }
+}
+
+// trivially copyable item type, for save/load
+struct pos_item {
+    pos beg, end;
+    bool operator==(const pos_item& rhs) const {
+        return beg == rhs.beg && end == rhs.end;
+    }
+};
+pos pos_item_beg(const pos_item& it) { return it.beg; }
+pos pos_item_end(const pos_item& it) { return it.end; }
+
+template<class tree1, class tree2>
+bool same_results(const tree1& t1, const tree2& t2, const vector<pair<pos,pos>>& queries) {
+    for (const auto& q : queries) {
+        vector<const pos_item*> ans1, ans2;
+        if (t1.overlap(q.first, q.second, ans1) != t2.overlap(q.first, q.second, ans2) ||
+            ans1.size() != ans2.size() ||
+            !equal(ans1.begin(), ans1.end(), ans2.begin(), [](const pos_item* p1, const pos_item* p2) { return *p1 == *p2; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<class Layout>
+void test_save_load(const vector<pos_item>& examples, const vector<pair<pos,pos>>& queries, const string& filename) {
+    using tree_t = iit<pos, pos_item, pos_item_beg, pos_item_end, std::vector, Layout>;
+    using mapped_tree_t = iit<pos, pos_item, pos_item_beg, pos_item_end, iit_mapped_array, Layout>;
+    using treeii_t = iitii<pos, pos_item, pos_item_beg, pos_item_end, std::vector, iitii_stats_none, Layout>;
+    using mapped_treeii_t = iitii<pos, pos_item, pos_item_beg, pos_item_end, iit_mapped_array, iitii_stats_none, Layout>;
+
+    auto tree = typename tree_t::builder(examples.begin(), examples.end()).build();
+    tree.save(filename);
+    REQUIRE(same_results(tree, tree_t::load(filename), queries));
+    REQUIRE(same_results(tree, mapped_tree_t::load_mmap(filename), queries));
+    REQUIRE_THROWS(treeii_t::load(filename));
+
+    auto treeii = typename treeii_t::builder(examples.begin(), examples.end()).build(10);
+    treeii.save(filename);
+    REQUIRE(same_results(treeii, treeii_t::load(filename), queries));
+    // files of any other format version are rejected
+    {
+        fstream f(filename, ios::in | ios::out | ios::binary);
+        const uint32_t other = iit_file_header::VERSION + 1;
+        f.seekp(offsetof(iit_file_header, version));
+        f.write(reinterpret_cast<const char*>(&other), sizeof(other));
+    }
+    REQUIRE_THROWS(treeii_t::load(filename));
+    auto treeii_ec = typename treeii_t::builder(examples.begin(), examples.end()).build(10, iitii_partition::equal_count);
+    treeii_ec.save(filename);
+    REQUIRE(same_results(treeii_ec, treeii_t::load(filename), queries));
+    REQUIRE(same_results(treeii_ec, mapped_treeii_t::load_mmap(filename), queries));
+    treeii.save(filename);
+    auto mapped = mapped_treeii_t::load_mmap(filename);
+    treeii.save(filename + ".iit");
+    REQUIRE(same_results(treeii, mapped, queries));
+    // the mapping stays valid for copies of the tree (even after the file is deleted)
+    unlink(filename.c_str());
+    unique_ptr<mapped_treeii_t> copy(new mapped_treeii_t(mapped));
+    mapped = mapped_treeii_t::load_mmap(filename + ".iit");
+    REQUIRE(same_results(treeii, *copy, queries));
+    REQUIRE(same_results(treeii, mapped, queries));
+    unlink((filename + ".iit").c_str());
+}
+
+struct pow2_tuning : iitii_tuning {
+    static constexpr bool pow2_domains = true;
+};
+struct double_weight_tuning : iitii_tuning {
+    template<typename Pos>
+    using weight = double;
+};
+struct model_tuning : iitii_tuning {
+    template<typename Pos>
+    using weight = double;
+    static constexpr unsigned train_levels[] = {0, 2, 4, 8};
+    static constexpr size_t climb_cost_factor = 1;
+};
+
+template<class tree1, class tree2>
+bool same_pospairs(const tree1& t1, const tree2& t2, const vector<pair<pos,pos>>& queries) {
+    vector<const pospair*> ans1, ans2;
+    for (const auto& q : queries) {
+        t1.overlap(q.first, q.second, ans1);
+        t2.overlap(q.first, q.second, ans2);
+        if (ans1.size() != ans2.size() || !equal(ans1.begin(), ans1.end(), ans2.begin(), [](const pospair* p1, const pospair* p2) { return *p1 == *p2; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("compile-time tuning") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 4200000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    REQUIRE(iit_cache_leaf_level(16) == 3);
+    REQUIRE(iit_cache_leaf_level(24) == 2);
+    REQUIRE(iit_cache_leaf_level(8) == 4);
+    REQUIRE(iit_cache_leaf_level(1000) == 1);
+#ifndef IITII_LEAF_LEVEL
+    // the deeper leaf level goes with the vectorized leaf kernel
+    REQUIRE(iit_soa::leaf_level<uint32_t> == (iit_simd_leaf_mask<uint32_t>() ? 3 : 2));
+    REQUIRE(iit_eytzinger<iit_soa>::leaf_level<int32_t> == (iit_simd_leaf_mask<int32_t>() ? 3 : 2));
+    REQUIRE(iit_soa::leaf_level<uint64_t> == 2);
+    REQUIRE(iit_soa::leaf_level<float> == 2);
+    REQUIRE(iit_aos::leaf_level<uint32_t> == 2);
+    REQUIRE(iit_compact<>::leaf_level<uint64_t> == 2);
+#endif
+#ifdef __AVX2__
+    REQUIRE(iit_simd_leaf_mask<uint32_t>());
+#endif
+
+    for (int N = 0; N < 300000; N = N*5+1) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        vector<pair<pos,pos>> queries;
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 1000) });
+        }
+        auto tree = build_iit(examples);
+
+        // leaf block sizes
+        REQUIRE(same_pospairs(tree, iit<pos, pospair, &get_beg, &get_end, std::vector, iit_leaf_blocks<iit_aos, 1>>::builder(examples.begin(), examples.end()).build(), queries));
+        REQUIRE(same_pospairs(tree, iit<pos, pospair, &get_beg, &get_end, std::vector, iit_leaf_blocks<iit_soa, 4>>::builder(examples.begin(), examples.end()).build(), queries));
+        REQUIRE(same_pospairs(tree, iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_leaf_blocks<iit_eytzinger<iit_soa>>>::builder(examples.begin(), examples.end()).build(10), queries));
+
+        // power-of-two domains, and other model settings
+        for (size_t domains : { 1, 10, 64 }) {
+            auto pow2 = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_aos, pow2_tuning>::builder(examples.begin(), examples.end()).build(domains);
+            REQUIRE(same_pospairs(tree, pow2, queries));
+            auto report = pow2.model_report();
+            for (size_t d = 1; N > 1 && d < report.domains.size(); ++d) {
+                const uint64_t width = uint64_t(report.domains[d].origin - report.domains[d-1].origin);
+                REQUIRE((width & (width-1)) == 0);
+            }
+            auto tuned = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_soa, model_tuning>::builder(examples.begin(), examples.end()).build(domains);
+            REQUIRE(same_pospairs(tree, tuned, queries));
+            for (const auto& d : tuned.model_report().domains) {
+                REQUIRE((d.level == -1 || d.level == 0 || d.level == 2 || d.level == 4 || d.level == 8));
+            }
+        }
+    }
+
+    // an index saved with one domain width loads only with matching tuning
+    vector<pos_item> items;
+    for (int i = 0; i < 1000; ++i) {
+        auto beg = begD(R);
+        items.push_back({ beg, pos(beg+lenD(R)) });
+    }
+    vector<pair<pos,pos>> queries = { { 0, 5000000 }, { 100000, 100100 } };
+    const string filename = "/tmp/test_iitii_tuning." + to_string(getpid());
+    using pow2_t = iitii<pos, pos_item, pos_item_beg, pos_item_end, std::vector, iitii_stats_none, iit_aos, pow2_tuning>;
+    iitii<pos, pos_item, pos_item_beg, pos_item_end>::builder(items.begin(), items.end()).build(7).save(filename);
+    REQUIRE_THROWS(pow2_t::load(filename));
+    auto pow2 = pow2_t::builder(items.begin(), items.end()).build(7);
+    pow2.save(filename);
+    REQUIRE(same_results(pow2, pow2_t::load(filename), queries));
+    unlink(filename.c_str());
+}
+
+TEST_CASE("save, load & load_mmap") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+    const string filename = "/tmp/test_iitii." + to_string(getpid());
+
+    for (int N = 0; N < 200000; N = N*7+10) {
+        vector<pos_item> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        vector<pair<pos,pos>> queries;
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 1000) });
+        }
+        test_save_load<iit_aos>(examples, queries, filename);
+        test_save_load<iit_soa>(examples, queries, filename);
+        test_save_load<iit_eytzinger<>>(examples, queries, filename);
+        test_save_load<iit_compact<uint16_t>>(examples, queries, filename);
+    }
+}
+
+TEST_CASE("overlap_batch") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N = 10; N < 200000; N *= 7) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        auto tree = build_iit(examples);
+        auto treeii = build_iitii(examples, N >= 100 ? 10 : 1);
+
+        const size_t Q = 1000;
+        vector<pos> qbegs, qends;
+        for (size_t i = 0; i < Q; ++i) {
+            qbegs.push_back(begD(R));
+            qends.push_back(qbegs.back() + (i%3 ? 42 : 1000));
+        }
+
+        for (size_t inflight : {1, 4, 16}) {
+            vector<size_t> offsets, offsetsii;
+            vector<const pospair*> items, itemsii;
+            size_t cost = tree.overlap_batch(qbegs.data(), qends.data(), Q, offsets, items, inflight);
+            size_t costii = treeii.overlap_batch(qbegs.data(), qends.data(), Q, offsetsii, itemsii, inflight);
+            REQUIRE(offsets.size() == Q+1);
+            REQUIRE(offsetsii.size() == Q+1);
+            REQUIRE(offsets[Q] == items.size());
+            REQUIRE(offsetsii[Q] == itemsii.size());
+
+            // results and costs are the same as for one-at-a-time queries
+            size_t cost1 = 0, costii1 = 0;
+            bool alleq = true;
+            for (size_t i = 0; i < Q; ++i) {
+                vector<const pospair*> ans, ansii;
+                cost1 += tree.overlap(qbegs[i], qends[i], ans);
+                costii1 += treeii.overlap(qbegs[i], qends[i], ansii);
+                alleq = alleq && ans == vector<const pospair*>(items.begin()+offsets[i], items.begin()+offsets[i+1]);
+                alleq = alleq && ansii == vector<const pospair*>(itemsii.begin()+offsetsii[i], itemsii.begin()+offsetsii[i+1]);
+            }
+            REQUIRE(alleq);
+            REQUIRE(cost == cost1);
+            REQUIRE(costii == costii1);
+        }
+    }
+}
+
+template<class tree>
+void test_visit(const tree& t, pos qbeg, pos qend) {
+    vector<const pospair*> ans;
+    size_t cost = t.overlap(qbeg, qend, ans);
+
+    vector<const pospair*> visited;
+    REQUIRE(t.overlap_visit(qbeg, qend, [&](const pospair& p) { visited.push_back(&p); }) == cost);
+    REQUIRE(visited == ans);
+    REQUIRE(t.overlap_count(qbeg, qend) == ans.size());
+    REQUIRE(t.overlap_any(qbeg, qend) == !ans.empty());
+
+    // stop early after the first three results
+    visited.clear();
+    size_t early_cost = t.overlap_visit(qbeg, qend, [&](const pospair& p) {
+        visited.push_back(&p);
+        return visited.size() < 3;
+    });
+    REQUIRE(visited.size() == std::min(ans.size(), size_t(3)));
+    REQUIRE(equal(visited.begin(), visited.end(), ans.begin()));
+    REQUIRE(early_cost <= cost);
+
+    // lazy cursor, run to the end and abandoned after three results
+    visited.clear();
+    for (const pospair& p : t.overlap_range(qbeg, qend)) {
+        visited.push_back(&p);
+    }
+    REQUIRE(visited == ans);
+    auto it = t.overlap_range(qbeg, qend);
+    size_t n = 0;
+    for (; it != it.end() && n < 3; ++it, ++n) {
+        REQUIRE(&*it == ans[n]);
+    }
+    REQUIRE(n == std::min(ans.size(), size_t(3)));
+    REQUIRE(it.cost() <= cost);
+    while (it != it.end()) {
+        ++it;
+    }
+    REQUIRE(it.cost() == cost);
+}
+
+TEST_CASE("overlap_visit, overlap_count, overlap_any & overlap_range") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N = 10; N < 200000; N *= 7) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        auto tree = build_iit(examples);
+        auto treeii = build_iitii(examples, N >= 100 ? 10 : 1);
+
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            auto qend = qbeg + (i%3 ? 42 : 1000);
+            test_visit(tree, qbeg, qend);
+            test_visit(treeii, qbeg, qend);
+        }
+    }
+}
+
+TEST_CASE("scan across imaginary nodes") {
+    // sizes just around powers of two, where the scan meets imaginary subtrees of every height
+    // on the right border; queries towards the high end of the position range
+    default_random_engine R(42);
+    geometric_distribution<uint16_t> lenD(0.05);
+    for (int s = 1; s <= 16; s += 3) {
+        for (int N : { (1 << s) - 1, 1 << s, (1 << s) + 1, (1 << s) + (1 << (s-1)) }) {
+            vector<pospair> examples;
+            for (int i = 0; i < N; ++i) {
+                examples.push_back({ 10*i, 10*i + lenD(R) });
+            }
+            auto tree = build_iit(examples);
+            auto treeii = build_iitii(examples, 4);
+            uniform_int_distribution<uint32_t> begD(std::max(0, 10*N-1000), 10*N+100);
+            bool alleq = true;
+            for (size_t i = 0; i < 200; ++i) {
+                auto qbeg = begD(R), qend = qbeg + (i%2 ? 1 : 200);
+                size_t naive = 0;
+                for (const auto& p : examples) {
+                    naive += qbeg < p.second && p.first < qend;
+                }
+                alleq = alleq && tree.overlap_count(qbeg, qend) == naive && treeii.overlap_count(qbeg, qend) == naive;
+                test_visit(tree, qbeg, qend);
+                test_visit(treeii, qbeg, qend);
+            }
+            REQUIRE(alleq);
+        }
+    }
+}
+
+// check k_nearest against a brute-force ranking by distance, then descending (beg, end); return
+// the query cost
+template<class tree_t>
+size_t test_nearest(const tree_t& tree, const vector<pospair>& examples, pos qpos, size_t k, iit_direction dir) {
+    auto dist = [qpos](const pospair& p) {
+        return p.first > qpos ? p.first - qpos : p.second > qpos ? 0 : qpos - p.second + 1;
+    };
+    vector<tuple<pos, pos, pos>> naive;
+    for (const auto& p : examples) {
+        if ((dir == iit_direction::upstream && p.second > qpos) || (dir == iit_direction::downstream && p.first <= qpos)) {
+            continue;
+        }
+        naive.emplace_back(dist(p), p.first, p.second);
+    }
+    sort(naive.begin(), naive.end(), [](const tuple<pos, pos, pos>& a, const tuple<pos, pos, pos>& b) {
+        return get<0>(a) < get<0>(b) || (get<0>(a) == get<0>(b) && make_pair(get<1>(a), get<2>(a)) > make_pair(get<1>(b), get<2>(b)));
+    });
+    naive.resize(min(naive.size(), k));
+
+    vector<const pospair*> ans;
+    size_t cost = tree.k_nearest(qpos, k, ans, dir);
+    vector<tuple<pos, pos, pos>> got;
+    for (auto p : ans) {
+        got.emplace_back(dist(*p), p->first, p->second);
+    }
+    REQUIRE(got == naive);
+    return cost;
+}
+
+TEST_CASE("nearest & k_nearest") {
+    default_random_engine R(42);
+    for (int N : { 0, 1, 2, 7, 8, 9, 1000, 4097 }) {
+        vector<pospair> examples;
+        uniform_int_distribution<pos> begD(0, 10*N);
+        geometric_distribution<pos> lenD(0.05);
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg + (i%50 ? lenD(R) : 10*lenD(R)) });  // incl. some long & empty
+        }
+        auto tree = build_iit(examples);
+        auto treeii = build_iitii(examples, 8);
+        auto treeii_ce = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_eytzinger<iit_compact<uint16_t>, 5>>::builder(examples.begin(), examples.end()).build(8);
+        uniform_int_distribution<pos> qD(0, 10*N+100);
+        for (size_t i = 0; i < 100; ++i) {
+            const pos qpos = qD(R);
+            for (size_t k : { 0, 1, 2, 10 }) {
+                for (auto dir : { iit_direction::both, iit_direction::upstream, iit_direction::downstream }) {
+                    test_nearest(tree, examples, qpos, k, dir);
+                    test_nearest(treeii, examples, qpos, k, dir);
+                    test_nearest(treeii_ce, examples, qpos, k, dir);
+                }
+            }
+        }
+    }
+
+    SECTION("convenience forms") {
+        vector<pospair> examples = { {10, 20}, {30, 40}, {35, 50}, {60, 61} };
+        auto treeii = build_iitii(examples, 2);
+        REQUIRE(*treeii.nearest(15) == pospair(10, 20));
+        REQUIRE(*treeii.nearest(24) == pospair(10, 20));  // 5 away from 19, 6 from 30
+        REQUIRE(*treeii.nearest(25) == pospair(30, 40));
+        REQUIRE(*treeii.nearest(26) == pospair(30, 40));
+        REQUIRE(*treeii.nearest_upstream(37) == pospair(10, 20));
+        REQUIRE(*treeii.nearest_downstream(37) == pospair(60, 61));
+        REQUIRE(treeii.nearest_upstream(5) == nullptr);
+        REQUIRE(treeii.nearest_downstream(60) == nullptr);
+        auto ans = treeii.k_nearest(37, 3);
+        REQUIRE(ans.size() == 3);
+        REQUIRE(*ans[0] == pospair(35, 50));  // tie: the later-beginning first
+        REQUIRE(*ans[1] == pospair(30, 40));
+        REQUIRE(*ans[2] == pospair(10, 20));  // 18 away from 19, 23 from 60
+        REQUIRE(build_iit({}).nearest(42) == nullptr);
+    }
+
+    SECTION("cost") {
+        // with the model's prediction as the starting rank, a nearest query costs about as much
+        // as a short overlap query
+        uniform_int_distribution<pos> begD(0, 1000000000);
+        vector<pospair> examples;
+        for (int i = 0; i < 100000; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg + 100 });
+        }
+        auto tree = build_iit(examples);
+        auto treeii = build_iitii(examples, 1000);
+        size_t cost = 0, costii = 0, overlap_cost = 0;
+        vector<const pospair*> ans;
+        for (size_t i = 0; i < 10000; ++i) {
+            const pos qpos = begD(R);
+            cost += tree.k_nearest(qpos, 1, ans);
+            costii += treeii.k_nearest(qpos, 1, ans);
+            overlap_cost += treeii.overlap(qpos, qpos+1, ans);
+        }
+        cout << "nearest cost: iit " << cost << ", iitii " << costii << ", iitii overlap " << overlap_cost << endl;
+        REQUIRE(costii < cost);
+        REQUIRE(costii < 2*overlap_cost);
+    }
+}
+
+// check coverage() of [beg, end) against per-position brute force
+template<class tree_t>
+void test_coverage(const tree_t& tree, const vector<pospair>& examples, pos beg, pos end, pos window, unsigned threads) {
+    vector<iit_coverage_window<pos>> out;
+    tree.coverage(beg, end, window, out, threads);
+    REQUIRE(out.size() == (end > beg ? (end - beg + window - 1)/window : 0));
+    bool allok = true;
+    for (size_t w = 0; w < out.size(); ++w) {
+        const pos wb = beg + w*window, we = min(end, wb + pos(window));
+        iit_coverage_window<pos> naive;
+        naive.items = tree.overlap_count(wb, we);
+        for (pos x = wb; x < we; ++x) {
+            size_t depth = 0;
+            for (const auto& p : examples) {
+                depth += p.first <= x && x < p.second;
+            }
+            naive.max_depth = max(naive.max_depth, depth);
+            naive.covered += depth > 0;
+            naive.depth_sum += depth;
+        }
+        allok = allok && out[w].items == naive.items && out[w].max_depth == naive.max_depth &&
+                out[w].covered == naive.covered && out[w].depth_sum == naive.depth_sum;
+    }
+    REQUIRE(allok);
+}
+
+TEST_CASE("coverage & aggregate") {
+    default_random_engine R(42);
+    vector<pospair> examples;
+    uniform_int_distribution<pos> begD(1000, 5000);
+    geometric_distribution<pos> lenD(0.02);
+    for (int i = 0; i < 2000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg + (i%100 ? lenD(R) : 20*lenD(R)) });  // incl. some long & empty
+    }
+    for (int i = 0; i < 100; ++i) {
+        examples.push_back({ 8000 + 7*i, 8003 + 7*i });  // a sparse stretch after a gap
+    }
+    auto tree = build_iit(examples);
+    auto treeii = build_iitii(examples, 8);
+    vector<pospair> many;
+    for (int i = 0; i < 300000; ++i) {
+        auto beg = pos(i*3 + begD(R)%7);
+        many.push_back({ beg, beg + lenD(R) });
+    }
+    auto big = build_iitii(many, 100);
+
+    SECTION("coverage") {
+        for (pos window : { 1, 7, 100, 1000 }) {
+            test_coverage(tree, examples, 0, 9000, window, 1);
+            test_coverage(treeii, examples, 2345, 8123, window, 1);
+        }
+        test_coverage(tree, examples, 3000, 3000, 10, 1);
+        vector<iit_coverage_window<pos>> out1, out4;
+        REQUIRE_THROWS(tree.coverage(0, 100, 0, out1));
+
+        // parallel sweeps give the same answer
+        const size_t cost = big.coverage(100, 890000, 1000, out1, 1);
+        big.coverage(100, 890000, 1000, out4, 4);
+        REQUIRE(out1.size() == out4.size());
+        bool alleq = true;
+        for (size_t w = 0; w < out1.size(); ++w) {
+            alleq = alleq && out1[w].items == out4[w].items && out1[w].depth_sum == out4[w].depth_sum &&
+                    out1[w].covered == out4[w].covered && out1[w].max_depth == out4[w].max_depth &&
+                    out1[w].items == big.overlap_count(100 + 1000*w, min(pos(890000), pos(1100 + 1000*w)));
+        }
+        REQUIRE(alleq);
+        // one sweep, visiting each node about once, instead of a query per window
+        REQUIRE(cost < 2*many.size());
+    }
+
+    SECTION("aggregate") {
+        // windows with gaps between them, some overlapping, and a few empty
+        vector<pair<pos, pos>> windows;
+        for (pos b = 0; b < 9000; b += 10 + b%37) {
+            windows.push_back({ b, b + (b%5 ? 5 + b%23 : 0) });
+        }
+        sort(windows.begin(), windows.end());
+        for (size_t w = 1; w < windows.size(); ++w) {
+            windows[w].second = max(windows[w].second, windows[w-1].second);
+        }
+        for (unsigned threads : { 1, 3 }) {
+            vector<vector<pospair>> out;
+            treeii.aggregate(windows, out, [](vector<pospair>& acc, const pospair& p) { acc.push_back(p); }, threads);
+            REQUIRE(out.size() == windows.size());
+            bool alleq = true;
+            for (size_t w = 0; w < windows.size(); ++w) {
+                vector<pospair> naive;
+                for (auto p : tree.overlap(windows[w].first, windows[w].second)) {
+                    naive.push_back(*p);
+                }
+                sort(naive.begin(), naive.end());
+                sort(out[w].begin(), out[w].end());
+                alleq = alleq && out[w] == naive;
+            }
+            REQUIRE(alleq);
+        }
+
+        // sparse windows over a large index, in parallel: the sweep skips the gaps between them
+        vector<pair<pos, pos>> sparse;
+        for (pos b = 0; b < 900000; b += 50000) {
+            sparse.push_back({ b, b + 100 });
+        }
+        vector<size_t> counts;
+        const size_t cost = big.aggregate(sparse, counts, [](size_t& acc, const pospair&) { ++acc; }, 4);
+        REQUIRE(counts.size() == sparse.size());
+        bool alleq = true;
+        for (size_t w = 0; w < sparse.size(); ++w) {
+            alleq = alleq && counts[w] == big.overlap_count(sparse[w].first, sparse[w].second);
+        }
+        REQUIRE(alleq);
+        REQUIRE(cost < 10000);
+
+        vector<pair<pos, pos>> unsorted = { { 10, 20 }, { 5, 30 } };
+        REQUIRE_THROWS(tree.aggregate(unsorted, counts, [](size_t& acc, const pospair&) { ++acc; }));
+    }
+}
+
+template<class Stats>
+void test_stats_policy() {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    vector<pospair> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+10 });
+    }
+    auto tree = typename iitii<pos, pospair, &get_beg, &get_end, std::vector, Stats>::builder(examples.begin(), examples.end()).build(100);
+
+    // concurrent queries from several threads, each checked against the default (stat-less) tree
+    auto treeii = build_iitii(examples, 100);
+    const size_t T = 4, Q = 10000;
+    vector<thread> threads;
+    atomic<size_t> mismatches(0);
+    for (size_t t = 0; t < T; ++t) {
+        threads.emplace_back([&, t]() {
+            default_random_engine Rt(t);
+            vector<const pospair*> ans, ansii;
+            for (size_t i = 0; i < Q; ++i) {
+                auto qbeg = begD(Rt);
+                tree.overlap(qbeg, qbeg+42, ans);
+                treeii.overlap(qbeg, qbeg+42, ansii);
+                bool alleq = ans.size() == ansii.size();
+                for (size_t j = 0; alleq && j < ans.size(); ++j) {
+                    alleq = *ans[j] == *ansii[j];
+                }
+                if (!alleq) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    REQUIRE(mismatches == 0);
+    REQUIRE(tree.stats().queries() == T*Q);
+    REQUIRE(tree.stats().total_climb_cost() > 0);
+
+    // stats are carried along with copies of the tree
+    auto copy = tree;
+    REQUIRE(copy.stats().queries() == T*Q);
+}
+
+TEST_CASE("stats policies") {
+    test_stats_policy<iitii_stats_atomic>();
+    test_stats_policy<iitii_stats_sharded>();
+
+    auto tree = build_iitii({ { 12, 34 }, { 0, 23 }, { 34, 56 } }, 1);
+    tree.overlap(22, 25);
+    REQUIRE(tree.stats().queries() == 0);
+}
+
+TEST_CASE("model diagnostics") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 1000000);
+    geometric_distribution<uint16_t> lenD(0.01);
+    vector<pospair> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+lenD(R) });
+    }
+    examples.push_back({ 10000000, 10000001 });   // a sparse tail: domains with no items
+
+    auto treeii = build_iitii(examples, 100);
+    auto report = treeii.model_report();
+    REQUIRE(report.domains.size() == 100);
+    size_t items = 0, root_domains = 0;
+    double total_cost = 0;
+    for (const auto& d : report.domains) {
+        items += d.items;
+        root_domains += d.level < 0;
+        total_cost += d.expected_cost*d.items;
+    }
+    REQUIRE(items == examples.size());
+    REQUIRE(report.root_domains == root_domains);
+    REQUIRE(root_domains > 0);
+    REQUIRE(std::abs(total_cost/items - treeii.model_summary().predicted_cost) < 1e-6);
+
+    ostringstream tsv, json;
+    report.write_tsv(tsv);
+    const string tsv_str = tsv.str();
+    REQUIRE(count(tsv_str.begin(), tsv_str.end(), '\n') == 101);
+    REQUIRE(tsv_str.substr(0, 13) == "domain\torigin");
+    report.write_json(json);
+    const string json_prefix = "{\"root_domains\":" + to_string(root_domains) + ",\"domains\":[{\"domain\":0,";
+    REQUIRE(json.str().substr(0, json_prefix.size()) == json_prefix);
+
+    // query histograms
+    using treeii_h = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_histograms>;
+    auto treeh = treeii_h::builder(examples.begin(), examples.end()).build(100);
+    iitii_histogram results;
+    size_t total_results = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        auto qbeg = begD(R);
+        if (i%2) {
+            auto n = treeh.overlap(qbeg, qbeg+100).size();
+            results.counts[iitii_histogram::bucket(n)]++;
+            total_results += n;
+        } else {
+            size_t n = treeh.overlap_count(qbeg, qbeg+100);
+            results.counts[iitii_histogram::bucket(n)]++;
+            total_results += n;
+        }
+    }
+    auto h = treeh.stats().histograms_snapshot();
+    REQUIRE(h.results.total() == 1000);
+    REQUIRE(h.nodes_scanned.total() == 1000);
+    REQUIRE(h.climb_depth.total() == treeh.stats().queries());
+    REQUIRE(h.prediction_error.total() == treeh.stats().queries());
+    REQUIRE(equal(begin(h.results.counts), end(h.results.counts), begin(results.counts)));
+    ostringstream htsv;
+    h.write_tsv(htsv);
+    REQUIRE(htsv.str().substr(0, 22) == "bucket_min\tclimb_depth");
+}
+
+TEST_CASE("equal-count domains") {
+    default_random_engine R(42);
+    geometric_distribution<uint16_t> lenD(0.1);
+
+    // a few dense clusters separated by sparse deserts
+    vector<pospair> examples;
+    for (uint32_t cluster = 0; cluster < 5; ++cluster) {
+        uniform_int_distribution<uint32_t> denseD(cluster*10000000, cluster*10000000 + 1000000);
+        for (int i = 0; i < 50000; ++i) {
+            auto beg = denseD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        uniform_int_distribution<uint32_t> sparseD(cluster*10000000, (cluster+1)*10000000);
+        for (int i = 0; i < 1000; ++i) {
+            auto beg = sparseD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+    }
+    // plus many duplicate begin positions
+    for (int i = 0; i < 10000; ++i) {
+        examples.push_back({ 12345678, 12345678 + lenD(R) });
+    }
+
+    auto tree = build_iit(examples);
+    for (size_t domains : { 1, 2, 100, 1000, 10000 }) {
+        auto ew = iitii<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(domains);
+        auto ec = iitii<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(domains, iitii_partition::equal_count);
+        size_t ew_cost = 0, ec_cost = 0;
+        uniform_int_distribution<uint32_t> denseD(0, 1000000);
+        for (size_t i = 0; i < 10000; ++i) {
+            // queries mostly in the clusters, where the items are
+            auto qbeg = (i%5)*10000000 + denseD(R) + (i%10 ? 0 : 5000000);
+            vector<const pospair*> ans, ew_ans, ec_ans;
+            tree.overlap(qbeg, qbeg+42, ans);
+            ew_cost += ew.overlap(qbeg, qbeg+42, ew_ans);
+            ec_cost += ec.overlap(qbeg, qbeg+42, ec_ans);
+            REQUIRE(ans.size() == ew_ans.size());
+            REQUIRE(equal(ans.begin(), ans.end(), ew_ans.begin(), [](const pospair* a, const pospair* b) { return *a == *b; }));
+            REQUIRE(ans.size() == ec_ans.size());
+            REQUIRE(equal(ans.begin(), ans.end(), ec_ans.begin(), [](const pospair* a, const pospair* b) { return *a == *b; }));
+        }
+        if (domains >= 1000) {
+            REQUIRE(ec_cost < ew_cost);
+        }
+    }
+}
+
+TEST_CASE("automatic domain selection") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 100000000);
+    geometric_distribution<uint16_t> lenD(0.1);
+
+    for (int N : { 0, 1, 10, 1000, 100000 }) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        auto tree = build_iit(examples);
+        using treeii_t = iitii<pos, pospair, &get_beg, &get_end>;
+        auto treeii = treeii_t::builder(examples.begin(), examples.end()).build(iitii_auto_domains());
+        auto summary = treeii.model_summary();
+        REQUIRE(summary.domains >= 1);
+        REQUIRE(summary.model_bytes <= iitii_auto_domains().max_model_bytes);
+        REQUIRE(summary.domains*iitii_auto_domains().min_domain_items <= std::max(size_t(N), iitii_auto_domains().min_domain_items));
+
+        // the chosen model predicts no worse than any fixed candidate
+        for (size_t domains = 1; domains*iitii_auto_domains().min_domain_items <= std::max(size_t(N), iitii_auto_domains().min_domain_items); domains *= 4) {
+            auto fixed = treeii_t::builder(examples.begin(), examples.end()).build(domains);
+            REQUIRE(summary.predicted_cost <= fixed.model_summary().predicted_cost*(1.0 + iitii_auto_domains().tolerance) + 1e-9);
+        }
+
+        for (size_t i = 0; i < 1000; ++i) {
+            auto qbeg = begD(R);
+            vector<const pospair*> ans, ansii;
+            tree.overlap(qbeg, qbeg+100, ans);
+            treeii.overlap(qbeg, qbeg+100, ansii);
+            REQUIRE(ans.size() == ansii.size());
+            REQUIRE(equal(ans.begin(), ans.end(), ansii.begin(), [](const pospair* a, const pospair* b) { return *a == *b; }));
+        }
+
+        // a tight memory bound limits the model size
+        iitii_auto_domains tight;
+        tight.max_model_bytes = 1000;
+        auto small = treeii_t::builder(examples.begin(), examples.end()).build(tight);
+        REQUIRE(small.model_summary().model_bytes <= 1000);
+    }
+}
+
+TEST_CASE("sampled training") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 100000000);
+    geometric_distribution<uint16_t> lenD(0.01);
+    vector<pospair> examples;
+    for (int i = 0; i < 1000000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg + (i%1000 ? lenD(R) : 100000) });
+    }
+    using treeii_t = iitii<pos, pospair, &get_beg, &get_end>;
+    auto tree = build_iit(examples);
+    auto exact = build_iitii(examples, 100);
+
+    // the streaming regression agrees with the two-pass one
+    vector<pair<double,double>> points;
+    for (int i = 0; i < 1000; ++i) {
+        points.push_back({ 4e9 + begD(R), i + 0.1*lenD(R) });
+    }
+    iit_regression reg;
+    double sum_x = 0, sum_y = 0, cov = 0, var = 0;
+    for (const auto& pt : points) {
+        reg.add(pt.first, pt.second);
+        sum_x += pt.first;
+        sum_y += pt.second;
+    }
+    for (const auto& pt : points) {
+        cov += (pt.first - sum_x/points.size())*(pt.second - sum_y/points.size());
+        var += (pt.first - sum_x/points.size())*(pt.first - sum_x/points.size());
+    }
+    REQUIRE(fabs(reg.fit().second - cov/var) < 1e-9*fabs(cov/var));
+    REQUIRE(fabs(reg.fit().first - (sum_y/points.size() - cov/var*sum_x/points.size())) < 1e-3);
+
+    for (size_t sample : { 0, 64, 1024 }) {
+        for (bool early_stop : { false, true }) {
+            iitii_train_options opts;
+            opts.cost_sample = sample;
+            opts.early_stop = early_stop;
+            auto treeii = treeii_t::builder(examples.begin(), examples.end()).build(100, iitii_partition::equal_width, opts);
+            if (!sample && !early_stop) {
+                REQUIRE(treeii.model_summary().predicted_cost == exact.model_summary().predicted_cost);
+            }
+            REQUIRE(fabs(treeii.model_summary().predicted_cost - exact.model_summary().predicted_cost)
+                    < 0.25*exact.model_summary().predicted_cost);
+
+            // the queries are just as correct, and about as cheap
+            size_t cost = 0, exact_cost = 0;
+            bool alleq = true;
+            vector<const pospair*> ans, ansii, ans_exact;
+            for (int i = 0; i < 10000; ++i) {
+                auto qbeg = begD(R);
+                tree.overlap(qbeg, qbeg+100, ans);
+                cost += treeii.overlap(qbeg, qbeg+100, ansii);
+                exact_cost += exact.overlap(qbeg, qbeg+100, ans_exact);
+                alleq = alleq && ans.size() == ansii.size()
+                              && equal(ans.begin(), ans.end(), ansii.begin(), [](const pospair* a, const pospair* b) { return *a == *b; });
+            }
+            REQUIRE(alleq);
+            REQUIRE(cost < 1.1*exact_cost);
+        }
+    }
+
+    // automatic domain selection with sampled training
+    iitii_auto_domains autod;
+    autod.train.cost_sample = 256;
+    autod.train.early_stop = true;
+    auto treeii = treeii_t::builder(examples.begin(), examples.end()).build(autod);
+    REQUIRE(treeii.model_summary().domains > 1);
+    REQUIRE(treeii.model_summary().predicted_cost < exact.model_summary().predicted_cost);
+}
+
+TEST_CASE("model precision far from the origin") {
+    // the model measures positions relative to the domain origins, so shifting all the items &
+    // queries by a large offset should make no difference
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 1000000);
+    geometric_distribution<uint16_t> lenD(0.1);
+    const uint32_t shift = 4000000000U;
+
+    vector<pospair> examples, shifted;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R), end = beg+lenD(R);
+        examples.push_back({ beg, end });
+        shifted.push_back({ beg+shift, end+shift });
+    }
+    for (auto partition : { iitii_partition::equal_width, iitii_partition::equal_count }) {
+        for (size_t domains : { 1, 16, 1024 }) {
+            auto treeii = iitii<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(domains, partition);
+            auto shiftedii = iitii<pos, pospair, &get_beg, &get_end>::builder(shifted.begin(), shifted.end()).build(domains, partition);
+            REQUIRE(treeii.model_summary().predicted_cost == shiftedii.model_summary().predicted_cost);
+            size_t cost = 0, shifted_cost = 0, results = 0, shifted_results = 0;
+            for (size_t i = 0; i < 10000; ++i) {
+                auto qbeg = begD(R);
+                vector<const pospair*> ans;
+                cost += treeii.overlap(qbeg, qbeg+10, ans);
+                results += ans.size();
+                shifted_cost += shiftedii.overlap(qbeg+shift, qbeg+shift+10, ans);
+                shifted_results += ans.size();
+            }
+            REQUIRE(results == shifted_results);
+            REQUIRE(cost == shifted_cost);
+        }
+    }
+
+    // float weights (12-byte rows) predict as well as double weights, even across domains much
+    // wider than float's 24-bit significand
+    uniform_int_distribution<uint32_t> wideD(0, 4000000000U);
+    vector<pospair> wide;
+    for (int i = 0; i < 200000; ++i) {
+        auto beg = wideD(R);
+        wide.push_back({ beg, beg+lenD(R) });
+    }
+    using double_ii = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_aos, double_weight_tuning>;
+    for (size_t domains : { 1, 16, 256 }) {
+        auto floatii = iitii<pos, pospair, &get_beg, &get_end>::builder(wide.begin(), wide.end()).build(domains);
+        auto doubleii = double_ii::builder(wide.begin(), wide.end()).build(domains);
+        REQUIRE(floatii.model_summary().model_bytes == 3*sizeof(float)*domains);
+        REQUIRE(doubleii.model_summary().model_bytes == 3*sizeof(double)*domains);
+        size_t float_cost = 0, double_cost = 0;
+        vector<const pospair*> ans, ans_d;
+        bool alleq = true;
+        for (size_t i = 0; i < 10000; ++i) {
+            auto qbeg = wideD(R);
+            float_cost += floatii.overlap(qbeg, qbeg+1000, ans);
+            double_cost += doubleii.overlap(qbeg, qbeg+1000, ans_d);
+            alleq = alleq && ans.size() == ans_d.size();
+        }
+        REQUIRE(alleq);
+        REQUIRE(float_cost <= double_cost*1.01);
+    }
+}
+
+TEST_CASE("parallel build") {
+    using tree_t = iit<pos, pos_item, pos_item_beg, pos_item_end>;
+    using treeii_t = iitii<pos, pos_item, pos_item_beg, pos_item_end>;
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 10000000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N : { 0, 1, 1000, 70000, 300001 }) {
+        vector<pos_item> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+        }
+        vector<pair<pos,pos>> queries;
+        for (size_t i = 0; i < 10000; ++i) {
+            auto qbeg = begD(R);
+            queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 1000) });
+        }
+
+        auto tree = tree_t::builder(examples.begin(), examples.end()).build();
+        for (unsigned threads : { 2, 3, 8 }) {
+            auto ptree = tree_t::builder(examples.begin(), examples.end()).threads(threads).build();
+            REQUIRE(same_results(tree, ptree, queries));
+        }
+
+        // same_results() also compares the query costs, so this checks that the parallel-trained
+        // models are identical
+        auto treeii = treeii_t::builder(examples.begin(), examples.end()).build(1000);
+        for (unsigned threads : { 2, 3, 8 }) {
+            auto ptreeii = treeii_t::builder(examples.begin(), examples.end()).threads(threads).build(1000);
+            REQUIRE(same_results(treeii, ptreeii, queries));
+        }
+    }
+}
+
+struct named_item {
+    pos beg, end;
+    string name;
+    named_item(pos beg_, pos end_, string name_) : beg(beg_), end(end_), name(move(name_)) {}
+};
+pos named_item_beg(const named_item& it) { return it.beg; }
+pos named_item_end(const named_item& it) { return it.end; }
+
+TEST_CASE("presorted & move-based building") {
+    using treeii_t = iitii<pos, pos_item, pos_item_beg, pos_item_end>;
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 10000000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    vector<pos_item> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+lenD(R) });
+    }
+    vector<pair<pos,pos>> queries;
+    for (size_t i = 0; i < 10000; ++i) {
+        auto qbeg = begD(R);
+        queries.push_back({ qbeg, qbeg + (i%3 ? 42 : 1000) });
+    }
+    auto tree = treeii_t::builder(examples.begin(), examples.end()).build(100);
+
+    auto less = [](const pos_item& lhs, const pos_item& rhs) {
+        return lhs.beg < rhs.beg || (lhs.beg == rhs.beg && lhs.end < rhs.end);
+    };
+    vector<pos_item> sorted = examples, runs = examples;
+    sort(sorted.begin(), sorted.end(), less);
+    for (size_t i = 0; i < 3; ++i) {
+        sort(runs.begin() + i*runs.size()/3, runs.begin() + (i+1)*runs.size()/3, less);
+    }
+    for (unsigned threads : { 1, 4 }) {
+        for (const auto* input : { &sorted, &runs, &examples }) {
+            auto ptree = treeii_t::builder(input->begin(), input->end()).threads(threads).build_presorted(100);
+            REQUIRE(same_results(tree, ptree, queries));
+        }
+    }
+
+    // moving & emplacing items
+    using named_iit = iit<pos, named_item, named_item_beg, named_item_end>;
+    vector<named_item> named;
+    for (const auto& it : sorted) {
+        named.emplace_back(it.beg, it.end, "item_with_a_long_name_" + to_string(it.beg));
+    }
+    named_iit::builder br(make_move_iterator(named.begin()), make_move_iterator(named.end()) - 1);
+    br.emplace(named.back().beg, named.back().end, named.back().name);
+    auto named_tree = br.build_presorted();
+    bool allok = true;
+    for (const auto& q : queries) {
+        size_t n = 0;
+        named_tree.overlap_visit(q.first, q.second, [&](const named_item& it) {
+            allok = allok && it.name == "item_with_a_long_name_" + to_string(it.beg);
+            ++n;
+        });
+        allok = allok && n == tree.overlap_count(q.first, q.second);
+    }
+    REQUIRE(allok);
+}
+
+// write text BGZF-compressed, in blocks of block_size bytes (far smaller than bgzip's) so that
+// lines span blocks, followed by the EOF marker block
+void write_bgzf(const string& filename, const string& text, size_t block_size) {
+    ofstream out(filename, ios::binary);
+    for (size_t ofs = 0; ; ofs += block_size) {
+        const string block = text.substr(std::min(ofs, text.size()), block_size);
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        REQUIRE(deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        string data(deflateBound(&zs, block.size()), 0);
+        zs.next_in = (Bytef*) block.data();
+        zs.avail_in = block.size();
+        zs.next_out = (Bytef*) &data[0];
+        zs.avail_out = data.size();
+        REQUIRE(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+        data.resize(zs.total_out);
+        deflateEnd(&zs);
+
+        auto le = [&](uint32_t x, size_t bytes) {
+            for (size_t i = 0; i < bytes; ++i) {
+                out.put(char((x >> (8*i)) & 255));
+            }
+        };
+        const char header[] = { 31, char(139), 8, 4, 0, 0, 0, 0, 0, char(255), 6, 0, 'B', 'C', 2, 0 };
+        out.write(header, sizeof(header));
+        le(sizeof(header) + 2 + data.size() + 8 - 1, 2);
+        out.write(data.data(), data.size());
+        le(crc32(0, (const Bytef*) block.data(), block.size()), 4);
+        le(block.size(), 4);
+        if (block.empty()) {
+            break;
+        }
+    }
+}
+
+TEST_CASE("parallel BED/VCF loading") {
+    const string filename = "/tmp/test_iitii_loader." + to_string(getpid());
+    REQUIRE(iit_interval_format_of("a.vcf.gz") == iit_interval_format::vcf);
+    REQUIRE(iit_interval_format_of("a.gtf") == iit_interval_format::gtf);
+    REQUIRE(iit_interval_format_of("a.gff3.bgz") == iit_interval_format::gtf);
+    REQUIRE(iit_interval_format_of("a.bed.gz") == iit_interval_format::bed);
+    REQUIRE(iit_interval_format_of("a") == iit_interval_format::bed);
+
+    // sorted BED records on chr1 & chr2, with header lines & some extra columns
+    default_random_engine R(42);
+    geometric_distribution<uint32_t> gapD(0.1), lenD(0.01);
+    auto less = [](const named_item& lhs, const named_item& rhs) {
+        return lhs.beg < rhs.beg || (lhs.beg == rhs.beg && lhs.end < rhs.end);
+    };
+    string bed = "track name=test\n#comment\n";
+    vector<named_item> expected;
+    for (const char* contig : { "chr1", "chr2" }) {
+        vector<named_item> records;
+        pos beg = 0;
+        for (int i = 0; i < 10000; ++i) {
+            beg += gapD(R);
+            records.emplace_back(beg, beg + lenD(R), contig + to_string(i));
+        }
+        sort(records.begin(), records.end(), less);
+        for (size_t i = 0; i < records.size(); ++i) {
+            const auto& it = records[i];
+            bed += string(contig) + "\t" + to_string(it.beg) + "\t" + to_string(it.end) + "\t" + it.name;
+            bed += i % 2 ? "\t0\t+\n" : "\n";
+        }
+        if (expected.empty()) {
+            expected = records;
+        }
+    }
+
+    auto make = [](const iit_interval_record& rec, vector<named_item>& out) {
+        if (rec.contig == "chr1") {
+            out.emplace_back(pos(rec.beg), pos(rec.end), string(rec.fields[3]));
+        }
+        return true;
+    };
+    using named_iit = iit<pos, named_item, named_item_beg, named_item_end>;
+    auto tree = named_iit::builder(expected.begin(), expected.end()).build();
+    for (bool bgzf : { false, true }) {
+        if (bgzf) {
+            write_bgzf(filename, bed, 97);
+        } else {
+            ofstream(filename) << bed;
+        }
+        for (unsigned threads : { 1, 4 }) {
+            iit_interval_loader loader(filename, iit_interval_format::bed);
+            REQUIRE(loader.text_size() == bed.size());
+            auto runs = loader.load<named_item>(make, less, threads);
+            REQUIRE(runs.size() <= 64);
+            vector<named_item> loaded;
+            for (const auto& run : runs) {
+                loaded.insert(loaded.end(), run.begin(), run.end());
+            }
+            REQUIRE(loaded.size() == expected.size());
+            bool allok = true;
+            for (size_t i = 0; i < loaded.size(); ++i) {
+                allok = allok && loaded[i].beg == expected[i].beg && loaded[i].end == expected[i].end &&
+                        loaded[i].name.compare(0, 4, "chr1") == 0;
+            }
+            REQUIRE(allok);
+
+            named_iit::builder br;
+            iit_add_runs(br, move(runs));
+            auto loaded_tree = br.build_presorted();
+            for (pos qbeg = 0; qbeg < expected.back().end; qbeg += 997) {
+                vector<string> names1, names2;
+                tree.overlap_visit(qbeg, qbeg+50, [&](const named_item& it) { names1.push_back(it.name); });
+                loaded_tree.overlap_visit(qbeg, qbeg+50, [&](const named_item& it) { names2.push_back(it.name); });
+                sort(names1.begin(), names1.end());
+                sort(names2.begin(), names2.end());
+                allok = allok && names1 == names2;
+            }
+            REQUIRE(allok);
+        }
+    }
+
+    // VCF (with multiple ALT alleles, and one variant beyond the first Mbp), GTF & a malformed line
+    const string vcf =
+        "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+        "chr2\t100\trs1\tA\tG\t.\tPASS\t.\n"
+        "chr2\t200\t.\tACGT\tA,ACG\t50\tPASS\tAC=1\n"
+        "chr2\t1500000\t.\tC\tT\t.\t.\t.\n";
+    for (bool bgzf : { false, true }) {
+        if (bgzf) {
+            write_bgzf(filename, vcf, 10);
+        } else {
+            ofstream(filename) << vcf;
+        }
+        vector<variant> variants;
+        for (auto& run : load_variant_runs(filename, 1, 1, 4)) {
+            variants.insert(variants.end(), run.begin(), run.end());
+        }
+        REQUIRE(variants.size() == 2);
+        REQUIRE(variants[0].str() == "100/A/G/rs1");
+        REQUIRE(variants[0].end == 101);
+        REQUIRE(variants[1].beg == 200);
+        REQUIRE(variants[1].id.empty());
+        REQUIRE(variants[1].alt == vector<string>({ "A", "ACG" }));
+        REQUIRE(variants[1].rid == 1);
+        REQUIRE(variants[1].end == 204);
+    }
+
+    ofstream(filename) << "chr1\tsrc\tgene\t11\t20\t.\t+\t.\tgene_id \"g1\";\n";
+    vector<pair<int64_t, int64_t>> gtf;
+    for (auto& run : iit_interval_loader(filename, iit_interval_format::gtf).load<pair<int64_t, int64_t>>(
+             [](const iit_interval_record& rec, vector<pair<int64_t, int64_t>>& out) {
+                 if (rec.contig == "chr1" && rec.fields[2] == "gene" && rec.fields[5].substr(0, 3) == ".\t+") {
+                     out.emplace_back(rec.beg, rec.end);
+                 }
+                 return true;
+             }, std::less<pair<int64_t, int64_t>>(), 1)) {
+        gtf.insert(gtf.end(), run.begin(), run.end());
+    }
+    REQUIRE(gtf == vector<pair<int64_t, int64_t>>({ { 10, 20 } }));
+
+    write_bgzf(filename, bed + "chr2\tx\t5\n", 97);
+    REQUIRE_THROWS(iit_interval_loader(filename, iit_interval_format::bed).load<named_item>(make, less, 4));
+    {
+        gzFile gz = gzopen(filename.c_str(), "wb");
+        gzputs(gz, bed.c_str());
+        gzclose(gz);
+    }
+    REQUIRE_THROWS(iit_interval_loader(filename, iit_interval_format::bed));
+    unlink(filename.c_str());
+}
+
+struct contig_item {
+    size_t rid;
+    pos beg, end;
+};
+pos contig_item_beg(const contig_item& it) { return it.beg; }
+pos contig_item_end(const contig_item& it) { return it.end; }
+size_t contig_item_rid(const contig_item& it) { return it.rid; }
+
+template<class Layout>
+void test_genome(const vector<contig_item>& examples, size_t contigs, unsigned threads) {
+    using genome_t = iitii_genome<pos, contig_item, contig_item_beg, contig_item_end, contig_item_rid, iitii_stats_none, Layout>;
+    auto genome = typename genome_t::builder(examples.begin(), examples.end()).threads(threads).build(1000);
+    REQUIRE(genome.contigs() <= contigs);
+
+    typename genome_t::session sess(genome);
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 100000);
+    for (size_t i = 0; i < 2000; ++i) {
+        const size_t rid = i % (contigs+1);  // including one beyond the last contig
+        const pos qbeg = begD(R), qend = qbeg + (i%3 ? 42 : 1000);
+        vector<contig_item> naive;
+        for (const auto& it : examples) {
+            if (it.rid == rid && qbeg < it.end && it.beg < qend) {
+                naive.push_back(it);
+            }
+        }
+        auto ans = genome.overlap(rid, qbeg, qend);
+        REQUIRE(ans.size() == naive.size());
+        REQUIRE(genome.overlap_count(rid, qbeg, qend) == naive.size());
+        REQUIRE(genome.overlap_any(rid, qbeg, qend) == !naive.empty());
+        REQUIRE(sess.overlap_count(rid, qbeg, qend) == naive.size());
+        auto range = genome.overlap_range(rid, qbeg, qend);
+        REQUIRE(size_t(distance(range.begin(), range.end())) == naive.size());
+        bool allok = true;
+        for (auto p : ans) {
+            allok = allok && p->rid == rid && qbeg < p->end && p->beg < qend;
+        }
+        REQUIRE(allok);
+
+        // nearest item downstream of qbeg on the contig
+        const contig_item* naive_down = nullptr;
+        for (const auto& it : examples) {
+            if (it.rid == rid && it.beg > qbeg && (!naive_down || it.beg < naive_down->beg)) {
+                naive_down = &it;
+            }
+        }
+        const contig_item* down = genome.nearest_downstream(rid, qbeg);
+        REQUIRE((down == nullptr) == (naive_down == nullptr));
+        REQUIRE((!down || (down->rid == rid && down->beg == naive_down->beg)));
+        REQUIRE((genome.nearest(rid, qbeg) == nullptr) == (genome.k_nearest(rid, qbeg, 3).size() == 0));
+    }
+}
+
+TEST_CASE("genome-wide index") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 100000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    // contigs of very different sizes, some of them empty
+    const size_t contigs = 40;
+    vector<contig_item> examples;
+    for (size_t rid = 0; rid < contigs; ++rid) {
+        const size_t n = rid % 7 == 3 ? 0 : (rid == 5 ? 100000 : rid*rid*10);
+        for (size_t i = 0; i < n; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ rid, beg, beg+lenD(R) });
+        }
+    }
+    shuffle(examples.begin(), examples.end(), R);
+
+    for (unsigned threads : { 1, 4 }) {
+        test_genome<iit_aos>(examples, contigs, threads);
+        test_genome<iit_soa>(examples, contigs, threads);
+        test_genome<iit_eytzinger<>>(examples, contigs, threads);
+    }
+
+    // the contigs record their queries in the genome's one Stats object; a copy has its own
+    using stats_genome_t = iitii_genome<pos, contig_item, contig_item_beg, contig_item_end, contig_item_rid, iitii_stats_sharded>;
+    auto sgenome = stats_genome_t::builder(examples.begin(), examples.end()).build(1000);
+    size_t queries = 0;
+    for (size_t rid = 0; rid < sgenome.contigs(); ++rid) {
+        if (sgenome.contig(rid).size()) {
+            sgenome.overlap_count(rid, 0, 1000);
+            ++queries;
+        }
+    }
+    REQUIRE(queries > 1);
+    REQUIRE(sgenome.stats().queries() == queries);
+    REQUIRE(sgenome.contig(5).stats().queries() == queries);
+    auto scopy = sgenome;
+    scopy.overlap_count(5, 0, 1000);
+    REQUIRE(scopy.stats().queries() == queries+1);
+    REQUIRE(scopy.contig(1).stats().queries() == queries+1);
+    REQUIRE(sgenome.stats().queries() == queries);
+
+    using genome_t = iitii_genome<pos, contig_item, contig_item_beg, contig_item_end, contig_item_rid>;
+    auto empty = genome_t::builder().build(10);
+    REQUIRE(empty.contigs() == 0);
+    REQUIRE(empty.overlap(0, 0, 100).empty());
+    REQUIRE(empty.overlap_range(0, 0, 100) == empty.overlap_range(0, 0, 100).end());
+}
+
+template<class tree>
+size_t test_session(const tree& t, const vector<pospair>& queries, size_t max_gallop, bool cheaper) {
+    typename tree::session sess(t, max_gallop);
+    size_t cost = 0, sess_cost = 0;
+    bool alleq = true;
+    decltype(t.overlap(0, 0)) ans, sess_ans;
+    for (const auto& q : queries) {
+        cost += t.overlap(q.first, q.second, ans);
+        sess_cost += sess.overlap(q.first, q.second, sess_ans);
+        alleq = alleq && ans == sess_ans;
+        alleq = alleq && sess.overlap_count(q.first, q.second) == ans.size();
+        alleq = alleq && sess.overlap_any(q.first, q.second) == !ans.empty();
+    }
+    REQUIRE(alleq);
+    if (cheaper) {
+        REQUIRE(sess_cost < cost);
+    }
+    return sess_cost;
+}
+
+TEST_CASE("query sessions") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(1, 420000);
+    geometric_distribution<uint16_t> lenD(0.01);
+
+    for (int N = 1; N < 200000; N *= 7) {
+        vector<pospair> examples;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            examples.push_back({ beg, beg+lenD(R) });
+            if (i%10 == 0) {
+                examples.push_back({ beg, beg+lenD(R) });
+            }
+        }
+        // a sorted stream, a random one, and a sorted one with occasional long jumps back
+        vector<pospair> sorted_queries, random_queries, jumpy_queries;
+        for (int i = 0; i < 2000; ++i) {
+            auto beg = begD(R);
+            random_queries.push_back({ beg, beg + (i%3 ? 42 : 1000) });
+        }
+        sorted_queries = random_queries;
+        sort(sorted_queries.begin(), sorted_queries.end());
+        jumpy_queries = sorted_queries;
+        for (size_t i = 0; i < jumpy_queries.size(); i += 100) {
+            jumpy_queries[i] = random_queries[i];
+        }
+
+        auto treeii = build_iitii(examples, N >= 100 ? 10 : 1);
+        auto treeii_soa = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_soa>::builder(examples.begin(), examples.end()).build(10);
+        auto treeii_ce = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_eytzinger<iit_compact<uint16_t>>>::builder(examples.begin(), examples.end()).build(10);
+        for (size_t max_gallop : { 0, 4, 256 }) {
+            test_session(treeii, sorted_queries, max_gallop, false);
+            test_session(treeii, random_queries, max_gallop, false);
+            test_session(treeii, jumpy_queries, max_gallop, false);
+            test_session(treeii_soa, sorted_queries, max_gallop, false);
+            test_session(treeii_ce, jumpy_queries, max_gallop, false);
+        }
+    }
+
+    // where the domains model very uneven density poorly, a dense sorted stream is cheaper from
+    // the finger than from the model's predictions
+    vector<pospair> clustered, queries;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R) / (i%4 ? 1000 : 1) * (i%4 ? 1000 : 1) + (i%4 ? begD(R)%100 : 0);
+        clustered.push_back({ beg, beg+lenD(R) });
+    }
+    for (pos qbeg = 0; qbeg < 420000; qbeg += 5) {
+        queries.push_back({ qbeg, qbeg+10 });
+    }
+    const size_t sess_cost = test_session(build_iitii(clustered, 1000), queries, 256, true);
+
+    // which relies on the domains' cost estimates, saved with the index
+    vector<pos_item> clustered_items;
+    for (const auto& p : clustered) {
+        clustered_items.push_back({ p.first, p.second });
+    }
+    using item_tree = iitii<pos, pos_item, pos_item_beg, pos_item_end>;
+    const string filename = "/tmp/test_iitii_session." + to_string(getpid());
+    item_tree::builder(clustered_items.begin(), clustered_items.end()).build(1000).save(filename);
+    REQUIRE(test_session(item_tree::load(filename), queries, 256, true) == sess_cost);
+    REQUIRE(test_session(iitii<pos, pos_item, pos_item_beg, pos_item_end, iit_mapped_array>::load_mmap(filename),
+                         queries, 256, true) == sess_cost);
+    unlink(filename.c_str());
+
+    auto empty = build_iitii(vector<pospair>(), 1);
+    decltype(empty)::session sess(empty);
+    REQUIRE(sess.overlap(0, 100).empty());
+    REQUIRE(sess.overlap(10, 100).empty());
+
+    // one session per thread
+    vector<pospair> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+lenD(R) });
+    }
+    auto treeii = build_iitii(examples, 100);
+    vector<thread> workers;
+    vector<size_t> counts(4, 0), expected(4, 0);
+    for (size_t i = 0; i < 4; ++i) {
+        for (pos qbeg = pos(i); qbeg < 420000; qbeg += 97) {
+            expected[i] += treeii.overlap_count(qbeg, qbeg+50);
+        }
+        workers.emplace_back([&, i]() {
+            decltype(treeii)::session sess(treeii);
+            for (pos qbeg = pos(i); qbeg < 420000; qbeg += 97) {
+                counts[i] += sess.overlap_count(qbeg, qbeg+50);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    REQUIRE(counts == expected);
+}
+
+template<class treeA, class treeB>
+void test_join(const treeA& a, const treeB& b, const vector<pospair>& bitems) {
+    using pair_t = pair<const pospair*, const pospair*>;
+    // reference: one (top-down) query of a per item of b
+    vector<pair_t> naive;
+    for (const auto& it : bitems) {
+        a.overlap_visit(it.first, it.second, [&](const pospair& ai) {
+            naive.emplace_back(&ai, nullptr);
+        });
+    }
+    for (unsigned threads : { 1, 4 }) {
+        vector<pair_t> pairs;
+        mutex mu;
+        size_t n = a.join(b, [&](const pospair& ai, const pospair& bi) {
+            lock_guard<mutex> lock(mu);
+            pairs.emplace_back(&ai, &bi);
+        }, threads);
+        REQUIRE(n == pairs.size());
+        REQUIRE(pairs.size() == naive.size());
+        bool allok = true;
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            const auto& ai = *pairs[i].first;
+            const auto& bi = *pairs[i].second;
+            allok = allok && ai.first < bi.second && bi.first < ai.second;
+            // single-threaded, the pairs come in order of their later begin
+            allok = allok && (threads > 1 || !i ||
+                              max(pairs[i-1].first->first, pairs[i-1].second->first) <= max(ai.first, bi.first));
+        }
+        REQUIRE(allok);
+        sort(pairs.begin(), pairs.end());
+        REQUIRE(unique(pairs.begin(), pairs.end()) == pairs.end());
+        REQUIRE(b.join(a, [](const pospair&, const pospair&) {}, threads) == pairs.size());
+    }
+
+    // stop early
+    size_t seen = 0;
+    size_t n = a.join(b, [&](const pospair&, const pospair&) { return ++seen < 10; });
+    REQUIRE(seen == std::min(naive.size(), size_t(10)));
+    REQUIRE(n == seen);
+}
+
+TEST_CASE("join") {
+    default_random_engine R(42);
+    geometric_distribution<uint16_t> lenD(0.01);
+    geometric_distribution<uint32_t> longD(0.00005);
+
+    for (int N = 1; N < 600000; N *= 9) {
+        uniform_int_distribution<uint32_t> begD(0, 10*N);
+        vector<pospair> as, bs;
+        for (int i = 0; i < N; ++i) {
+            auto beg = begD(R);
+            // including some long and some empty intervals
+            as.push_back({ beg, beg + (i%50 == 0 ? longD(R) : i%40 == 0 ? 0 : lenD(R)) });
+            beg = begD(R);
+            bs.push_back({ beg, beg + (i%10 == 0 ? 0 : lenD(R)) });
+        }
+        // and some shared begin positions
+        for (int i = 0; i < N/10; ++i) {
+            bs.push_back({ as[i].first, as[i].first + lenD(R) });
+        }
+        auto ta = build_iit(as);
+        auto tb = build_iit(bs);
+        auto tbii = build_iitii(bs, 32);
+        auto tbc = iitii<pos, pospair, &get_beg, &get_end, std::vector, iitii_stats_none, iit_compact<uint16_t>>::builder(bs.begin(), bs.end()).build(32);
+        auto tbe = iit<pos, pospair, &get_beg, &get_end, std::vector, iit_eytzinger<iit_soa>>::builder(bs.begin(), bs.end()).build();
+        test_join(ta, tb, bs);
+        test_join(ta, tbii, bs);
+        test_join(ta, tbc, bs);
+        test_join(ta, tbe, bs);
+    }
+
+    auto empty = build_iit(vector<pospair>());
+    auto one = build_iit(vector<pospair>({{1, 10}}));
+    REQUIRE(empty.join(one, [](const pospair&, const pospair&) {}) == 0);
+    REQUIRE(one.join(empty, [](const pospair&, const pospair&) {}) == 0);
+    REQUIRE(one.join(one, [](const pospair&, const pospair&) {}) == 1);
+
+    // contig by contig
+    vector<contig_item> cas, cbs;
+    uniform_int_distribution<uint32_t> begD(0, 100000);
+    for (size_t i = 0; i < 20000; ++i) {
+        auto beg = begD(R);
+        cas.push_back({ i%7, beg, beg+lenD(R) });
+        beg = begD(R);
+        cbs.push_back({ i%5, beg, beg+lenD(R) });
+    }
+    using genome_t = iitii_genome<pos, contig_item, contig_item_beg, contig_item_end, contig_item_rid>;
+    auto ga = genome_t::builder(cas.begin(), cas.end()).build(100);
+    auto gb = genome_t::builder(cbs.begin(), cbs.end()).build(100);
+    size_t naive = 0;
+    for (const auto& it : cbs) {
+        naive += ga.overlap_count(it.rid, it.beg, it.end);
+    }
+    bool allok = true;
+    REQUIRE(ga.join(gb, [&](const contig_item& ai, const contig_item& bi) {
+        allok = allok && ai.rid == bi.rid && ai.beg < bi.end && bi.beg < ai.end;
+    }) == naive);
+    REQUIRE(allok);
+}
+
+TEST_CASE("updatable index") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 1000000);
+    geometric_distribution<uint32_t> lenD(0.01);
+    vector<pospair> examples;
+    for (int i = 0; i < 20000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+lenD(R) });
+    }
+    using updatable = iitii_updatable<pos, pospair, &get_beg, &get_end>;
+    updatable db(build_iitii(examples, 100), 64, 0.1, 2);
+
+    auto check = [&]() {
+        bool alleq = true;
+        for (int i = 0; i < 100; ++i) {
+            auto qbeg = begD(R);
+            auto qend = qbeg + (i%2 ? 10 : 2000);
+            vector<pospair> naive;
+            for (const auto& p : examples) {
+                if (qbeg < p.second && p.first < qend) {
+                    naive.push_back(p);
+                }
+            }
+            sort(naive.begin(), naive.end());
+            auto ans = db.overlap(qbeg, qend);
+            alleq = alleq && ans.size() == naive.size() && db.overlap_count(qbeg, qend) == naive.size()
+                          && db.overlap_any(qbeg, qend) == !naive.empty();
+            for (size_t j = 0; alleq && j < ans.size(); ++j) {
+                alleq = *ans[j] == naive[j];
+            }
+            // visiting, stopping after the first few results
+            size_t visited = 0;
+            db.overlap_visit(qbeg, qend, [&](const pospair& p) {
+                alleq = alleq && p == naive[visited];
+                return ++visited < 3;
+            });
+            alleq = alleq && visited == min(naive.size(), size_t(3));
+        }
+        return alleq;
+    };
+
+    bool merged = false;
+    for (int i = 0; i < 10000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg+lenD(R) });
+        db.insert(examples.back());
+        merged = merged || db.merging();
+        if (i % 997 == 0) {
+            REQUIRE(db.size() == examples.size());
+            REQUIRE(check());
+        }
+    }
+    REQUIRE(merged);
+    db.wait();
+    REQUIRE(!db.merging());
+    REQUIRE(check());
+
+    db.compact();
+    REQUIRE(db.base().overlap_count(0, 2000000) == examples.size());
+    REQUIRE(db.base().model_summary().domains == 100);
+    REQUIRE(check());
+
+    // starting from an empty base
+    updatable db2(build_iitii({}, 10), 16);
+    for (const auto& p : examples) {
+        db2.insert(p);
+    }
+    db2.compact();
+    REQUIRE(db2.size() == examples.size());
+    REQUIRE(db2.overlap_count(0, 2000000) == examples.size());
+
+    // appending past the greatest begin position: with power-of-two domain widths, the domains'
+    // origins stay put, so the merge retrains only the domain receiving the new items
+    using pow2_updatable = iitii_updatable<pos, pospair, &get_beg, &get_end, iitii_stats_none, iit_aos, pow2_tuning>;
+    pow2_updatable db3(pow2_updatable::base_tree::builder(examples.begin(), examples.end()).build(100), 16);
+    const auto before = db3.base().model_report();
+    for (int i = 0; i < 16; ++i) {
+        db3.insert({ 1000000 + i, 1000010 + i });
+    }
+    db3.compact();
+    const auto after = db3.base().model_report();
+    REQUIRE(after.domains.size() == before.domains.size());
+    size_t retrained = 0;
+    for (size_t d = 0; d < after.domains.size(); ++d) {
+        REQUIRE(after.domains[d].origin == before.domains[d].origin);
+        if (after.domains[d].items == before.domains[d].items) {
+            REQUIRE(after.domains[d].level == before.domains[d].level);
+            REQUIRE(after.domains[d].w1 == before.domains[d].w1);
+        } else {
+            ++retrained;
+        }
+    }
+    REQUIRE(retrained == 1);
+}
+
+TEST_CASE("hybrid long-interval index") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 10000000);
+    geometric_distribution<uint32_t> lenD(0.01);
+    uniform_int_distribution<uint32_t> longD(100000, 2000000);
+    vector<pospair> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg + (i%500 ? lenD(R) : longD(R)) });
+    }
+    using hybrid = iitii_hybrid<pos, pospair, &get_beg, &get_end>;
+    auto db = hybrid::builder(examples.begin(), examples.end()).build(100);
+    auto plain = build_iitii(examples, 100);
+    REQUIRE(db.size() == examples.size());
+    REQUIRE((db.long_size() >= 200 && db.long_size() < 210));
+    REQUIRE(db.long_threshold() < 100000);
+
+    bool alleq = true;
+    size_t hybrid_cost = 0, plain_cost = 0;
+    vector<const pospair*> ans, ans2;
+    for (int i = 0; i < 10000; ++i) {
+        auto qbeg = begD(R);
+        auto qend = qbeg + (i%10 ? 10 : 10000);
+        hybrid_cost += db.overlap(qbeg, qend, ans);
+        plain_cost += plain.overlap(qbeg, qend, ans2);
+        alleq = alleq && ans.size() == ans2.size() && db.overlap_count(qbeg, qend) == ans.size()
+                      && db.overlap_any(qbeg, qend) == !ans.empty();
+        for (size_t j = 0; alleq && j < ans.size(); ++j) {
+            alleq = *ans[j] == *ans2[j];
+        }
+        size_t visited = 0;
+        db.overlap_visit(qbeg, qend, [&](const pospair&) { ++visited; });
+        alleq = alleq && visited == ans.size();
+    }
+    REQUIRE(alleq);
+    REQUIRE(hybrid_cost < plain_cost);
+
+    // explicit threshold, and data without a long tail
+    auto db2 = hybrid::builder(examples.begin(), examples.end()).long_threshold(1000).threads(2).build(10);
+    REQUIRE(db2.long_threshold() == 1000);
+    REQUIRE(db2.long_size() + db2.short_index().overlap_count(0, 20000000) == examples.size());
+    REQUIRE(db2.overlap_count(0, 20000000) == examples.size());
+    vector<pospair> shorts;
+    for (const auto& p : examples) {
+        if (p.second - p.first < 1000) {
+            shorts.push_back(p);
+        }
+    }
+    auto db3 = hybrid::builder(shorts.begin(), shorts.end()).build(10);
+    REQUIRE(db3.long_size() == 0);
+    REQUIRE(db3.overlap_count(0, 20000000) == shorts.size());
+    auto db4 = hybrid::builder().build(1);
+    REQUIRE(db4.size() == 0);
+    REQUIRE(!db4.overlap_any(0, 20000000));
+}
+
+TEST_CASE("sharded index") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 10000000);
+    geometric_distribution<uint32_t> lenD(0.01);
+    uniform_int_distribution<uint32_t> longD(100000, 2000000);
+    vector<pos_item> examples;
+    for (int i = 0; i < 100000; ++i) {
+        auto beg = begD(R);
+        examples.push_back({ beg, beg + (i%500 ? lenD(R) : longD(R)) });
+    }
+    using sharded = iitii_sharded<pos, pos_item, pos_item_beg, pos_item_end>;
+    using mapped_sharded = iitii_sharded<pos, pos_item, pos_item_beg, pos_item_end, iit_mapped_array>;
+    auto db = sharded::builder(examples.begin(), examples.end()).threads(4).build(16, 10);
+    auto plain = iitii<pos, pos_item, pos_item_beg, pos_item_end>::builder(examples.begin(), examples.end()).build(100);
+    REQUIRE(db.shards() == 16);
+    REQUIRE(db.size() == examples.size());
+    size_t spanning = 0;
+    for (size_t s = 0; s < db.shards(); ++s) {
+        // balanced, and the shards' iitii items lie within their ranges
+        REQUIRE((db.router().shard_size(s) >= 6200 && db.router().shard_size(s) <= 6300));
+        REQUIRE(db.shard(s).index().overlap_count(0, s ? db.router().boundaries()[s-1] : 0) == 0);
+        if (s+1 < db.shards()) {
+            REQUIRE(db.shard(s).index().overlap_count(db.router().boundaries()[s], 20000000) == 0);
+        }
+        spanning += db.router().spanning_size(s);
+    }
+    REQUIRE((spanning > 0 && spanning < 1000));
+
+    const string prefix = "/tmp/test_iitii_sharded." + to_string(getpid());
+    db.save(prefix);
+    auto loaded = sharded::load(prefix);
+    auto mapped = mapped_sharded::load_mmap(prefix);
+    // one shard alone, as a host serving it would
+    const size_t s5 = 5;
+    auto shard5 = sharded::load_shard(prefix, s5);
+    auto router = sharded::load_router(prefix);
+
+    bool alleq = true;
+    size_t fanout = 0;
+    vector<const pos_item*> ans, ans2, ans3;
+    vector<size_t> route;
+    for (int i = 0; i < 10000; ++i) {
+        auto qbeg = begD(R);
+        auto qend = qbeg + (i%10 ? 10 : i%100 ? 10000 : 3000000);
+        db.overlap(qbeg, qend, ans);
+        plain.overlap(qbeg, qend, ans2);
+        alleq = alleq && ans.size() == ans2.size() && db.overlap_count(qbeg, qend) == ans.size()
+                      && db.overlap_any(qbeg, qend) == !ans.empty();
+        for (size_t j = 0; alleq && j < ans.size(); ++j) {
+            alleq = *ans[j] == *ans2[j];
+        }
+        size_t visited = 0;
+        db.overlap_visit(qbeg, qend, [&](const pos_item&) { ++visited; });
+        alleq = alleq && visited == ans.size();
+        alleq = alleq && loaded.overlap_count(qbeg, qend) == ans.size() && mapped.overlap_count(qbeg, qend) == ans.size();
+
+        // the shards routed are those whose ranges the query touches, or whose spanning items reach it
+        router.route(qbeg, qend, route);
+        alleq = alleq && route == db.router().route(qbeg, qend);
+        fanout += route.size();
+        vector<size_t> naive_route;
+        for (size_t s = 0; s < db.shards(); ++s) {
+            const auto& bounds = db.router().boundaries();
+            const bool touched = (!s || bounds[s-1] < qend) && (s+1 == db.shards() || bounds[s] > qbeg);
+            if ((touched && db.router().shard_size(s)) || (!touched && db.shard(s).spanning().overlap_any(qbeg, 20000000) &&
+                                                           (s+1 == db.shards() || bounds[s] <= qbeg))) {
+                naive_route.push_back(s);
+            }
+        }
+        alleq = alleq && route == naive_route;
+        if (find(route.begin(), route.end(), s5) != route.end()) {
+            shard5.overlap(qbeg, qend, ans3);
+            alleq = alleq && ans3.size() == db.shard(s5).overlap_count(qbeg, qend);
+        } else {
+            alleq = alleq && !db.shard(s5).overlap_any(qbeg, qend);
+        }
+    }
+    REQUIRE(alleq);
+    // (with shards ~625Kbp wide, the longest items span up to four)
+    REQUIRE(fanout < 40000);
+    unlink(sharded::router_filename(prefix).c_str());
+    for (size_t s = 0; s < db.shards(); ++s) {
+        unlink(sharded::shard_filename(prefix, s).c_str());
+        unlink((sharded::shard_filename(prefix, s) + ".spanning").c_str());
+    }
+    REQUIRE_THROWS(sharded::load(prefix));
+
+    // stop early
+    size_t seen = 0;
+    db.overlap_visit(0, 20000000, [&](const pos_item&) { return ++seen < 10; });
+    REQUIRE(seen == 10);
+
+    // more shards than items, many equal begin positions, and no items
+    vector<pos_item> few = { { 5, 10 }, { 5, 100 }, { 5, 7 }, { 6, 8 } };
+    auto db2 = sharded::builder(few.begin(), few.end()).build(8, 1);
+    REQUIRE(db2.shards() == 8);
+    REQUIRE(db2.overlap_count(0, 1000) == 4);
+    REQUIRE(db2.overlap_count(7, 9) == 3);
+    REQUIRE(db2.overlap_count(50, 60) == 1);
+    auto db3 = sharded::builder().build(4, 1);
+    REQUIRE(db3.size() == 0);
+    REQUIRE(!db3.overlap_any(0, 20000000));
+    REQUIRE(db3.router().route(0, 20000000).empty());
+}
+
+// results in ascending (beg, end) order
+bool ascending(const vector<const pospair*>& results) {
+    return is_sorted(results.begin(), results.end(), [](const pospair* a, const pospair* b) { return *a < *b; });
+}
+
+template<class tree>
+bool check_ranks(const tree& t, pos qbeg, pos qend) {
+    vector<const pospair*> results;
+    vector<size_t> ranks;
+    vector<pair<size_t, size_t>> runs;
+    t.overlap(qbeg, qend, results);
+    t.overlap_ranks(qbeg, qend, ranks);
+    t.overlap_rank_runs(qbeg, qend, runs);
+    bool ok = ranks.size() == results.size() && is_sorted(ranks.begin(), ranks.end());
+    for (size_t i = 0; ok && i < ranks.size(); ++i) {
+        ok = &t.item_at(ranks[i]) == results[i] && t.item_rank(*results[i]) == ranks[i];
+    }
+    // the runs, expanded, are the ranks; and they're maximal
+    vector<size_t> expanded;
+    for (size_t i = 0; ok && i < runs.size(); ++i) {
+        ok = runs[i].first <= runs[i].second && (!i || runs[i-1].second+1 < runs[i].first);
+        for (size_t r = runs[i].first; r <= runs[i].second; ++r) {
+            expanded.push_back(r);
+        }
+    }
+    return ok && expanded == ranks;
+}
+
+TEST_CASE("result order & rank queries") {
+    default_random_engine R(42);
+    uniform_int_distribution<uint32_t> begD(0, 1000000);
+    geometric_distribution<uint32_t> lenD(0.01);
+    uniform_int_distribution<uint32_t> longD(10000, 200000);
+    vector<pospair> examples;
+    for (int i = 0; i < 50000; ++i) {
+        auto beg = begD(R);
+        // with long items, and runs of items sharing a begin position
+        examples.push_back({ beg, beg + (i%200 ? lenD(R) : longD(R)) });
+        for (int j = 0; i%100 == 0 && j < 5; ++j) {
+            examples.push_back({ beg, beg + lenD(R) });
+        }
+    }
+    auto tree = build_iit(examples);
+    auto treeii = build_iitii(examples, 100);
+    auto hybrid = iitii_hybrid<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(10);
+    auto sharded = iitii_sharded<pos, pospair, &get_beg, &get_end>::builder(examples.begin(), examples.end()).build(8, 10);
+    iitii<pos, pospair, &get_beg, &get_end>::session sess(treeii);
+    REQUIRE(tree.size() == examples.size());
+
+    vector<pos> qbegs, qends;
+    for (int i = 0; i < 2000; ++i) {
+        qbegs.push_back(begD(R));
+        qends.push_back(qbegs.back() + (i%3 ? 100 : 20000));
+    }
+    bool allok = true;
+    vector<const pospair*> results, visited;
+    for (size_t i = 0; i < qbegs.size(); ++i) {
+        const pos qbeg = qbegs[i], qend = qends[i];
+        tree.overlap(qbeg, qend, results);
+        allok = allok && ascending(results);
+        for (const auto& other : { treeii.overlap(qbeg, qend), sess.overlap(qbeg, qend),
+                                   hybrid.overlap(qbeg, qend), sharded.overlap(qbeg, qend) }) {
+            allok = allok && ascending(other) && other.size() == results.size();
+        }
+        visited.clear();
+        for (const auto& p : treeii.overlap_range(qbeg, qend)) {
+            visited.push_back(&p);
+        }
+        allok = allok && ascending(visited) && visited.size() == results.size();
+        for (bool composite : { false, true }) {
+            visited.clear();
+            auto f = [&](const pospair& p) { visited.push_back(&p); };
+            if (composite) {
+                hybrid.overlap_visit(qbeg, qend, f);
+            } else {
+                sharded.overlap_visit(qbeg, qend, f);
+            }
+            allok = allok && ascending(visited) && visited.size() == results.size();
+        }
+        allok = allok && check_ranks(tree, qbeg, qend) && check_ranks(treeii, qbeg, qend);
+        vector<size_t> ranks, sess_ranks;
+        treeii.overlap_ranks(qbeg, qend, ranks);
+        sess.overlap_ranks(qbeg, qend, sess_ranks);
+        allok = allok && ranks == sess_ranks;
+    }
+    REQUIRE(allok);
+
+    vector<size_t> offsets;
+    vector<const pospair*> items;
+    treeii.overlap_batch(qbegs.data(), qends.data(), qbegs.size(), offsets, items);
+    for (size_t i = 0; i < qbegs.size(); ++i) {
+        allok = allok && ascending(vector<const pospair*>(items.begin() + offsets[i], items.begin() + offsets[i+1]));
+    }
+    REQUIRE(allok);
+
+    // a stopped composite visit sees a prefix of the ordered results
+    hybrid.overlap(0, 2000000, results);
+    visited.clear();
+    hybrid.overlap_visit(0, 2000000, [&](const pospair& p) { visited.push_back(&p); return visited.size() < 100; });
+    REQUIRE(visited.size() == 100);
+    REQUIRE(equal(visited.begin(), visited.end(), results.begin(), [](const pospair* a, const pospair* b) { return *a == *b; }));
+}
+
+TEST_CASE("gnomAD chr2") {
+    const int rid = 0;
+    #ifdef NDEBUG
+    const int megabases = 244;
+    #else
+    const int megabases = 24;
+    #endif
+    // Newer gnomAD versions have far larger files but not that many additional variants (a lot more metadata)
+    const string filename = "/tmp/gnomad.genomes.r2.0.2.sites.chr2.vcf.bgz";
+    const string url = "https://storage.googleapis.com/gnomad-public/release/2.0.2/vcf/genomes/gnomad.genomes.r2.0.2.sites.chr2.vcf.bgz";
+
+    ifstream vcf(filename), tbi(filename + ".tbi");
+    if (!(vcf.good() && tbi.good())) {
+        WARN("Skipping test because " + filename + " and .tbi aren't present. Download them to that location from " + url);
+    } else {
+        auto variants = load_variants_parallel(filename, rid, megabases);
+        int max_len = -1, max_end = -1;
+        for (const auto& vt : variants) {
+            max_len = std::max(max_len, vt.end - vt.beg);
+            max_end = std::max(max_end, vt.end);
+        }
+        cout << "Loaded " << variants.size() << " variants from first " << megabases << "Mbp, max len =  " << max_len << endl;
+
+        // the parallel BGZF loader finds the same variants, without the .tbi
+        size_t loaded = 0;
+        for (const auto& run : load_variant_runs(filename, rid, megabases)) {
+            loaded += run.size();
+        }
+        REQUIRE(loaded == variants.size());
 
         default_random_engine R(42);
         uniform_int_distribution<uint32_t> begD(0, max_end);
         const size_t trials = 1000000;
 
         auto tree = iit<int, variant, variant_beg, variant_end>::builder(variants.begin(), variants.end()).build();
-        auto treeii = iitii<int, variant, variant_beg, variant_end>::builder(variants.begin(), variants.end()).build(megabases*10);
+        auto treeii = iitii<int, variant, variant_beg, variant_end, std::vector, iitii_stats_atomic>::builder(variants.begin(), variants.end()).build(megabases*10);
         size_t cost = 0, costii=0, count=0;
         vector<const variant*> results, resultsii;
 
@@ -202,7 +2325,7 @@ TEST_CASE("gnomAD chr2") {
         }
 
         cout << count << " " << cost << " " << costii << endl;
-        cout << "mean climbing per query = " << double(treeii.total_climb_cost)/treeii.queries << endl;
+        cout << "mean climbing per query = " << double(treeii.stats().total_climb_cost())/treeii.stats().queries() << endl;
 
         /*
         std::sort(variants.begin(), variants.end(), [](const variant& lhs, const variant& rhs) {
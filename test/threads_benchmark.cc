@@ -0,0 +1,125 @@
+// benchmark query throughput when many threads share one index, using the synthetic ideal data
+// of ideal_benchmark.cc. With the default (stat-less) iitii, the query path is read-only and
+// throughput should scale linearly with the thread count; the atomic statistics policy is shown
+// for comparison, since every query then bounces one cache line between cores. Also reports the
+// build time using the builder's threads() setting.
+
+#include "util.h"
+#include <random>
+
+struct ideal_item {
+    uint32_t beg;
+    uint32_t end;
+};
+
+uint32_t ideal_beg(const ideal_item& it) { return it.beg; }
+uint32_t ideal_end(const ideal_item& it) { return it.end; }
+
+using ideal_iit = iit<uint32_t, ideal_item, ideal_beg, ideal_end>;
+using ideal_iitii = iitii<uint32_t, ideal_item, ideal_beg, ideal_end>;
+using ideal_iitii_atomic = iitii<uint32_t, ideal_item, ideal_beg, ideal_end, std::vector, iitii_stats_atomic>;
+using ideal_iitii_sharded = iitii<uint32_t, ideal_item, ideal_beg, ideal_end, std::vector, iitii_stats_sharded>;
+
+vector<ideal_item> generate(size_t N) {
+    // each item ranked i has begin position 10*i, with geometrically distributed length mean 20.
+    default_random_engine R(42);
+    geometric_distribution<uint32_t> lenD(0.05);
+    vector<ideal_item> ans;
+
+    for (uint32_t i = 0; i < N; i++) {
+        ideal_item it;
+        it.beg = i*10;
+        it.end = it.beg + lenD(R);
+        ans.push_back(it);
+    }
+
+    return ans;
+}
+
+// run queries_per_thread queries on each of the threads concurrently; return total result count
+template <class tree>
+size_t run_threads(const tree& t, uint32_t max_end, size_t threads, size_t queries_per_thread) {
+    vector<thread> workers;
+    vector<size_t> result_counts(threads, 0);
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+            default_random_engine R(i);
+            uniform_int_distribution<uint32_t> begD(0, max_end);
+            geometric_distribution<uint32_t> lenD(0.025);
+            vector<const ideal_item*> results;
+            size_t ans = 0;
+            for (size_t j = 0; j < queries_per_thread; j++) {
+                auto qbeg = begD(R);
+                t.overlap(qbeg, qbeg+lenD(R), results);
+                ans += results.size();
+            }
+            result_counts[i] = ans;
+        });
+    }
+    size_t ans = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i].join();
+        ans += result_counts[i];
+    }
+    return ans;
+}
+
+template <class tree, typename... Args>
+void run_experiment(const string& name, const vector<ideal_item>& items, size_t max_threads,
+                    size_t queries_per_thread, Args&&... args) {
+    auto t = typename tree::builder(items.begin(), items.end()).build(forward<Args>(args)...);
+    double single_qps = 0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        size_t result_count = 0;
+        uint32_t queries_ms = milliseconds_to([&](){
+            result_count = run_threads<tree>(t, items.size()*10, threads, queries_per_thread);
+        });
+        double qps = 1000.0*threads*queries_per_thread/std::max(queries_ms, uint32_t(1));
+        if (threads == 1) {
+            single_qps = qps;
+        }
+        cout << name << "\t" << items.size() << "\t" << threads << "\t" << queries_ms << "\t"
+             << size_t(qps) << "\t" << qps/single_qps << "\t" << result_count << endl;
+    }
+}
+
+template <class tree, typename... Args>
+void run_build_experiment(const string& name, const vector<ideal_item>& items, size_t max_threads,
+                          Args&&... args) {
+    uint32_t single_ms = 0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        uint32_t build_ms = milliseconds_to([&](){
+            typename tree::builder(items.begin(), items.end()).threads(threads).build(forward<Args>(args)...);
+        });
+        if (threads == 1) {
+            single_ms = build_ms;
+        }
+        cout << name << "\t" << items.size() << "\t" << threads << "\t" << build_ms << "\t"
+             << double(single_ms)/std::max(build_ms, uint32_t(1)) << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t max_threads = std::max(1U, thread::hardware_concurrency());
+    const size_t queries_per_thread = 2000000;
+    cout << "#tree_type\tN\tthreads\tqueries_ms\tqueries_per_sec\tspeedup\tresult_count" << endl;
+    for (size_t s = 20; s <= 26; s += 3) {
+        size_t N = 1 << s;
+        auto items = generate(N);
+        run_experiment<ideal_iit>("iit", items, max_threads, queries_per_thread);
+        run_experiment<ideal_iitii>("iitii", items, max_threads, queries_per_thread, 1);
+        run_experiment<ideal_iitii_sharded>("iitii_stats_sharded", items, max_threads, queries_per_thread, 1);
+        run_experiment<ideal_iitii_atomic>("iitii_stats_atomic", items, max_threads, queries_per_thread, 1);
+    }
+
+    cout << "#tree_type\tN\tthreads\tbuild_ms\tspeedup" << endl;
+    for (size_t s = 20; s <= 26; s += 3) {
+        size_t N = 1 << s;
+        auto items = generate(N);
+        std::shuffle(items.begin(), items.end(), default_random_engine(42));
+        run_build_experiment<ideal_iit>("iit", items, max_threads);
+        run_build_experiment<ideal_iitii>("iitii(65536)", items, max_threads, 65536);
+    }
+
+    return 0;
+}
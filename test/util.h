@@ -6,10 +6,12 @@
 #include <chrono>
 #include <functional>
 #include <assert.h>
+#include <string_view>
 #include "kstring.h"
 #include "tbx.h"
 #include "ctpl_stl.h"
 #include "iitii.h"
+#include "iitii_loader.h"
 
 using namespace std;
 
@@ -204,5 +206,39 @@ vector<variant> load_variants_parallel(const string& filename, int rid, int mega
     return ans;
 }
 
+// load the variants beginning in the first megabases Mbp of a coordinate-sorted, single-contig VCF
+// file (like load_variants_parallel), with iit_interval_loader. The variants come as runs sorted by
+// beg, then end, for build_presorted()
+vector<vector<variant>> load_variant_runs(const string& filename, int rid, int megabases,
+                                          unsigned threads = thread::hardware_concurrency()) {
+    const int64_t limit = int64_t(megabases)*1000000;
+    auto make = [&](const iit_interval_record& rec, vector<variant>& out) {
+        if (rec.beg + 1 >= limit) {
+            return false;  // (the file is coordinate-sorted)
+        }
+        variant vt;
+        vt.rid = rid;
+        vt.beg = int(rec.beg + 1);  // as load_variants
+        vt.end = int(rec.end + 1);
+        vt.id = rec.fields[2] != "." ? string(rec.fields[2]) : "";
+        vt.ref = string(rec.fields[3]);
+        string_view alts = rec.fields[4];
+        for (size_t comma; (comma = alts.find(',')) != string_view::npos; alts.remove_prefix(comma+1)) {
+            vt.alt.emplace_back(alts.substr(0, comma));
+        }
+        vt.alt.emplace_back(alts);
+        out.push_back(move(vt));
+        return true;
+    };
+    auto less = [](const variant& lhs, const variant& rhs) {
+        return lhs.beg < rhs.beg || (lhs.beg == rhs.beg && lhs.end < rhs.end);
+    };
+    return iit_interval_loader(filename, iit_interval_format::vcf).load<variant>(make, less, threads);
+}
+
 using variant_iit = iit<int, variant, variant_beg, variant_end>;
 using variant_iitii = iitii<int, variant, variant_beg, variant_end>;
+using variant_iit_soa = iit<int, variant, variant_beg, variant_end, std::vector, iit_soa>;
+using variant_iitii_soa = iitii<int, variant, variant_beg, variant_end, std::vector, iitii_stats_none, iit_soa>;
+using variant_iit_eytzinger = iit<int, variant, variant_beg, variant_end, std::vector, iit_eytzinger<iit_soa>>;
+using variant_iitii_eytzinger = iitii<int, variant, variant_beg, variant_end, std::vector, iitii_stats_none, iit_eytzinger<iit_soa>>;